@@ -0,0 +1,15 @@
+# find the 16-bit PCRE2 library and header if available
+# This module defines
+#  PCRE2_INCLUDE_DIR, where to find pcre2.h
+#  PCRE2_LIBRARIES, the libraries needed to link against pcre2-16
+#  PCRE2_FOUND, If false, pcre2-16 was not found
+#
+# Redistribution and use is allowed according to the terms of the BSD license.
+# For details see the accompanying COPYING-CMAKE-SCRIPTS file.
+
+find_path(PCRE2_INCLUDE_DIR pcre2.h)
+
+find_library(PCRE2_LIBRARIES NAMES pcre2-16)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(PCRE2 REQUIRED_VARS PCRE2_INCLUDE_DIR PCRE2_LIBRARIES)
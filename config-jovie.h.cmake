@@ -1,2 +1,2 @@
 #cmakedefine SPEECHD_FOUND ${SPEECHD_FOUND}
-
+#cmakedefine PCRE2_FOUND ${PCRE2_FOUND}
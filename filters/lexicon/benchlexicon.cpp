@@ -0,0 +1,185 @@
+#include <QtTest>
+#include <QtCore/QTemporaryFile>
+#include <ktempdir.h>
+#include "benchlexicon.h"
+#include "lexicon.h"
+#include "lexiconbuilder.h"
+
+// Builds lexicons from a shipped word list and from made up words, checks
+// that every word is found with its substitution, and times lookups and
+// opening for lexicons of very different sizes.  Neither should depend on
+// the number of words.
+
+// Writes a lexicon to a temporary file and opens it.
+static bool openLexicon(const LexiconBuilder &builder, QTemporaryFile *file, Lexicon *lexicon)
+{
+    const QByteArray data = builder.data();
+    if (data.isEmpty() || !file->open() || file->write(data) != data.size() || !file->flush())
+        return false;
+    return lexicon->open(file->fileName());
+}
+
+static QString madeUpWord(int i)
+{
+    return QString::fromLatin1("w%1x").arg(i, 0, 36);
+}
+
+void BenchLexicon::wordList()
+{
+    LexiconBuilder builder;
+    QStringList skipped;
+    const int added = builder.addWordList(QLatin1String(WORDLIST_DIR "/abbreviations.xml"), &skipped);
+    QVERIFY(added > 0);
+    QCOMPARE(builder.count(), added);
+    QTemporaryFile file;
+    Lexicon lexicon;
+    QVERIFY(openLexicon(builder, &file, &lexicon));
+    QCOMPARE(lexicon.count(), added);
+
+    // Whole words only, case as the rule says, exact words before folded ones.
+    QString subst;
+    const QString kde = QLatin1String("KDE");
+    QVERIFY(lexicon.lookup(kde.constData(), kde.length(), &subst));
+    QVERIFY(!subst.isEmpty());
+    QVERIFY(subst != kde);
+    const QString kdes = QLatin1String("KDEs");
+    subst.clear();
+    QVERIFY(!lexicon.lookup(kdes.constData(), kdes.length(), &subst));
+    QVERIFY(subst.isEmpty());
+    QVERIFY(!lexicon.lookup(kde.constData(), 0, &subst));
+
+    LexiconBuilder small;
+    QVERIFY(small.add(QLatin1String("Gnu"), QLatin1String("exact"), Qt::CaseSensitive));
+    QVERIFY(small.add(QLatin1String("gnu"), QLatin1String("folded"), Qt::CaseInsensitive));
+    QVERIFY(small.add(QLatin1String("GNU"), QLatin1String("ignored"), Qt::CaseInsensitive));
+    QVERIFY(!small.add(QLatin1String("two words"), QLatin1String("x"), Qt::CaseSensitive));
+    QVERIFY(small.add(QString::fromUtf8("Stra\xc3\x9f" "e"), QLatin1String("street"), Qt::CaseInsensitive));
+    QCOMPARE(small.count(), 3);
+    QTemporaryFile smallFile;
+    Lexicon smallLexicon;
+    QVERIFY(openLexicon(small, &smallFile, &smallLexicon));
+    const char * const words[][2] = {
+        { "Gnu", "exact" }, { "gnu", "folded" }, { "gNU", "folded" },
+        { "STRA\xc3\x9f" "E", "street" }, { "stra\xc3\x9f" "e", "street" }, { "gnus", 0 }
+    };
+    for (uint i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+    {
+        const QString word = QString::fromUtf8(words[i][0]);
+        subst.clear();
+        QCOMPARE(smallLexicon.lookup(word.constData(), word.length(), &subst), words[i][1] != 0);
+        QCOMPARE(subst, QString::fromUtf8(words[i][1]));
+    }
+}
+
+void BenchLexicon::badFiles()
+{
+    Lexicon lexicon;
+    QVERIFY(!lexicon.open(QLatin1String(WORDLIST_DIR "/abbreviations.xml")));
+    QVERIFY(!lexicon.isOpen());
+
+    LexiconBuilder builder;
+    for (int i = 0; i < 100; ++i)
+        QVERIFY(builder.add(madeUpWord(i), QLatin1String("x"), Qt::CaseSensitive));
+    QByteArray data = builder.data();
+    for (int size = 0; size < data.size(); size += 7)
+    {
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        file.write(data.left(size));
+        file.flush();
+        QVERIFY(!lexicon.open(file.fileName()));
+    }
+}
+
+void BenchLexicon::rewrite()
+{
+    // Writing a lexicon over one that is mapped leaves the mapping intact.
+    KTempDir dir;
+    QVERIFY(dir.exists());
+    const QString fileName = dir.name() + QLatin1String("test.lex");
+    LexiconBuilder first;
+    for (int i = 0; i < 1000; ++i)
+        QVERIFY(first.add(madeUpWord(i), QLatin1String("first"), Qt::CaseSensitive));
+    QVERIFY(first.write(fileName));
+    Lexicon mapped;
+    QVERIFY(mapped.open(fileName));
+
+    LexiconBuilder second;
+    QVERIFY(second.add(QLatin1String("word"), QLatin1String("second"), Qt::CaseSensitive));
+    QVERIFY(second.write(fileName));
+
+    QString subst;
+    const QString word = madeUpWord(999);
+    QVERIFY(mapped.lookup(word.constData(), word.length(), &subst));
+    QCOMPARE(subst, QString::fromLatin1("first"));
+    Lexicon reopened;
+    QVERIFY(reopened.open(fileName));
+    QCOMPARE(reopened.count(), 1);
+}
+
+void BenchLexicon::lookup_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::newRow("1000 words") << 1000;
+    QTest::newRow("100000 words") << 100000;
+}
+
+void BenchLexicon::lookup()
+{
+    QFETCH(int, size);
+    LexiconBuilder builder;
+    for (int i = 0; i < size; ++i)
+        QVERIFY(builder.add(madeUpWord(i), madeUpWord(i).toUpper(), i % 2 ? Qt::CaseSensitive : Qt::CaseInsensitive));
+    QTemporaryFile file;
+    Lexicon lexicon;
+    QVERIFY(openLexicon(builder, &file, &lexicon));
+    QCOMPARE(lexicon.count(), size);
+
+    // Every word is found, half of the looked up words are not there.
+    QString subst;
+    for (int i = 0; i < size; ++i)
+    {
+        const QString word = madeUpWord(i);
+        subst.clear();
+        QVERIFY(lexicon.lookup(word.constData(), word.length(), &subst));
+        QCOMPARE(subst, word.toUpper());
+    }
+    QStringList words;
+    for (int i = 0; i < 1000; ++i)
+        words.append(madeUpWord(i * (size / 500)));
+    int found = 0;
+    QBENCHMARK {
+        found = 0;
+        foreach (const QString &word, words)
+        {
+            subst.clear();
+            if (lexicon.lookup(word.constData(), word.length(), &subst))
+                ++found;
+        }
+    }
+    QCOMPARE(found, 500);
+}
+
+void BenchLexicon::open_data()
+{
+    lookup_data();
+}
+
+void BenchLexicon::open()
+{
+    QFETCH(int, size);
+    LexiconBuilder builder;
+    for (int i = 0; i < size; ++i)
+        QVERIFY(builder.add(madeUpWord(i), QLatin1String("x"), Qt::CaseSensitive));
+    QTemporaryFile file;
+    Lexicon lexicon;
+    QVERIFY(openLexicon(builder, &file, &lexicon));
+    lexicon.close();
+    QBENCHMARK {
+        lexicon.open(file.fileName());
+        lexicon.close();
+    }
+}
+
+QTEST_MAIN(BenchLexicon)
+#include "benchlexicon.moc"
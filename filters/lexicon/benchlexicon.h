@@ -0,0 +1,20 @@
+#ifndef BENCHLEXICON_H
+#define BENCHLEXICON_H
+
+#include <QObject>
+
+class BenchLexicon : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void wordList();
+    void badFiles();
+    void rewrite();
+    void lookup_data();
+    void lookup();
+    void open_data();
+    void open();
+};
+
+#endif // BENCHLEXICON_H
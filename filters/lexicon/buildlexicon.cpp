@@ -0,0 +1,83 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Command line tool that builds pronunciation lexicon files.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTextStream>
+
+#include <klocale.h>
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+
+#include "lexiconbuilder.h"
+
+int main(int argc, char *argv[])
+{
+    KAboutData aboutdata(
+        "jovie-buildlexicon", 0, ki18n("jovie-buildlexicon"),
+        "0.1.0", ki18n("Builds Jovie pronunciation lexicon files from String Replacer word lists."),
+         KAboutData::License_GPL);
+
+    KCmdLineArgs::init( argc, argv, &aboutdata );
+
+    KCmdLineOptions options;
+    options.add("+wordlist", ki18n("Word list XML files, earlier files take precedence (required)"));
+    options.add("o");
+    options.add("output <file>", ki18n("Lexicon file to write"), "lexicon.lex");
+    options.add("v");
+    options.add("verbose", ki18n("List the rules that cannot be put into a lexicon"));
+    KCmdLineArgs::addCmdLineOptions( options );
+
+    QCoreApplication app( KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv() );
+
+    KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+    QTextStream err( stderr, QIODevice::WriteOnly );
+    if (args->count() == 0)
+    {
+        err << i18n("No word list given.") << endl;
+        return 1;
+    }
+
+    LexiconBuilder builder;
+    for (int i = 0; i < args->count(); ++i)
+    {
+        const QString fileName = args->arg(i);
+        QStringList skipped;
+        const int added = builder.addWordList(fileName, &skipped);
+        if (added < 0)
+        {
+            err << i18n("Cannot read word list %1.", fileName) << endl;
+            return 1;
+        }
+        err << i18n("%1: %2 words, %3 rules skipped", fileName, added, skipped.count()) << endl;
+        if (args->isSet("verbose"))
+        {
+            foreach (const QString& match, skipped)
+                err << "    " << match << endl;
+        }
+    }
+
+    const QString output = args->getOption("output");
+    if (!builder.write(output))
+    {
+        err << i18n("Cannot write lexicon %1.", output) << endl;
+        return 1;
+    }
+    err << i18n("%1: %2 words", output, builder.count()) << endl;
+    return 0;
+}
@@ -0,0 +1,214 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Pronunciation lexicon read from a memory-mapped perfect hash table.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+// Lexicon includes.
+#include "lexicon.h"
+
+// Qt includes.
+#include <QtCore/QtEndian>
+
+// KDE includes.
+#include <kdebug.h>
+
+static inline quint32 read32(const uchar* p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+static inline quint16 read16(const uchar* p)
+{
+    return qFromLittleEndian<quint16>(p);
+}
+
+// Final mixing step of MurmurHash3, so that all bits of the hash depend on
+// all bits of the word.
+static inline quint32 mix(quint32 h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+Lexicon::Lexicon() :
+    m_data(0),
+    m_size(0),
+    m_maxWordLength(0),
+    m_strings(0),
+    m_stringsLength(0)
+{
+    for (int table = 0; table < 2; ++table)
+    {
+        m_count[table] = 0;
+        m_buckets[table] = 0;
+        m_seeds[table] = 0;
+        m_slots[table] = 0;
+    }
+}
+
+Lexicon::~Lexicon()
+{
+    close();
+}
+
+bool Lexicon::open(const QString& fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+    m_size = m_file.size();
+    m_data = m_size >= HeaderSize ? m_file.map(0, m_size) : 0;
+    if (!m_data || read32(m_data) != Magic || read32(m_data + 4) != Version)
+    {
+        kDebug() << "Lexicon::open: " << fileName << " is not a lexicon";
+        close();
+        return false;
+    }
+    m_maxWordLength = read32(m_data + 8);
+    const quint64 stringsOffset = read32(m_data + 12);
+    m_stringsLength = read32(m_data + 16);
+    bool valid = stringsOffset + 2 * quint64(m_stringsLength) <= quint64(m_size);
+    m_strings = m_data + stringsOffset;
+    for (int table = 0; table < 2; ++table)
+    {
+        const uchar* p = m_data + 20 + 16 * table;
+        m_count[table] = read32(p);
+        m_buckets[table] = read32(p + 4);
+        const quint64 seedsOffset = read32(p + 8);
+        const quint64 slotsOffset = read32(p + 12);
+        valid = valid && (m_count[table] == 0 || m_buckets[table] > 0) &&
+            seedsOffset + 4 * quint64(m_buckets[table]) <= quint64(m_size) &&
+            slotsOffset + SlotSize * quint64(m_count[table]) <= quint64(m_size);
+        m_seeds[table] = m_data + seedsOffset;
+        m_slots[table] = m_data + slotsOffset;
+    }
+    if (!valid)
+    {
+        kDebug() << "Lexicon::open: " << fileName << " is damaged";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Lexicon::close()
+{
+    if (m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+    m_file.close();
+    m_data = 0;
+    m_size = 0;
+    m_maxWordLength = 0;
+    m_strings = 0;
+    m_stringsLength = 0;
+    for (int table = 0; table < 2; ++table)
+    {
+        m_count[table] = 0;
+        m_buckets[table] = 0;
+    }
+}
+
+bool Lexicon::isOpen() const
+{
+    return m_data != 0;
+}
+
+int Lexicon::count() const
+{
+    return m_count[ExactTable] + m_count[FoldedTable];
+}
+
+int Lexicon::maxWordLength() const
+{
+    return m_maxWordLength;
+}
+
+bool Lexicon::isWordChar(QChar c)
+{
+    return c.isLetterOrNumber() || c.isMark() || c == QLatin1Char('_');
+}
+
+quint32 Lexicon::hash(const QChar* word, int length, quint32 seed, bool fold)
+{
+    // FNV-1a over the code units, started from the mixed seed.
+    quint32 h = 2166136261u ^ mix(seed + 0x9e3779b9u);
+    for (int i = 0; i < length; ++i)
+    {
+        const ushort c = fold ? word[i].toCaseFolded().unicode() : word[i].unicode();
+        h = (h ^ c) * 16777619u;
+    }
+    return mix(h);
+}
+
+int Lexicon::find(int table, const QChar* word, int length) const
+{
+    const quint32 count = m_count[table];
+    if (count == 0)
+        return -1;
+    const bool fold = table == FoldedTable;
+    const quint32 bucket = hash(word, length, 0, fold) % m_buckets[table];
+    const quint32 seed = read32(m_seeds[table] + 4 * bucket);
+    const quint32 slot = (seed & DirectSlot) ? (seed & ~DirectSlot) : hash(word, length, seed, fold) % count;
+    if (slot >= count)
+        return -1;
+    // The slot of a word that is not in the table holds another word.
+    const uchar* p = m_slots[table] + SlotSize * slot;
+    const quint32 keyOffset = read32(p);
+    const int keyLength = read16(p + 8);
+    if (keyLength != length || quint64(keyOffset) + keyLength > m_stringsLength)
+        return -1;
+    const uchar* key = m_strings + 2 * keyOffset;
+    for (int i = 0; i < length; ++i)
+    {
+        const ushort c = fold ? word[i].toCaseFolded().unicode() : word[i].unicode();
+        if (read16(key + 2 * i) != c)
+            return -1;
+    }
+    return slot;
+}
+
+bool Lexicon::lookup(const QChar* word, int length, QString* subst) const
+{
+    if (length > m_maxWordLength)
+        return false;
+    int table = ExactTable;
+    int slot = find(table, word, length);
+    if (slot < 0)
+    {
+        table = FoldedTable;
+        slot = find(table, word, length);
+        if (slot < 0)
+            return false;
+    }
+    const uchar* p = m_slots[table] + SlotSize * slot;
+    const quint32 offset = read32(p + 4);
+    const int length16 = read16(p + 10);
+    if (quint64(offset) + length16 > m_stringsLength)
+        return false;
+    const uchar* s = m_strings + 2 * offset;
+    const int start = subst->length();
+    subst->resize(start + length16);
+    QChar* out = subst->data() + start;
+    for (int i = 0; i < length16; ++i)
+        out[i] = QChar(read16(s + 2 * i));
+    return true;
+}
@@ -0,0 +1,150 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Pronunciation lexicon read from a memory-mapped perfect hash table.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef LEXICON_H
+#define LEXICON_H
+
+// Qt includes.
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+/**
+ * @class Lexicon
+ *
+ * A word list of any size, looked up in constant time.  The file, written
+ * by @ref LexiconBuilder, holds two minimal perfect hash tables: one of
+ * words whose case must match and one of case folded words.  The file is
+ * mapped, not read, so opening even a large lexicon costs next to nothing
+ * and all filters using it share its pages.
+ *
+ * File layout, all integers little-endian, strings UTF-16LE:
+ *
+ *   header      magic, version, longest word, strings offset, strings
+ *               length, and for each table: entries, buckets, seeds
+ *               offset, slots offset
+ *   per table   seeds: 32 bits per bucket
+ *               slots: key offset (32), substitution offset (32),
+ *                      key length (16), substitution length (16)
+ *   strings     keys and substitutions, offsets and lengths in code units
+ *
+ * A word hashes with seed 0 to its bucket.  The bucket's seed either has
+ * the top bit set, and the rest is the word's slot, or is the seed the word
+ * hashes with to its slot.  The slot's key tells whether the word is in the
+ * table at all.
+ */
+class Lexicon
+{
+public:
+    enum {
+        Magic = 0x58454c4a,             /* "JLEX" */
+        Version = 1,
+        HeaderSize = 52,
+        SlotSize = 12
+    };
+
+    /** Top bit of a bucket seed that holds the slot of the bucket's word. */
+    static const quint32 DirectSlot = 0x80000000u;
+
+    enum Table {
+        ExactTable = 0,                 /* Words whose case must match. */
+        FoldedTable = 1                 /* Case folded words. */
+    };
+
+    /**
+     * Constructs a lexicon that is not open.
+     */
+    Lexicon();
+
+    /**
+     * Destructor.  Unmaps the file.
+     */
+    ~Lexicon();
+
+    /**
+     * Maps a lexicon file.
+     * @return               False if the file cannot be mapped or is not a
+     *                       lexicon of this version.
+     */
+    bool open(const QString& fileName);
+
+    /**
+     * Unmaps the file.
+     */
+    void close();
+
+    /**
+     * Returns True if a lexicon file is mapped.
+     */
+    bool isOpen() const;
+
+    /**
+     * Returns the number of words.
+     */
+    int count() const;
+
+    /**
+     * Returns the length of the longest word.
+     */
+    int maxWordLength() const;
+
+    /**
+     * Looks a word up.  A word whose case must match is preferred to a case
+     * folded one.
+     * @param word           Characters of the word.
+     * @param length         Number of characters.
+     * @param subst          The substitution is appended to it if the word
+     *                       is found.
+     * @return               True if the word was found.
+     */
+    bool lookup(const QChar* word, int length, QString* subst) const;
+
+    /**
+     * Returns True if a character is part of a word, that is, matched by
+     * \\w of the Word rules of a String Replacer word list.
+     */
+    static bool isWordChar(QChar c);
+
+    /**
+     * The hash function of the tables.  It goes by the UTF-16 code units,
+     * so files are the same on every platform.
+     * @param fold           Hash the case folded word.
+     */
+    static quint32 hash(const QChar* word, int length, quint32 seed, bool fold);
+
+private:
+    Q_DISABLE_COPY(Lexicon)
+
+    // Returns the slot of a word in a table, or -1.
+    int find(int table, const QChar* word, int length) const;
+
+    QFile m_file;
+    const uchar* m_data;
+    qint64 m_size;
+    int m_maxWordLength;
+    // Strings, and their length in code units.
+    const uchar* m_strings;
+    quint32 m_stringsLength;
+    // Entries, buckets, seeds and slots of each table.
+    quint32 m_count[2];
+    quint32 m_buckets[2];
+    const uchar* m_seeds[2];
+    const uchar* m_slots[2];
+};
+
+#endif      // LEXICON_H
@@ -0,0 +1,295 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Writes pronunciation lexicon files from String Replacer word lists.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+// Lexicon includes.
+#include "lexiconbuilder.h"
+#include "lexicon.h"
+
+// Qt includes.
+#include <QtCore/QFile>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QtEndian>
+#include <QtXml/QDomDocument>
+
+// KDE includes.
+#include <ksavefile.h>
+
+// KTTS includes.
+#include "cdataescaper.h"
+
+/**
+ * Average number of words per bucket.  More buckets make seeds quicker to
+ * find and the file bigger.
+ */
+static const int WordsPerBucket = 4;
+
+/**
+ * Seeds tried for a bucket before giving up.
+ */
+static const quint32 MaxSeed = 1 << 24;
+
+static inline void put32(QByteArray* data, int pos, quint32 value)
+{
+    qToLittleEndian<quint32>(value, reinterpret_cast<uchar*>(data->data() + pos));
+}
+
+static inline void put16(QByteArray* data, int pos, quint16 value)
+{
+    qToLittleEndian<quint16>(value, reinterpret_cast<uchar*>(data->data() + pos));
+}
+
+// Orders buckets by descending size, so that the big ones, whose seeds are
+// hard to find, are placed while the table is still empty.
+struct LargerBucket
+{
+    explicit LargerBucket(const QVector< QList<int> >* members) : m_members(members) { }
+    bool operator()(int a, int b) const { return m_members->at(a).count() > m_members->at(b).count(); }
+    const QVector< QList<int> >* m_members;
+};
+
+// Returns True if a substitution refers to groups of a regular expression.
+static bool hasBackReference(const QString& subst)
+{
+    for (int i = 0; i + 1 < subst.length(); ++i)
+    {
+        if (subst.at(i) == QLatin1Char('\\') && subst.at(i + 1).isDigit())
+            return true;
+    }
+    return false;
+}
+
+LexiconBuilder::LexiconBuilder() :
+    m_maxWordLength(0)
+{
+}
+
+bool LexiconBuilder::add(const QString& word, const QString& subst, Qt::CaseSensitivity cs)
+{
+    if (word.isEmpty() || word.length() > 0xffff || subst.length() > 0xffff)
+        return false;
+    for (int i = 0; i < word.length(); ++i)
+    {
+        if (!Lexicon::isWordChar(word.at(i)))
+            return false;
+    }
+    const int table = cs == Qt::CaseSensitive ? Lexicon::ExactTable : Lexicon::FoldedTable;
+    const QString key = table == Lexicon::FoldedTable ? word.toCaseFolded() : word;
+    if (m_keys[table].contains(key))
+        return true;
+    m_keys[table].insert(key);
+    Entry entry;
+    entry.key = key;
+    entry.subst = subst;
+    m_entries[table].append(entry);
+    m_maxWordLength = qMax(m_maxWordLength, key.length());
+    return true;
+}
+
+int LexiconBuilder::addWordList(const QString& fileName, QStringList* skipped)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+    QDomDocument doc(QLatin1String( "" ));
+    if (!doc.setContent(&file))
+        return -1;
+    file.close();
+
+    int added = 0;
+    QDomNodeList wordList = doc.elementsByTagName(QLatin1String( "word" ));
+    const int wordListCount = wordList.count();
+    for (int wordIndex = 0; wordIndex < wordListCount; ++wordIndex)
+    {
+        QDomNodeList propList = wordList.item(wordIndex).childNodes();
+        QString wordType;
+        QString matchCase = QLatin1String( "No" );
+        QString match;
+        QString subst;
+        const int propListCount = propList.count();
+        for (int propIndex = 0; propIndex < propListCount; ++propIndex)
+        {
+            QDomElement prop = propList.item(propIndex).toElement();
+            if (prop.tagName() == QLatin1String( "type" )) wordType = prop.text();
+            if (prop.tagName() == QLatin1String( "case" )) matchCase = prop.text();
+            if (prop.tagName() == QLatin1String( "match" ))
+            {
+                match = prop.text();
+                cdataUnescape(&match);
+            }
+            if (prop.tagName() == QLatin1String( "subst" ))
+            {
+                subst = prop.text();
+                cdataUnescape(&subst);
+            }
+        }
+        // As in StringReplacerProc, "Yes" means the case does not matter.
+        const Qt::CaseSensitivity cs =
+            matchCase == QLatin1String( "Yes" ) ? Qt::CaseInsensitive : Qt::CaseSensitive;
+        if (wordType == QLatin1String( "Word" ) && !hasBackReference(subst) && add(match, subst, cs))
+            ++added;
+        else if (skipped)
+            skipped->append(match);
+    }
+    return added;
+}
+
+int LexiconBuilder::count() const
+{
+    return m_entries[Lexicon::ExactTable].count() + m_entries[Lexicon::FoldedTable].count();
+}
+
+bool LexiconBuilder::buildTable(int table, QByteArray* seeds, QByteArray* slots, QVector<ushort>* strings) const
+{
+    const QList<Entry>& entries = m_entries[table];
+    const quint32 count = entries.count();
+    seeds->clear();
+    slots->clear();
+    if (count == 0)
+        return true;
+    const bool fold = table == Lexicon::FoldedTable;
+    const quint32 bucketCount = count / WordsPerBucket + 1;
+
+    QVector< QList<int> > members(bucketCount);
+    for (quint32 i = 0; i < count; ++i)
+    {
+        const QString& key = entries.at(i).key;
+        members[Lexicon::hash(key.constData(), key.length(), 0, fold) % bucketCount].append(i);
+    }
+    QVector<int> order(bucketCount);
+    for (quint32 b = 0; b < bucketCount; ++b)
+        order[b] = b;
+    qStableSort(order.begin(), order.end(), LargerBucket(&members));
+
+    seeds->fill(0, 4 * bucketCount);
+    QVector<int> slotOf(count, -1);
+    QVector<bool> taken(count, false);
+    quint32 nextFree = 0;
+    foreach (int b, order)
+    {
+        const QList<int>& keys = members.at(b);
+        if (keys.isEmpty())
+            break;
+        if (keys.count() == 1)
+        {
+            // A bucket of one word names its slot.
+            while (taken.at(nextFree))
+                ++nextFree;
+            taken[nextFree] = true;
+            slotOf[keys.first()] = nextFree;
+            put32(seeds, 4 * b, Lexicon::DirectSlot | nextFree);
+            continue;
+        }
+        quint32 seed = 1;
+        QVarLengthArray<quint32, 16> placed;
+        for (; seed < MaxSeed; ++seed)
+        {
+            placed.clear();
+            foreach (int i, keys)
+            {
+                const QString& key = entries.at(i).key;
+                const quint32 slot = Lexicon::hash(key.constData(), key.length(), seed, fold) % count;
+                bool free = !taken.at(slot);
+                for (int j = 0; free && j < placed.size(); ++j)
+                    free = placed[j] != slot;
+                if (!free)
+                    break;
+                placed.append(slot);
+            }
+            if (placed.size() == keys.count())
+                break;
+        }
+        if (seed == MaxSeed)
+            return false;
+        for (int j = 0; j < keys.count(); ++j)
+        {
+            taken[placed[j]] = true;
+            slotOf[keys.at(j)] = placed[j];
+        }
+        put32(seeds, 4 * b, seed);
+    }
+
+    slots->fill(0, Lexicon::SlotSize * count);
+    for (quint32 i = 0; i < count; ++i)
+    {
+        const Entry& entry = entries.at(i);
+        const int pos = Lexicon::SlotSize * slotOf.at(i);
+        put32(slots, pos, strings->size());
+        for (int c = 0; c < entry.key.length(); ++c)
+            strings->append(entry.key.at(c).unicode());
+        put32(slots, pos + 4, strings->size());
+        for (int c = 0; c < entry.subst.length(); ++c)
+            strings->append(entry.subst.at(c).unicode());
+        put16(slots, pos + 8, entry.key.length());
+        put16(slots, pos + 10, entry.subst.length());
+    }
+    return true;
+}
+
+QByteArray LexiconBuilder::data() const
+{
+    QByteArray seeds[2];
+    QByteArray slots[2];
+    QVector<ushort> strings;
+    for (int table = 0; table < 2; ++table)
+    {
+        if (!buildTable(table, &seeds[table], &slots[table], &strings))
+            return QByteArray();
+    }
+
+    QByteArray data(Lexicon::HeaderSize, '\0');
+    put32(&data, 0, Lexicon::Magic);
+    put32(&data, 4, Lexicon::Version);
+    put32(&data, 8, m_maxWordLength);
+    for (int table = 0; table < 2; ++table)
+    {
+        const int pos = 20 + 16 * table;
+        put32(&data, pos, m_entries[table].count());
+        put32(&data, pos + 4, seeds[table].size() / 4);
+        put32(&data, pos + 8, data.size());
+        data += seeds[table];
+        put32(&data, pos + 12, data.size());
+        data += slots[table];
+    }
+    put32(&data, 12, data.size());
+    put32(&data, 16, strings.size());
+    const int stringsOffset = data.size();
+    data.resize(stringsOffset + 2 * strings.size());
+    for (int i = 0; i < strings.size(); ++i)
+        put16(&data, stringsOffset + 2 * i, strings.at(i));
+    return data;
+}
+
+bool LexiconBuilder::write(const QString& fileName) const
+{
+    const QByteArray lexicon = data();
+    if (lexicon.isEmpty())
+        return false;
+    // A daemon may have the old file mapped.  Truncating it would cost the
+    // daemon a SIGBUS, so the new file replaces it by a rename.
+    KSaveFile file(fileName);
+    if (!file.open())
+        return false;
+    if (file.write(lexicon) != lexicon.size())
+    {
+        file.abort();
+        return false;
+    }
+    return file.finalize();
+}
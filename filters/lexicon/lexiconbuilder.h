@@ -0,0 +1,103 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Writes pronunciation lexicon files from String Replacer word lists.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef LEXICONBUILDER_H
+#define LEXICONBUILDER_H
+
+// Qt includes.
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+/**
+ * @class LexiconBuilder
+ *
+ * Collects words and their substitutions and writes them as a @ref Lexicon
+ * file.  Words come one by one or from the Word rules of String Replacer
+ * word lists, such as abbreviations.xml.
+ *
+ * The first substitution given for a word is kept, as the first rule that
+ * replaces a word wins in a word list.  Unlike a word list, a lexicon
+ * replaces each word of a text at most once: a substitution is not looked
+ * up again.
+ */
+class LexiconBuilder
+{
+public:
+    LexiconBuilder();
+
+    /**
+     * Adds a word.
+     * @param word           The word.  Only letters, digits, marks and _.
+     * @param subst          What to speak instead.
+     * @param cs             Whether letter case must match.
+     * @return               False if @p word is not a single word, or too
+     *                       long.  A word that is already there is ignored.
+     */
+    bool add(const QString& word, const QString& subst, Qt::CaseSensitivity cs);
+
+    /**
+     * Adds the Word rules of a String Replacer word list.
+     * @param fileName       Word list XML file.
+     * @param skipped        Receives the match of each rule that cannot be
+     *                       put into a lexicon: RegExp rules, and Word rules
+     *                       that are not a single word.
+     * @return               Number of rules added, or -1 if the file could
+     *                       not be read.
+     */
+    int addWordList(const QString& fileName, QStringList* skipped);
+
+    /**
+     * Returns the number of words.
+     */
+    int count() const;
+
+    /**
+     * Returns the lexicon file contents.  Empty if no hash table could be
+     * found, which does not happen in practice.
+     */
+    QByteArray data() const;
+
+    /**
+     * Writes the lexicon file.  It replaces an old one by a rename, so a
+     * lexicon mapped with @ref Lexicon::open stays intact.
+     * @return               False if it could not be written.
+     */
+    bool write(const QString& fileName) const;
+
+private:
+    struct Entry
+    {
+        QString key;
+        QString subst;
+    };
+
+    // Lays out one table.  Returns False if no seeds were found.
+    bool buildTable(int table, QByteArray* seeds, QByteArray* slots, QVector<ushort>* strings) const;
+
+    // Entries and their keys of each Lexicon::Table.
+    QList<Entry> m_entries[2];
+    QSet<QString> m_keys[2];
+    int m_maxWordLength;
+};
+
+#endif      // LEXICONBUILDER_H
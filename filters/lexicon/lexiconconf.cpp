@@ -0,0 +1,117 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Pronunciation Lexicon Filter Configuration class.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+// Lexicon includes.
+#include "lexiconconf.h"
+#include "lexiconconf.moc"
+
+// Qt includes.
+#include <QtCore/QFileInfo>
+
+// KDE includes.
+#include <klocale.h>
+#include <klineedit.h>
+#include <kconfig.h>
+#include <kurlrequester.h>
+
+// KTTS includes.
+#include "filterconf.h"
+
+/**
+* Constructor
+*/
+LexiconConf::LexiconConf( QWidget *parent, const QVariantList &args) :
+    KttsFilterConf(parent, args)
+{
+    Q_UNUSED(args);
+
+    // Create configuration widget.
+    setupUi(this);
+
+    // Set up defaults.
+    defaults();
+
+    // Connect signals.
+    connect( nameLineEdit, SIGNAL(textChanged(QString)),
+         this, SLOT(configChanged()));
+    connect( lexiconPath, SIGNAL(textChanged(QString)),
+         this, SLOT(configChanged()) );
+    connect( appIdLineEdit, SIGNAL(textChanged(QString)),
+         this, SLOT(configChanged()) );
+}
+
+/**
+* Destructor.
+*/
+LexiconConf::~LexiconConf(){
+}
+
+void LexiconConf::load(KConfig* c, const QString& configGroup){
+    KConfigGroup config( c, configGroup );
+    nameLineEdit->setText( config.readEntry( "UserFilterName", nameLineEdit->text() ) );
+    lexiconPath->setUrl( KUrl::fromPath( config.readEntry( "LexiconFile", lexiconPath->url().path() ) ) );
+    appIdLineEdit->setText(
+            config.readEntry( "AppID", appIdLineEdit->text() ) );
+}
+
+void LexiconConf::save(KConfig* c, const QString& configGroup){
+    KConfigGroup config( c, configGroup );
+    config.writeEntry( "UserFilterName", nameLineEdit->text() );
+    config.writeEntry( "LexiconFile", realFilePath( lexiconPath->url().path() ) );
+    config.writeEntry( "AppID", appIdLineEdit->text().remove(QLatin1Char( ' ' )) );
+}
+
+/**
+* This function is called to set the settings in the module to sensible
+* default values. It gets called when hitting the "Default" button. The
+* default values should probably be the same as the ones the application
+* uses when started without a config file.  Note that defaults should
+* be applied to the on-screen widgets; not to the config file.
+*/
+void LexiconConf::defaults(){
+    // Default name.
+    nameLineEdit->setText(i18n( "Pronunciation Lexicon" ));
+    // No lexicon until the user builds one.
+    lexiconPath->clear();
+    // Default App ID to blank.
+    appIdLineEdit->clear();
+}
+
+/**
+ * Indicates whether the plugin supports multiple instances.  Return
+ * False if only one instance of the plugin can be configured.
+ * @return            True if multiple instances are possible.
+ */
+bool LexiconConf::supportsMultiInstance() { return true; }
+
+/**
+ * Returns the name of the plugin.  Displayed in Filters tab of KTTSMgr.
+ * If there can be more than one instance of a filter, it should return
+ * a unique name for each instance.  The name should be translated for
+ * the user if possible.  If the plugin is not correctly configured,
+ * return an empty string.
+ * @return          Filter instance name.
+ */
+QString LexiconConf::userPlugInName()
+{
+    const QString filePath = realFilePath(lexiconPath->url().path());
+    if (filePath.isEmpty()) return QString();
+    if (!QFileInfo(filePath).isFile()) return QString();
+    return nameLineEdit->text();
+}
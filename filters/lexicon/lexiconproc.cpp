@@ -0,0 +1,192 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Pronunciation Lexicon Filter Processing class.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+// Lexicon includes.
+#include "lexiconproc.h"
+#include "lexiconproc.moc"
+
+// Qt includes.
+#include <QtCore/QStringRef>
+
+// KDE includes.
+#include <kdebug.h>
+#include <kconfig.h>
+#include <kconfiggroup.h>
+
+// KTTS includes.
+#include "talkercode.h"
+
+/**
+ * Constructor.
+ */
+LexiconProc::LexiconProc( QObject *parent, const QVariantList& args ) :
+    KttsFilterProc(parent, args),
+    m_wasModified(false),
+    m_inLongWord(false)
+{
+}
+
+/**
+ * Destructor.
+ */
+/*virtual*/ LexiconProc::~LexiconProc()
+{
+}
+
+bool LexiconProc::init(KConfig* c, const QString& configGroup)
+{
+    KConfigGroup config( c, configGroup );
+    m_appIdList = config.readEntry( "AppID", QStringList() );
+    m_pending.clear();
+    m_inLongWord = false;
+    const QString fileName = config.readEntry( "LexiconFile" );
+    if ( fileName.isEmpty() || !m_lexicon.open( fileName ) )
+    {
+        kDebug() << "LexiconProc::init: could not open lexicon " << fileName;
+        m_lexicon.close();
+        return false;
+    }
+    kDebug() << "LexiconProc::init: " << fileName << " has " << m_lexicon.count() << " words";
+    return true;
+}
+
+/*virtual*/ QString LexiconProc::convert(const QString& inputText, TalkerCode* talkerCode,
+    const QString& appId)
+{
+    Q_UNUSED(talkerCode);
+    m_wasModified = false;
+    if ( !m_lexicon.isOpen() )
+        return inputText;
+    // If appId doesn't match, return input unmolested.
+    if ( !m_appIdList.isEmpty() )
+    {
+        bool found = false;
+        foreach ( const QString& id, m_appIdList )
+        {
+            if ( appId.contains( id ) )
+            {
+                found = true;
+                break;
+            }
+        }
+        if ( !found )
+            return inputText;
+    }
+
+    // The output is only built once a word is found, and then in one pass.
+    const QChar* text = inputText.constData();
+    const int length = inputText.length();
+    QString output;
+    int copied = 0;
+    int pos = 0;
+    while ( pos < length )
+    {
+        while ( pos < length && !Lexicon::isWordChar( text[pos] ) )
+            ++pos;
+        const int start = pos;
+        while ( pos < length && Lexicon::isWordChar( text[pos] ) )
+            ++pos;
+        if ( pos == start )
+            break;
+        if ( !m_wasModified )
+        {
+            // Try the word in place before copying anything.
+            QString subst;
+            if ( !m_lexicon.lookup( text + start, pos - start, &subst ) )
+                continue;
+            m_wasModified = true;
+            output.reserve( length + length / 8 );
+            output.append( inputText.midRef( 0, start ) );
+            output.append( subst );
+        }
+        else
+        {
+            const int end = output.length();
+            output.append( inputText.midRef( copied, start - copied ) );
+            if ( !m_lexicon.lookup( text + start, pos - start, &output ) )
+            {
+                output.truncate( end );
+                continue;
+            }
+        }
+        copied = pos;
+    }
+    if ( !m_wasModified )
+        return inputText;
+    output.append( inputText.midRef( copied ) );
+    return output;
+}
+
+/**
+ * Did this filter do anything?  If the filter returns the input as output
+ * unmolested, it should return False when this method is called.
+ */
+/*virtual*/ bool LexiconProc::wasModified() { return m_wasModified; }
+
+/*virtual*/ bool LexiconProc::supportsSplitting() { return true; }
+
+/*virtual*/ bool LexiconProc::supportsStreaming() { return true; }
+
+/*virtual*/ int LexiconProc::holdback() { return m_lexicon.maxWordLength(); }
+
+/*virtual*/ bool LexiconProc::isHolding() { return !m_pending.isEmpty() || m_inLongWord; }
+
+/*virtual*/ QString LexiconProc::feed(const QString& chunk, TalkerCode* talkerCode,
+    const QString& appId)
+{
+    // The rest of a word too long for the lexicon goes out as it is.
+    int from = 0;
+    if ( m_inLongWord )
+    {
+        while ( from < chunk.length() && Lexicon::isWordChar( chunk.at( from ) ) )
+            ++from;
+        m_inLongWord = from == chunk.length();
+    }
+    const QString passed = chunk.left( from );
+    m_pending += chunk.midRef( from );
+
+    // Cut after the last character that is not part of a word, so no word
+    // is looked up in two pieces.  A word already longer than any in the
+    // lexicon is not replaced however it ends, so it need not wait.
+    int cut = m_pending.length();
+    while ( cut > 0 && Lexicon::isWordChar( m_pending.at( cut - 1 ) ) )
+        --cut;
+    if ( m_pending.length() - cut > m_lexicon.maxWordLength() )
+    {
+        cut = m_pending.length();
+        m_inLongWord = true;
+    }
+    if ( cut == 0 )
+        return passed;
+    QString text = m_pending.left( cut );
+    m_pending.remove( 0, cut );
+    const bool modified = m_wasModified;
+    text = convert( text, talkerCode, appId );
+    m_wasModified = m_wasModified || modified;
+    return passed + text;
+}
+
+/*virtual*/ QString LexiconProc::flush(TalkerCode* talkerCode, const QString& appId)
+{
+    m_inLongWord = false;
+    if ( m_pending.isEmpty() ) return QString();
+    QString text = m_pending;
+    m_pending.clear();
+    return convert( text, talkerCode, appId );
+}
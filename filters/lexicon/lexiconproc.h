@@ -0,0 +1,126 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Pronunciation Lexicon Filter Processing class.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef LEXICONPROC_H
+#define LEXICONPROC_H
+
+// Qt includes.
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+
+// KTTS includes.
+#include "filterproc.h"
+
+// Lexicon includes.
+#include "lexicon.h"
+
+/**
+ * Replaces the words of a text that are in a lexicon built with
+ * jovie-buildlexicon.  The text is split into words once, and each word is
+ * looked up in constant time, however many words the lexicon has.  Words
+ * are what \\b separates in the Word rules of a String Replacer word list.
+ */
+class LexiconProc : public KttsFilterProc
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Constructor.
+     */
+    explicit LexiconProc( QObject *parent, const QVariantList &args = QVariantList() );
+
+    /**
+     * Destructor.
+     */
+    virtual ~LexiconProc();
+
+    /**
+     * Initialize the filter.
+     * @param c               Settings object.
+     * @param configGroup     Settings Group.
+     * @return                False if filter is not ready to filter.
+     *
+     * Maps the file given by LexiconFile in the filter's group.
+     */
+    virtual bool init(KConfig *c, const QString &configGroup);
+
+    /**
+     * Convert input, returning output.
+     * @param inputText         Input text.
+     * @param talkerCode        TalkerCode structure for the talker that KTTSD intends to
+     *                          use for synthing the text.  Useful for extracting hints about
+     *                          how to filter the text.  For example, languageCode.
+     * @param appId             The DBUS appId of the application that queued the text.
+     *                          Also useful for hints about how to do the filtering.
+     */
+    virtual QString convert(const QString& inputText, TalkerCode* talkerCode, const QString& appId);
+
+    /**
+     * Did this filter do anything?  If the filter returns the input as output
+     * unmolested, it should return False when this method is called.
+     */
+    virtual bool wasModified();
+
+    /**
+     * Returns True.  Words never span a sentence boundary.
+     */
+    virtual bool supportsSplitting();
+
+    /**
+     * Returns True.  A stream is converted up to its last whole word.
+     */
+    virtual bool supportsStreaming();
+
+    /**
+     * Returns the length of the longest word in the lexicon.
+     */
+    virtual int holdback();
+
+    /**
+     * Returns True if part of the stream has not been converted yet, or the
+     * stream is in the middle of a word too long for the lexicon.
+     */
+    virtual bool isHolding();
+
+    /**
+     * Convert the next piece of a stream.
+     */
+    virtual QString feed(const QString& chunk, TalkerCode* talkerCode, const QString& appId);
+
+    /**
+     * Ends a stream and converts the rest of the text.
+     */
+    virtual QString flush(TalkerCode* talkerCode, const QString& appId);
+
+private:
+    // The mapped lexicon.
+    Lexicon m_lexicon;
+    // If not empty, apply filter only to apps containing one or more of these strings.
+    QStringList m_appIdList;
+    // True if this filter did anything to the text.
+    bool m_wasModified;
+    // Stream text not converted yet, at most the longest word.
+    QString m_pending;
+    // True if the stream so far ends inside a word longer than any in the
+    // lexicon.
+    bool m_inLongWord;
+};
+
+#endif      // LEXICONPROC_H
@@ -0,0 +1,401 @@
+#include <QtTest>
+#include <QtCore/QFile>
+#include <QtCore/QRegExp>
+#include <QtXml/QDomDocument>
+#include "benchregexp.h"
+#include "cdataescaper.h"
+#include "chartable.h"
+#include "filterregexp.h"
+#include "rulepattern.h"
+
+// Applies the rules of each shipped word list to a mixed text, once with
+// QRegExp as StringReplacerProc used to and once with FilterRegExp, checks
+// that both give the same text, and times both.  Which engine FilterRegExp
+// uses depends on whether Jovie was built with PCRE2.
+
+struct Rule
+{
+    QString chars;                      // Characters of a Char rule.
+    QString pattern;
+    Qt::CaseSensitivity cs;
+    QString subst;
+};
+
+// Reads the rules of a word list the way StringReplacerProc::init() does.
+static QList<Rule> loadWordList(const QString &fileName)
+{
+    QList<Rule> rules;
+    QFile file(QLatin1String(WORDLIST_DIR "/") + fileName);
+    QDomDocument doc(QLatin1String(""));
+    if (!file.open(QIODevice::ReadOnly) || !doc.setContent(&file))
+        return rules;
+    QDomNodeList wordList = doc.elementsByTagName(QLatin1String("word"));
+    for (int wordIndex = 0; wordIndex < wordList.count(); ++wordIndex)
+    {
+        QDomNodeList propList = wordList.item(wordIndex).childNodes();
+        QString wordType;
+        QString matchCase = QLatin1String("No");
+        Rule rule;
+        for (int propIndex = 0; propIndex < propList.count(); ++propIndex)
+        {
+            QDomElement prop = propList.item(propIndex).toElement();
+            if (prop.tagName() == QLatin1String("type")) wordType = prop.text();
+            if (prop.tagName() == QLatin1String("case")) matchCase = prop.text();
+            if (prop.tagName() == QLatin1String("match"))
+            {
+                rule.pattern = prop.text();
+                cdataUnescape(&rule.pattern);
+            }
+            if (prop.tagName() == QLatin1String("subst"))
+            {
+                rule.subst = prop.text();
+                cdataUnescape(&rule.subst);
+            }
+        }
+        if (wordType == QLatin1String("Word"))
+            rule.pattern = QLatin1String("\\b") + rule.pattern + QLatin1String("\\b");
+        // A Char rule does what the character class of its characters does.
+        if (wordType == QLatin1String("Char"))
+        {
+            rule.chars = rule.pattern;
+            rule.pattern = QLatin1Char('[') + rule.chars + QLatin1Char(']');
+        }
+        rule.cs = matchCase == QLatin1String("Yes") ? Qt::CaseInsensitive : Qt::CaseSensitive;
+        rules.append(rule);
+    }
+    return rules;
+}
+
+static QString sampleText()
+{
+    static const char * const lines[] = {
+        "<qt>&lt;jane&gt; brb, lol :-) see you at the KDE meeting ;) <br></qt>",
+        "<b>TODO:</b> check the CPU load of kttsd over DCOP, IP 10.0.0.1 \xc2\x80 5.",
+        "> Quoted text in /local/inbox says: imho afaik btw \xe2\x80\x9cquotes\xe2\x80\x9d :D",
+        "Za\xc5\xbc\xc3\xb3\xc5\x82\xc4\x87 g\xc4\x99\xc5\x9bl\xc4\x85 ja\xc5\xba\xc5\x84 \xe2\x80\x94 "
+            "caf\xc3\xa9 na\xc3\xafve <h1>Title</h1> &amp; more text.",
+        "Plain sentence without anything to replace, followed by another one."
+    };
+    const int count = sizeof(lines) / sizeof(lines[0]);
+    QString text;
+    for (int i = 0; i < 2000; ++i)
+    {
+        text += QString::fromUtf8(lines[i % count]);
+        text += QLatin1Char('\n');
+    }
+    return text;
+}
+
+static void addWordLists()
+{
+    QTest::addColumn<QString>("wordList");
+    QTest::newRow("abbreviations") << QString::fromLatin1("abbreviations.xml");
+    QTest::newRow("chat") << QString::fromLatin1("chat.xml");
+    QTest::newRow("chat-de") << QString::fromLatin1("chat-de.xml");
+    QTest::newRow("emoticons") << QString::fromLatin1("emoticons.xml");
+    QTest::newRow("festival_unspeakable_chars") << QString::fromLatin1("festival_unspeakable_chars.xml");
+    QTest::newRow("kmail") << QString::fromLatin1("kmail.xml");
+    QTest::newRow("polish_festival_fixes") << QString::fromLatin1("polish_festival_fixes.xml");
+    QTest::newRow("polish_festival_unspeakables") << QString::fromLatin1("polish_festival_unspeakables.xml");
+    QTest::newRow("qt2plaintext") << QString::fromLatin1("qt2plaintext.xml");
+}
+
+static QString applyQRegExp(const QList<QRegExp> &matchList, const QList<Rule> &rules, const QString &text)
+{
+    QString newText = text;
+    for (int i = 0; i < matchList.count(); ++i)
+    {
+        if (matchList.at(i).indexIn(newText) != -1)
+            newText.replace(matchList.at(i), rules.at(i).subst);
+    }
+    return newText;
+}
+
+static QString applyFilterRegExp(const QList<FilterRegExp> &matchList, const QList<Rule> &rules, const QString &text)
+{
+    QString newText = text;
+    for (int i = 0; i < matchList.count(); ++i)
+        matchList.at(i).replace(newText, rules.at(i).subst);
+    return newText;
+}
+
+void BenchRegExp::wordRule()
+{
+    // \b goes by Unicode word characters, as QRegExp's does.
+    FilterRegExp rx(QString::fromUtf8("\\bcaf\xc3\xa9\\b"));
+    QVERIFY(rx.isValid());
+    QCOMPARE(rx.indexIn(QString::fromUtf8("un caf\xc3\xa9 noir")), 3);
+    QCOMPARE(rx.matchedLength(), 4);
+    QCOMPARE(rx.indexIn(QString::fromUtf8("deux caf\xc3\xa9s")), -1);
+    QCOMPARE(rx.indexIn(QString::fromUtf8("\xc3\xa0" "caf\xc3\xa9")), -1);
+
+    // QRegExp's four digit hex escapes, . across lines and $ at the very end.
+    QCOMPARE(FilterRegExp(QLatin1String("\\x20ac")).indexIn(QString::fromUtf8("5 \xe2\x82\xac")), 2);
+    QCOMPARE(FilterRegExp(QLatin1String("a.b")).indexIn(QLatin1String("a\nb")), 0);
+    QCOMPARE(FilterRegExp(QLatin1String("a$")).indexIn(QLatin1String("a\n")), -1);
+    // \v is a vertical tab, not any vertical space.
+    QCOMPARE(FilterRegExp(QLatin1String("a\\vb")).indexIn(QLatin1String("a\vb")), 0);
+    QCOMPARE(FilterRegExp(QLatin1String("a\\vb")).indexIn(QLatin1String("a\nb")), -1);
+
+    // Only what QRegExp takes is valid, whatever PCRE2 makes of it.
+    QVERIFY(!FilterRegExp(QLatin1String("(?i)abc")).isValid());
+    QVERIFY(!FilterRegExp(QLatin1String("(?<=a)b")).isValid());
+    QVERIFY(!FilterRegExp(QLatin1String("(?<=a)b")).isUsable());
+
+    // Back references and empty matches are replaced as QString::replace() does.
+    QString text = QLatin1String("abc");
+    QCOMPARE(FilterRegExp(QLatin1String("x*")).replace(text, QLatin1String("-")), 4);
+    QCOMPARE(text, QString::fromLatin1("-a-b-c-"));
+    text = QLatin1String("One. Two");
+    FilterRegExp(QLatin1String("([.?!])(\\s|$)")).replace(text, QLatin1String("\\1\t"));
+    QCOMPARE(text, QString::fromLatin1("One.\tTwo"));
+    QVERIFY(FilterRegExp(QLatin1String("b")).matchesAt(QLatin1String("abb"), 1));
+    QVERIFY(!FilterRegExp(QLatin1String("b")).matchesAt(QLatin1String("abb"), 0));
+}
+
+void BenchRegExp::hazards()
+{
+    QCOMPARE(FilterRegExp(QLatin1String("(a+)+b")).hazard(), FilterRegExp::NestedRepetition);
+    QCOMPARE(FilterRegExp(QLatin1String("(\\w+\\s?)*$")).hazard(), FilterRegExp::NestedRepetition);
+    QCOMPARE(FilterRegExp(QLatin1String("(a|ab)*c")).hazard(), FilterRegExp::OverlappingAlternatives);
+    QCOMPARE(FilterRegExp(QLatin1String("(a|b)*c")).hazard(), FilterRegExp::NoHazard);
+    // Syntax that is not QRegExp's is not taken to be harmless.
+    QCOMPARE(FilterRegExp(QLatin1String("(a+)+?b")).hazard(), FilterRegExp::NestedRepetition);
+    QCOMPARE(FilterRegExp(QLatin1String("(a*{2,})+b")).hazard(), FilterRegExp::NestedRepetition);
+    QVERIFY(FilterRegExp(QLatin1String("(?<=a)b")).hazard() != FilterRegExp::NoHazard);
+    QVERIFY(FilterRegExp(QLatin1String("(?i)abc")).hazard() != FilterRegExp::NoHazard);
+    QCOMPARE(FilterRegExp(QLatin1String("([\\.\\?\\!\\:\\;])(\\s|$|(\\n *\\n))")).hazard(),
+             FilterRegExp::NoHazard);
+
+    // None of the shipped rules has a hazard.
+    const char * const wordLists[] = { "abbreviations.xml", "chat.xml", "chat-de.xml", "emoticons.xml",
+        "festival_unspeakable_chars.xml", "kmail.xml", "polish_festival_fixes.xml",
+        "polish_festival_unspeakables.xml", "qt2plaintext.xml" };
+    for (uint i = 0; i < sizeof(wordLists) / sizeof(wordLists[0]); ++i)
+    {
+        foreach (const Rule &rule, loadWordList(QLatin1String(wordLists[i])))
+            QCOMPARE(FilterRegExp(rule.pattern, rule.cs).hazard(), FilterRegExp::NoHazard);
+    }
+
+    // A match that backtracks too long gives up and leaves the text alone.
+    FilterRegExp rx(QLatin1String("(a+)+b"));
+    if (!rx.hasMatchLimit())
+    {
+        QVERIFY(!rx.isUsable());
+        return;
+    }
+    QString text = QString(40, QLatin1Char('a'));
+    QTime timer;
+    timer.start();
+    QCOMPARE(rx.replace(text, QLatin1String("x")), 0);
+    QVERIFY(rx.limitReached());
+    QCOMPARE(text, QString(40, QLatin1Char('a')));
+    qDebug() << "gave up after" << timer.elapsed() << "ms";
+}
+
+void BenchRegExp::rulePattern()
+{
+    // Classes that take in whitespace keep a stream from being cut there.
+    QCOMPARE(canMatchWhitespace(QLatin1String("a\\Db")), true);
+    QCOMPARE(canMatchWhitespace(QLatin1String("a\\vb")), true);
+    QCOMPARE(canMatchWhitespace(QLatin1String("a\\fb")), true);
+    QCOMPARE(canMatchWhitespace(QLatin1String("a\\d+b")), false);
+    QCOMPARE(canMatchWhitespace(QLatin1String("\\bKDE\\b")), false);
+
+    // ^ and $ anchor a rule, except escaped or in a character class.
+    QCOMPARE(isAnchored(QLatin1String("^Hello")), true);
+    QCOMPARE(isAnchored(QLatin1String("bye$")), true);
+    QCOMPARE(isAnchored(QLatin1String("(a|^b)")), true);
+    QCOMPARE(isAnchored(QLatin1String("[]^]x$")), true);
+    QCOMPARE(isAnchored(QLatin1String("\\$5")), false);
+    QCOMPARE(isAnchored(QLatin1String("[^$]+")), false);
+    QCOMPARE(isAnchored(QLatin1String("[]$^]")), false);
+    QCOMPARE(isAnchored(QLatin1String("a\\^b")), false);
+}
+
+void BenchRegExp::firstChars()
+{
+    QString chars;
+    QVERIFY(FilterRegExp(QLatin1String("<[^>]*>")).firstChars(&chars));
+    QCOMPARE(chars, QString::fromLatin1("<"));
+    QVERIFY(FilterRegExp(QLatin1String("&(lt|gt|amp);")).firstChars(&chars));
+    QCOMPARE(chars, QString::fromLatin1("&"));
+    QVERIFY(FilterRegExp(QLatin1String("(?:\\:|;)-?\\)")).firstChars(&chars));
+    QCOMPARE(chars, QString::fromLatin1(":;"));
+    QVERIFY(FilterRegExp(QLatin1String("(a|b)*c")).firstChars(&chars));
+    QCOMPARE(chars, QString::fromLatin1("abc"));
+    QVERIFY(FilterRegExp(QLatin1String("\\b(?=x)[\\x41-\\x43]{1,2}")).firstChars(&chars));
+    QCOMPARE(chars, QString::fromLatin1("ABC"));
+    QVERIFY(FilterRegExp(QLatin1String("\\x20ac")).firstChars(&chars));
+    QCOMPARE(chars, QString(QChar(0x20ac)));
+
+    // Letters in every case a caseless match finds, the Kelvin sign as well.
+    QVERIFY(FilterRegExp(QLatin1String("\\bKDE\\b"), Qt::CaseInsensitive).firstChars(&chars));
+    QVERIFY(chars.contains(QLatin1Char('K')));
+    QVERIFY(chars.contains(QLatin1Char('k')));
+    QVERIFY(chars.contains(QChar(0x212a)));
+
+    // Matches that can begin anywhere or be empty.
+    QVERIFY(!FilterRegExp(QLatin1String("x*")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("a|")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("\\w+")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("[^a]")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("a?.")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("^$")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("(a")).firstChars(&chars));
+
+    // Syntax that is not QRegExp's.
+    QVERIFY(!FilterRegExp(QLatin1String("x*?y")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("x{2}+y")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("(?i)abc")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("(?<=a)b")).firstChars(&chars));
+    QVERIFY(!FilterRegExp(QLatin1String("a(?#note)b")).firstChars(&chars));
+    QVERIFY(!FilterRegExp().firstChars(&chars));
+}
+
+void BenchRegExp::prefilter_data()
+{
+    addWordLists();
+}
+
+void BenchRegExp::prefilter()
+{
+    QFETCH(QString, wordList);
+    const QList<Rule> rules = loadWordList(wordList);
+    QList<FilterRegExp> matchList;
+    QString chars;
+    bool known = true;
+    foreach (const Rule &rule, rules)
+    {
+        matchList.append(FilterRegExp(rule.pattern, rule.cs));
+        QString ruleChars;
+        known = known && matchList.last().firstChars(&ruleChars);
+        chars += ruleChars;
+    }
+    qDebug() << QTest::currentDataTag() << ":" << (known ? chars.length() : -1) << "first characters";
+    if (!known)
+        return;
+    // A line without any of them comes out of the rules as it went in.
+    foreach (const QString &line, sampleText().split(QLatin1Char('\n')))
+    {
+        bool found = false;
+        for (int i = 0; i < line.length() && !found; ++i)
+            found = chars.contains(line.at(i));
+        if (!found)
+            QCOMPARE(applyFilterRegExp(matchList, rules, line), line);
+    }
+}
+
+void BenchRegExp::sameResult_data()
+{
+    addWordLists();
+}
+
+void BenchRegExp::sameResult()
+{
+    QFETCH(QString, wordList);
+    const QList<Rule> rules = loadWordList(wordList);
+    QVERIFY(!rules.isEmpty());
+    QList<QRegExp> qRegExps;
+    QList<FilterRegExp> filterRegExps;
+    foreach (const Rule &rule, rules)
+    {
+        qRegExps.append(QRegExp(rule.pattern, rule.cs));
+        filterRegExps.append(FilterRegExp(rule.pattern, rule.cs));
+        QCOMPARE(filterRegExps.last().isValid(), qRegExps.last().isValid());
+    }
+    const QString text = sampleText();
+    QCOMPARE(applyFilterRegExp(filterRegExps, rules, text), applyQRegExp(qRegExps, rules, text));
+}
+
+void BenchRegExp::qRegExp_data()
+{
+    addWordLists();
+}
+
+void BenchRegExp::qRegExp()
+{
+    QFETCH(QString, wordList);
+    const QList<Rule> rules = loadWordList(wordList);
+    QList<QRegExp> matchList;
+    foreach (const Rule &rule, rules)
+        matchList.append(QRegExp(rule.pattern, rule.cs));
+    const QString text = sampleText();
+    QString result;
+    QBENCHMARK {
+        result = applyQRegExp(matchList, rules, text);
+    }
+    QVERIFY(!result.isEmpty());
+}
+
+void BenchRegExp::filterRegExp_data()
+{
+    addWordLists();
+}
+
+void BenchRegExp::filterRegExp()
+{
+    QFETCH(QString, wordList);
+    const QList<Rule> rules = loadWordList(wordList);
+    QList<FilterRegExp> matchList;
+    int jitCompiled = 0;
+    foreach (const Rule &rule, rules)
+    {
+        matchList.append(FilterRegExp(rule.pattern, rule.cs));
+        if (matchList.last().isJitCompiled())
+            ++jitCompiled;
+    }
+    const QString text = sampleText();
+    QString result;
+    QBENCHMARK {
+        result = applyFilterRegExp(matchList, rules, text);
+    }
+    QVERIFY(!result.isEmpty());
+    qDebug() << QTest::currentDataTag() << ":" << jitCompiled << "of" << rules.count()
+             << "rules compiled to machine code";
+}
+
+void BenchRegExp::charTable_data()
+{
+    QTest::addColumn<QString>("wordList");
+    QTest::newRow("festival_unspeakable_chars") << QString::fromLatin1("festival_unspeakable_chars.xml");
+    QTest::newRow("polish_festival_unspeakables") << QString::fromLatin1("polish_festival_unspeakables.xml");
+}
+
+void BenchRegExp::charTable()
+{
+    QFETCH(QString, wordList);
+    const QList<Rule> rules = loadWordList(wordList);
+    // The Char rules of the list, all in one table, give the same text as
+    // one regular expression per rule.
+    CharTable table;
+    QList<FilterRegExp> matchList;
+    QList<Rule> charRules;
+    foreach (const Rule &rule, rules)
+    {
+        if (rule.chars.isEmpty())
+            continue;
+        QVector<ushort> codes;
+        QVERIFY(CharTable::parse(rule.chars, &codes));
+        QVERIFY(table.add(codes, rule.cs, rule.subst));
+        matchList.append(FilterRegExp(rule.pattern, rule.cs));
+        charRules.append(rule);
+    }
+    QVERIFY(!charRules.isEmpty());
+    QString chars;
+    QVERIFY(CharTable::isCharPattern(QLatin1String("[\\x91-\\x92]"), &chars));
+    QCOMPARE(chars, QString::fromLatin1("\\x91-\\x92"));
+    QVERIFY(!CharTable::isCharPattern(QLatin1String("\\d"), &chars));
+
+    const QString text = sampleText() + QString::fromUtf8("\xc2\x91quoted\xc2\x92 {x} (y) a_b & c/d\n");
+    QString result = text;
+    QVERIFY(table.translate(&result));
+    QCOMPARE(result, applyFilterRegExp(matchList, charRules, text));
+    QBENCHMARK {
+        result = text;
+        table.translate(&result);
+    }
+}
+
+QTEST_MAIN(BenchRegExp)
+#include "benchregexp.moc"
@@ -0,0 +1,27 @@
+#ifndef BENCHREGEXP_H
+#define BENCHREGEXP_H
+
+#include <QObject>
+
+class BenchRegExp : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void wordRule();
+    void hazards();
+    void firstChars();
+    void rulePattern();
+    void prefilter_data();
+    void prefilter();
+    void sameResult_data();
+    void sameResult();
+    void qRegExp_data();
+    void qRegExp();
+    void filterRegExp_data();
+    void filterRegExp();
+    void charTable_data();
+    void charTable();
+};
+
+#endif // BENCHREGEXP_H
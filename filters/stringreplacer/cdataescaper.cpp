@@ -14,6 +14,9 @@ void cdataEscape(QString* s)
 
 void cdataUnescape(QString* s)
 {
+    // Both escapes begin with &, and most strings have none.
+    if (!s->contains(QLatin1Char('&')))
+        return;
     s->replace(B1, A1);
     s->replace(B0, A0);
 }
@@ -0,0 +1,283 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Character translation table for String Replacer Char rules.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+// CharTable includes.
+#include "chartable.h"
+
+// System includes.
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Qt includes.
+#include <QtCore/QStringRef>
+
+// Returns the value of a digit in base 8 or 16, or -1.
+static int digitValue(QChar c, int base)
+{
+    const char d = c.toLatin1();
+    int value = -1;
+    if (d >= '0' && d <= '9')
+        value = d - '0';
+    else if (d >= 'a' && d <= 'f')
+        value = d - 'a' + 10;
+    else if (d >= 'A' && d <= 'F')
+        value = d - 'A' + 10;
+    return value < base ? value : -1;
+}
+
+// Parses one character or escape of a Char rule at pos.  Returns the
+// position after it, or -1.
+static int parseAtom(const QString& s, int pos, ushort* code)
+{
+    const int length = s.length();
+    const QChar c = s.at(pos);
+    if (c != QLatin1Char('\\'))
+    {
+        if (c == QLatin1Char('[') || c == QLatin1Char(']'))
+            return -1;
+        *code = c.unicode();
+        return pos + 1;
+    }
+    if (++pos >= length)
+        return -1;
+    const char e = s.at(pos++).toLatin1();
+    switch (e)
+    {
+        case 'x':
+        case '0':
+        {
+            // QRegExp's \xhhhh and \0ooo.
+            const int base = e == 'x' ? 16 : 8;
+            const int maxDigits = e == 'x' ? 4 : 3;
+            int value = 0;
+            int digits = 0;
+            while (digits < maxDigits && pos < length)
+            {
+                const int digit = digitValue(s.at(pos), base);
+                if (digit < 0)
+                    break;
+                value = value * base + digit;
+                ++digits;
+                ++pos;
+            }
+            if (e == 'x' && digits == 0)
+                return -1;
+            *code = value;
+            return pos;
+        }
+        case 'n': *code = '\n'; return pos;
+        case 't': *code = '\t'; return pos;
+        case 'r': *code = '\r'; return pos;
+        case 'f': *code = '\f'; return pos;
+        case 'v': *code = '\v'; return pos;
+        case 'a': *code = '\a'; return pos;
+    }
+    // Other letters and digits are character classes or back references.
+    if (s.at(pos - 1).isLetterOrNumber())
+        return -1;
+    *code = s.at(pos - 1).unicode();
+    return pos;
+}
+
+static bool isSurrogate(ushort code)
+{
+    return code >= 0xd800 && code <= 0xdfff;
+}
+
+CharTable::CharTable() :
+    m_low(0xffff),
+    m_high(0)
+{
+}
+
+bool CharTable::parse(const QString& chars, QVector<ushort>* codes)
+{
+    codes->clear();
+    const int length = chars.length();
+    if (length == 0 || chars.at(0) == QLatin1Char('^'))
+        return false;
+    int pos = 0;
+    while (pos < length)
+    {
+        ushort first;
+        pos = parseAtom(chars, pos, &first);
+        if (pos < 0 || isSurrogate(first))
+            return false;
+        ushort last = first;
+        // A - at the start or the end is the character itself.
+        if (pos + 1 < length && chars.at(pos) == QLatin1Char('-'))
+        {
+            pos = parseAtom(chars, pos + 1, &last);
+            if (pos < 0 || last < first || isSurrogate(last))
+                return false;
+        }
+        for (int code = first; code <= last; ++code)
+            codes->append(code);
+    }
+    return true;
+}
+
+bool CharTable::isCharPattern(const QString& pattern, QString* chars)
+{
+    const int length = pattern.length();
+    if (length == 0)
+        return false;
+    QVector<ushort> codes;
+    if (pattern.at(0) == QLatin1Char('['))
+    {
+        if (length < 3 || pattern.at(length - 1) != QLatin1Char(']'))
+            return false;
+        const QString set = pattern.mid(1, length - 2);
+        if (!parse(set, &codes))
+            return false;
+        *chars = set;
+        return true;
+    }
+    if (pattern.at(0) == QLatin1Char('\\'))
+    {
+        ushort code;
+        if (parseAtom(pattern, 0, &code) != length || isSurrogate(code))
+            return false;
+        *chars = pattern;
+        return true;
+    }
+    static const QString special = QLatin1String( "\\^$.[]|()?*+{}" );
+    if (length != 1 || special.contains(pattern.at(0)) || isSurrogate(pattern.at(0).unicode()))
+        return false;
+    *chars = pattern;
+    return true;
+}
+
+bool CharTable::add(const QVector<ushort>& codes, Qt::CaseSensitivity cs, const QString& subst)
+{
+    QVector<ushort> all = codes;
+    if (cs == Qt::CaseInsensitive)
+    {
+        foreach (ushort code, codes)
+        {
+            all.append(QChar(code).toLower().unicode());
+            all.append(QChar(code).toUpper().unicode());
+        }
+    }
+    // Earlier rules must not produce characters this one replaces.
+    foreach (ushort code, all)
+    {
+        if (m_substChars.contains(code))
+            return false;
+    }
+    const int index = m_substs.count();
+    m_substs.append(subst);
+    foreach (ushort code, all)
+    {
+        // An earlier rule has already replaced the character.
+        if (m_index.contains(code))
+            continue;
+        m_index.insert(code, index);
+        m_low = qMin(m_low, code);
+        m_high = qMax(m_high, code);
+        const int word = code >> 5;
+        if (word >= m_bits.size())
+            m_bits.resize(word + 1);
+        m_bits[word] |= 1u << (code & 31);
+    }
+    for (int i = 0; i < subst.length(); ++i)
+        m_substChars.insert(subst.at(i).unicode());
+    return true;
+}
+
+bool CharTable::isEmpty() const
+{
+    return m_substs.isEmpty();
+}
+
+QString CharTable::chars() const
+{
+    QString result;
+    result.reserve(m_index.count());
+    for (QHash<ushort, int>::const_iterator it = m_index.constBegin(); it != m_index.constEnd(); ++it)
+        result += QChar(it.key());
+    return result;
+}
+
+inline bool CharTable::contains(ushort code) const
+{
+    const int word = code >> 5;
+    return word < m_bits.size() && (m_bits.at(word) >> (code & 31)) & 1;
+}
+
+int CharTable::find(const ushort* data, int i, int length) const
+{
+    if (m_low > m_high)
+        return length;
+#if defined(__SSE2__)
+    // Skip eight characters at a time while none lies between the lowest
+    // and the highest in the table.  Tables mostly hold a narrow range,
+    // such as \x80-\x9f or punctuation, that most of a text is outside.
+    // SSE2 only compares signed words, so the offsets from the lowest are
+    // biased.
+    const __m128i bias = _mm_set1_epi16(short(0x8000));
+    const __m128i low = _mm_set1_epi16(short(m_low));
+    const __m128i span = _mm_set1_epi16(short((m_high - m_low) ^ 0x8000));
+    while (length - i >= 8)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i offset = _mm_xor_si128(_mm_sub_epi16(chunk, low), bias);
+        const int outside = _mm_movemask_epi8(_mm_cmpgt_epi16(offset, span));
+        if (outside == 0xffff)
+        {
+            i += 8;
+            continue;
+        }
+        // Two mask bits to each character.
+        i += __builtin_ctz(~outside) / 2;
+        if (contains(data[i]))
+            return i;
+        ++i;
+    }
+#endif
+    while (i < length && !contains(data[i]))
+        ++i;
+    return i;
+}
+
+bool CharTable::translate(QString* text) const
+{
+    const ushort* data = text->utf16();
+    const int length = text->length();
+    // Runs of characters not in the table are skipped and copied as a
+    // whole.
+    int i = find(data, 0, length);
+    if (i == length)
+        return false;
+
+    QString result;
+    result.reserve(length + length / 8);
+    int start = 0;
+    while (i < length)
+    {
+        result.append(text->midRef(start, i - start));
+        result.append(m_substs.at(m_index.value(data[i])));
+        start = ++i;
+        i = find(data, i, length);
+    }
+    result.append(text->midRef(start));
+    *text = result;
+    return true;
+}
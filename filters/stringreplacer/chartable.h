@@ -0,0 +1,121 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Character translation table for String Replacer Char rules.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef CHARTABLE_H
+#define CHARTABLE_H
+
+// Qt includes.
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+/**
+ * @class CharTable
+ *
+ * Replaces single characters by strings in one pass over a text.  A Char
+ * rule of a word list gives the characters to replace the way they are
+ * written inside [] of a regular expression: "\\x91-\\x94" or "(){}", and
+ * the rule has the same effect as the RegExp rule "[\\x91-\\x94]".  One
+ * table holds many rules, so a word list of character rules costs one
+ * pass over the text instead of one per rule.
+ *
+ * Rules are applied in order, each to the output of the ones before.  A
+ * table gives the same result only while no rule replaces a character by
+ * text that a later rule would replace again; @ref add refuses such a rule,
+ * and the word list then needs a second table.
+ */
+class CharTable
+{
+public:
+    /**
+     * Constructs an empty table.
+     */
+    CharTable();
+
+    /**
+     * Parses the characters of a Char rule: characters, ranges such as a-z,
+     * and escapes such as \\x20ac, \\0101, \\t or \\(.
+     * @param chars          The characters as written in the rule.
+     * @param codes          Receives the characters.
+     * @return               False if @p chars is empty or cannot be written
+     *                       inside [] as it is.  Character classes such as
+     *                       \\d, unescaped [ or ], a leading ^ and characters
+     *                       outside the Basic Multilingual Plane are not
+     *                       supported.
+     */
+    static bool parse(const QString& chars, QVector<ushort>* codes);
+
+    /**
+     * Returns True if a regular expression always matches exactly one
+     * character, as "\\x80", "\\{" or "[\\x91-\\x92]" do, and gives the
+     * characters as a Char rule writes them.
+     */
+    static bool isCharPattern(const QString& pattern, QString* chars);
+
+    /**
+     * Adds a rule to the table.
+     * @param codes          Characters to replace.
+     * @param cs             Whether letter case must match.
+     * @param subst          Replacement.
+     * @return               False if a rule already in the table replaces a
+     *                       character by text that contains one of @p codes.
+     *                       The table is unchanged then.
+     */
+    bool add(const QVector<ushort>& codes, Qt::CaseSensitivity cs, const QString& subst);
+
+    /**
+     * Returns True if the table has no rules.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the characters the table replaces, in any order.
+     */
+    QString chars() const;
+
+    /**
+     * Replaces all characters in the table.
+     * @param text           Text to translate.  Not touched, and not copied,
+     *                       if it has none of the characters.
+     * @return               True if anything was replaced.
+     */
+    bool translate(QString* text) const;
+
+private:
+    bool contains(ushort code) const;
+    // Returns the position of the first character in the table at or after
+    // i, or length.
+    int find(const ushort* data, int i, int length) const;
+
+    // One bit for each character up to the highest in the table.
+    QVector<quint32> m_bits;
+    // Index into m_substs of each character in the table.
+    QHash<ushort, int> m_index;
+    // Replacements.
+    QStringList m_substs;
+    // Characters that occur in the replacements.
+    QSet<ushort> m_substChars;
+    // Lowest and highest character in the table.
+    ushort m_low;
+    ushort m_high;
+};
+
+#endif      // CHARTABLE_H
@@ -0,0 +1,73 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  What String Replacer rule patterns can match.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+// RulePattern includes.
+#include "rulepattern.h"
+
+bool canMatchWhitespace(const QString& pattern)
+{
+    // Escapes that match whitespace: \s, \W and \D classes, and \n, \t, \r,
+    // \v, \f, \x and \0 characters.
+    static const QString spaceEscapes = QLatin1String( "sWDntrvfx0" );
+    for (int i = 0; i < pattern.length(); ++i)
+    {
+        const QChar c = pattern.at(i);
+        if (c.isSpace() || c == QLatin1Char('.'))
+            return true;
+        if (c == QLatin1Char('[') && i + 1 < pattern.length() && pattern.at(i + 1) == QLatin1Char('^'))
+            return true;
+        if (c == QLatin1Char('\\') && i + 1 < pattern.length() && spaceEscapes.contains(pattern.at(++i)))
+            return true;
+    }
+    return false;
+}
+
+bool isAnchored(const QString& pattern)
+{
+    bool inClass = false;
+    for (int i = 0; i < pattern.length(); ++i)
+    {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\'))
+            ++i;
+        else if (inClass)
+            inClass = c != QLatin1Char(']');
+        else if (c == QLatin1Char('['))
+        {
+            // A ] right after [ or [^ is a member of the class.
+            inClass = true;
+            if (i + 1 < pattern.length() && pattern.at(i + 1) == QLatin1Char('^'))
+                ++i;
+            if (i + 1 < pattern.length() && pattern.at(i + 1) == QLatin1Char(']'))
+                ++i;
+        }
+        else if (c == QLatin1Char('^') || c == QLatin1Char('$'))
+            return true;
+    }
+    return false;
+}
+
+bool isLiteral(const QString& pattern)
+{
+    static const QString special = QLatin1String( "\\^$.[]|()?*+{}" );
+    for (int i = 0; i < pattern.length(); ++i)
+        if (special.contains(pattern.at(i)))
+            return false;
+    return true;
+}
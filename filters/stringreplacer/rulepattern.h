@@ -0,0 +1,44 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  What String Replacer rule patterns can match.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef RULEPATTERN_H
+#define RULEPATTERN_H
+
+// Qt includes.
+#include <QtCore/QString>
+
+/**
+ * Returns True if a pattern might match whitespace, so a text must not be
+ * cut or split where a match of it could be.  Errs on the side of True.
+ */
+bool canMatchWhitespace(const QString& pattern);
+
+/**
+ * Returns True if a pattern has an unescaped ^ or $ outside a character
+ * class.  Its matches depend on where the text begins and ends, so the
+ * text cannot be converted in pieces.
+ */
+bool isAnchored(const QString& pattern);
+
+/**
+ * Returns True if a pattern is plain text, without regular expression syntax.
+ */
+bool isLiteral(const QString& pattern);
+
+#endif // RULEPATTERN_H
@@ -52,6 +52,8 @@
 #include "selectlanguagedlg.h"
 #include "filterconf.h"
 #include "cdataescaper.h"
+#include "chartable.h"
+#include "filterregexp.h"
 
 StringReplacerConf::StringReplacerConf( QWidget *parent, const QVariantList& args ) :
     KttsFilterConf(parent, args),
@@ -222,8 +224,11 @@ QString StringReplacerConf::loadFromFile( const QString& filename, bool clear)
                 cdataUnescape( &subst );
             }
         }
-        QString wordTypeStr =
-            (wordType==QLatin1String( "RegExp" )?i18nc("Abbreviation for 'Regular Expression'", "RegExp"):i18n("Word"));
+        QString wordTypeStr = i18n("Word");
+        if ( wordType == QLatin1String( "RegExp" ) )
+            wordTypeStr = i18nc("Abbreviation for 'Regular Expression'", "RegExp");
+        else if ( wordType == QLatin1String( "Char" ) )
+            wordTypeStr = substitutionTypeToString( stChar );
         int tableRow = substLView->rowCount();
         QString matchCaseStr =
             (matchCase==QLatin1String( "Yes" )?i18nc("Yes or no", "Yes"):i18nc("Yes or no", "No"));
@@ -308,8 +313,12 @@ QString StringReplacerConf::saveToFile(const QString& filename)
         root.appendChild( wordTag );
         QDomElement propTag = doc.createElement( QLatin1String( "type" ) );
         wordTag.appendChild( propTag);
-        QDomText t = doc.createTextNode(
-            substLView->item(row, 0)->text()==i18n("Word")?QLatin1String( "Word" ):QLatin1String( "RegExp" ) );
+        QString wordType = QLatin1String( "RegExp" );
+        if ( substLView->item(row, 0)->text() == i18n("Word") )
+            wordType = QLatin1String( "Word" );
+        else if ( substLView->item(row, 0)->text() == substitutionTypeToString( stChar ) )
+            wordType = QLatin1String( "Char" );
+        QDomText t = doc.createTextNode( wordType );
         propTag.appendChild( t );
 
         propTag = doc.createElement( QLatin1String( "case" ) );
@@ -385,6 +394,7 @@ QString StringReplacerConf::substitutionTypeToString(const int substitutionType)
     {
         case stWord:        return i18n("Word");
         case stRegExp:      return i18nc("Abbreviation for 'Regular Expresion'", "RegExp");
+        case stChar:        return i18nc("Abbreviation for 'Characters'", "Char");
     }
     return i18n("Error");
 }
@@ -538,7 +548,9 @@ void StringReplacerConf::addOrEditSubstitution(bool isAdd)
     m_editWidget->matchButton->setEnabled( false );
     if (!isAdd)
     {
-        if ( substLView->item(row, 0)->text() != i18n("Word") )
+        if ( substLView->item(row, 0)->text() == substitutionTypeToString( stChar ) )
+            m_editWidget->charRadioButton->setChecked( true );
+        else if ( substLView->item(row, 0)->text() != i18n("Word") )
         {
             m_editWidget->regexpRadioButton->setChecked( true );
             m_editWidget->matchButton->setEnabled( m_reEditorInstalled );
@@ -555,6 +567,8 @@ void StringReplacerConf::addOrEditSubstitution(bool isAdd)
          this, SLOT(slotTypeButtonGroup_clicked()) );
     connect( m_editWidget->wordRadioButton, SIGNAL(clicked()),
          this, SLOT(slotTypeButtonGroup_clicked()) );
+    connect( m_editWidget->charRadioButton, SIGNAL(clicked()),
+         this, SLOT(slotTypeButtonGroup_clicked()) );
     connect( m_editWidget->matchButton, SIGNAL(clicked()),
          this, SLOT(slotMatchButton_clicked()) );
     // Display the box in a dialog.
@@ -566,11 +580,13 @@ void StringReplacerConf::addOrEditSubstitution(bool isAdd)
     // Disable OK button if match field blank.
     m_editDlg->setMainWidget( w );
     m_editDlg->setHelp( QLatin1String( "" ), QLatin1String( "jovie" ) );
-    m_editDlg->enableButton( KDialog::Ok, !m_editWidget->matchLineEdit->text().isEmpty() );
+    m_editDlg->enableButton( KDialog::Ok, checkMatch() );
     int dlgResult = m_editDlg->exec();
     QString substType = i18n( "Word" );
     if ( m_editWidget->regexpRadioButton->isChecked() )
         substType = i18nc("Abbreviation for 'Regular Expression'", "RegExp");
+    else if ( m_editWidget->charRadioButton->isChecked() )
+        substType = substitutionTypeToString( stChar );
     QString matchCase = m_editWidget->matchCaseCheckBox->isChecked()?i18nc("Yes or no", "Yes"):i18nc("Yes or no", "No");
     QString match = m_editWidget->matchLineEdit->text();
     QString subst = m_editWidget->substLineEdit->text();
@@ -600,9 +616,35 @@ void StringReplacerConf::addOrEditSubstitution(bool isAdd)
 
 void StringReplacerConf::slotMatchLineEdit_textChanged(const QString& text)
 {
-    // Disable OK button if match field blank.
+    Q_UNUSED(text);
+    // Disable OK button if match field blank or the filter would not use it.
     if ( !m_editDlg ) return;
-    m_editDlg->enableButton( KDialog::Ok, !text.isEmpty() );
+    m_editDlg->enableButton( KDialog::Ok, checkMatch() );
+}
+
+bool StringReplacerConf::checkMatch()
+{
+    QString match = m_editWidget->matchLineEdit->text();
+    if ( match.isEmpty() )
+    {
+        m_editWidget->matchWarningLabel->clear();
+        return false;
+    }
+    if ( m_editWidget->charRadioButton->isChecked() )
+    {
+        QVector<ushort> codes;
+        const bool valid = CharTable::parse( match, &codes );
+        m_editWidget->matchWarningLabel->setText( valid ? QString() :
+            i18n("Write the characters as inside [] of a regular expression: ranges such as a-z "
+                 "and escapes such as \\x20ac are allowed, classes such as \\d and a leading ^ are not.") );
+        return valid;
+    }
+    // Build the expression as StringReplacerProc does.
+    if ( m_editWidget->wordRadioButton->isChecked() )
+        match = QLatin1String( "\\b" ) + match + QLatin1String( "\\b" );
+    FilterRegExp rx( match );
+    m_editWidget->matchWarningLabel->setText( rx.warning() );
+    return rx.isUsable();
 }
 
 void StringReplacerConf::slotRemoveButton_clicked()
@@ -623,6 +665,7 @@ void StringReplacerConf::slotTypeButtonGroup_clicked()
     // Enable Regular Expression Editor button if editor is installed (requires kdeutils).
     if ( !m_editWidget ) return;
     m_editWidget->matchButton->setEnabled( m_editWidget->regexpRadioButton->isChecked() &&  m_reEditorInstalled );
+    if ( m_editDlg ) m_editDlg->enableButton( KDialog::Ok, checkMatch() );
 }
 
 void StringReplacerConf::slotMatchButton_clicked()
@@ -645,7 +688,7 @@ void StringReplacerConf::slotMatchButton_clicked()
         {
             QString re = reEditor->regExp();
             m_editWidget->matchLineEdit->setText( re );
-            m_editDlg->enableButton( KDialog::Ok, !re.isEmpty() );
+            m_editDlg->enableButton( KDialog::Ok, checkMatch() );
         }
         delete editorDialog;
     } else return;
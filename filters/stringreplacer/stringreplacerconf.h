@@ -58,7 +58,8 @@ class StringReplacerConf : public KttsFilterConf, public Ui::StringReplacerConfW
 
         enum SubstitutionType {
             stWord,                 // Word
-            stRegExp                // Regular Expression
+            stRegExp,               // Regular Expression
+            stChar                  // Characters
         };
 
         /**
@@ -141,6 +142,9 @@ class StringReplacerConf : public KttsFilterConf, public Ui::StringReplacerConfW
         QString substitutionTypeToString(const int substitutionType);
         // Displays the add/edit string replacement dialog.
         void addOrEditSubstitution(bool isAdd);
+        // Shows in the edit dialog why its match is unsafe or would not be
+        // used.  Returns False if the filter would not use it.
+        bool checkMatch();
         // Loads word list and settings from a file.  Clearing configuration if clear is True.
         QString loadFromFile( const QString& filename, bool clear);
         // Saves word list and settings to a file.
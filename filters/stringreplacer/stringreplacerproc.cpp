@@ -41,12 +41,29 @@
 #include "filterproc.h"
 #include "talkercode.h"
 #include "cdataescaper.h"
+#include "chartable.h"
+#include "rulepattern.h"
+
+/**
+ * Assumed length of the longest match of a regular expression that can match
+ * whitespace.  Longer matches may be missed when a text is streamed.
+ */
+static const int RegExpHoldback = 256;
+
+/**
+ * Stream text without any whitespace to cut at is converted anyway once this
+ * much of it is pending.
+ */
+static const int MaxPendingStream = 16384;
 
 /**
  * Constructor.
  */
 StringReplacerProc::StringReplacerProc( QObject *parent, QVariantList list) :
-    KttsFilterProc(parent, list)
+    KttsFilterProc(parent, list),
+    m_wasModified(false),
+    m_holdback(0),
+    m_anchored(false)
 {
 }
 
@@ -57,6 +74,7 @@ StringReplacerProc::StringReplacerProc( QObject *parent, QVariantList list) :
 {
     m_matchList.clear();
     m_substList.clear();
+    m_tableList.clear();
 }
 
 bool StringReplacerProc::init(KConfig* c, const QString& configGroup){
@@ -86,6 +104,11 @@ bool StringReplacerProc::init(KConfig* c, const QString& configGroup){
     // Clear list.
     m_matchList.clear();
     m_substList.clear();
+    m_tableList.clear();
+    m_spanningRules.clear();
+    m_holdback = 0;
+    m_anchored = false;
+    m_pending.clear();
 
     // Name setting.
     // QDomNodeList nameList = doc.elementsByTagName( "name" );
@@ -142,23 +165,67 @@ bool StringReplacerProc::init(KConfig* c, const QString& configGroup){
                 cdataUnescape( &subst );
             }
         }
-        // Build Regular Expression for each word's match string.
-        QRegExp rx;
-        rx.setCaseSensitivity(matchCase == QLatin1String( "Yes" )?Qt::CaseInsensitive:Qt::CaseSensitive);
-        if ( wordType == QLatin1String( "Word" ) )
+        const Qt::CaseSensitivity cs =
+            matchCase == QLatin1String( "Yes" )?Qt::CaseInsensitive:Qt::CaseSensitive;
+        // Char rules, and RegExp rules that match one character, such as
+        // those of word lists written before there were Char rules, go into
+        // a character table.  Consecutive ones share a table.
+        QString chars;
+        const bool isChar = wordType == QLatin1String( "Char" );
+        if ( isChar )
+            chars = match;
+        else if ( wordType == QLatin1String( "RegExp" ) && !subst.contains( QLatin1Char( '\\' ) ) )
+            CharTable::isCharPattern( match, &chars );
+        if ( isChar || !chars.isEmpty() )
         {
-                // TODO: Does \b honor strange non-Latin1 encodings?
-            rx.setPattern( QLatin1String( "\\b" ) + match + QLatin1String( "\\b" ) );
+            QVector<ushort> codes;
+            if ( !CharTable::parse( chars, &codes ) )
+            {
+                kWarning() << "StringReplacerProc::init: " << wordsFilename << ": " << chars
+                    << ": not used: not a list of characters";
+                continue;
+            }
+            if ( m_tableList.isEmpty() || m_tableList.last().isEmpty() ||
+                 !m_tableList.last().add( codes, cs, subst ) )
+            {
+                CharTable table;
+                table.add( codes, cs, subst );
+                m_matchList.append( FilterRegExp() );
+                m_substList.append( QString() );
+                m_tableList.append( table );
+            }
+            continue;
         }
-        else
+        // Build Regular Expression for each word's match string.  It is
+        // compiled here, once, not on each match.
+        // \b goes by Unicode word characters, so Word rules work in any script.
+        QString pattern = match;
+        if ( wordType == QLatin1String( "Word" ) )
+            pattern = QLatin1String( "\\b" ) + match + QLatin1String( "\\b" );
+        FilterRegExp rx( pattern, cs );
+        // A pattern that can take exponential time is only used if its
+        // matches give up after FilterRegExp::DefaultMatchLimit steps.
+        if ( rx.isValid() && rx.hazard() != FilterRegExp::NoHazard )
         {
-            rx.setPattern( match );
+            kWarning() << "StringReplacerProc::init: " << wordsFilename << ": " << pattern
+                << ( rx.isUsable() ? ": " : ": not used: " ) << rx.warning();
         }
-            // Add Regular Expression to list (if valid).
-        if ( rx.isValid() )
+            // Add Regular Expression to list (if usable).
+        if ( rx.isUsable() )
         {
+            // Remember rules that a stream must not be cut through, and
+            // rules that must see the whole text.
+            if ( isAnchored( match ) )
+                m_anchored = true;
+            if ( canMatchWhitespace( match ) )
+            {
+                m_spanningRules.append( m_matchList.count() );
+                int length = isLiteral( match ) ? match.length() : RegExpHoldback;
+                m_holdback = qMax( m_holdback, length );
+            }
             m_matchList.append( rx );
             m_substList.append( subst );
+            m_tableList.append( CharTable() );
         }
     }
     return true;
@@ -216,14 +283,27 @@ bool StringReplacerProc::init(KConfig* c, const QString& configGroup){
             return inputText;
         }
     }
+    // FilterRegExp::replace() leaves the text alone if nothing matches, so
+    // until a rule matches, the input is passed on as it is.
     QString newText = inputText;
     const int listCount = m_matchList.count();
     for ( int index = 0; index < listCount; ++index )
     {
+        const CharTable& table = m_tableList.at( index );
+        if ( !table.isEmpty() )
+        {
+            if ( table.translate( &newText ) )
+                m_wasModified = true;
+            continue;
+        }
         //kDebug() << "newtext = " << newText << " matching " << m_matchList[index].pattern() << " replacing with " << m_substList[index];
-        newText.replace( m_matchList[index], m_substList[index] );
+        const FilterRegExp& rx = m_matchList.at( index );
+        if ( rx.replace( newText, m_substList.at( index ) ) )
+            m_wasModified = true;
+        else if ( rx.limitReached() )
+            kWarning() << "StringReplacerProc::convert: gave up on " << rx.pattern()
+                << " after " << rx.matchLimit() << " steps, text left as it is";
     }
-    m_wasModified = true;
     return newText;
 }
 
@@ -233,3 +313,107 @@ bool StringReplacerProc::init(KConfig* c, const QString& configGroup){
  */
 /*virtual*/ bool StringReplacerProc::wasModified() { return m_wasModified; }
 
+
+/**
+ * Returns True unless a rule is anchored to the beginning or end of the text.
+ * Other word lists can be applied to a text in pieces.
+ */
+/*virtual*/ bool StringReplacerProc::supportsStreaming() { return !m_anchored; }
+
+/**
+ * Returns the number of trailing characters held back so that matches
+ * spanning whitespace are not cut in two.
+ */
+/*virtual*/ int StringReplacerProc::holdback() { return m_holdback; }
+
+/*virtual*/ bool StringReplacerProc::isHolding() { return !m_pending.isEmpty(); }
+
+/**
+ * Returns True if no rule can match across whitespace, so no match can
+ * span a sentence boundary, and no rule is anchored.
+ */
+/*virtual*/ bool StringReplacerProc::supportsSplitting() { return m_spanningRules.isEmpty() && !m_anchored; }
+
+/**
+ * Returns True if every rule lists the characters its matches begin with,
+ * and gives all of them.  A rule only sees what the rules before it left,
+ * so if none of them matches, neither does any later one.
+ */
+/*virtual*/ bool StringReplacerProc::firstChars(QString* chars)
+{
+    QString result;
+    const int listCount = m_matchList.count();
+    for ( int index = 0; index < listCount; ++index )
+    {
+        const CharTable& table = m_tableList.at( index );
+        QString ruleChars;
+        if ( !table.isEmpty() )
+            ruleChars = table.chars();
+        else if ( !m_matchList.at( index ).firstChars( &ruleChars ) )
+            return false;
+        result += ruleChars;
+    }
+    *chars = result;
+    return true;
+}
+
+/**
+ * Convert the next piece of a stream.
+ */
+/*virtual*/ QString StringReplacerProc::feed(const QString& chunk, TalkerCode* talkerCode,
+    const QString& appId)
+{
+    m_pending += chunk;
+    int cut = streamCut();
+    if ( cut <= 0 ) return QString();
+    QString text = m_pending.left( cut );
+    m_pending.remove( 0, cut );
+    return convert( text, talkerCode, appId );
+}
+
+/**
+ * Ends a stream and converts the rest of the text.
+ */
+/*virtual*/ QString StringReplacerProc::flush(TalkerCode* talkerCode, const QString& appId)
+{
+    if ( m_pending.isEmpty() ) return QString();
+    QString text = m_pending;
+    m_pending.clear();
+    return convert( text, talkerCode, appId );
+}
+
+// Cuts go right after a whitespace, so \b of Word rules sees the same text on
+// both sides of the cut as it would in the whole text, and never inside a match
+// of a rule that can span whitespace.  At least m_holdback characters stay
+// pending so such a match can be seen in full.
+int StringReplacerProc::streamCut() const
+{
+    const int limit = m_pending.length() - m_holdback;
+    if ( limit <= 0 ) return 0;
+    int cut = limit;
+    bool moved = true;
+    while ( moved && cut > 0 )
+    {
+        moved = false;
+        while ( cut > 0 && !m_pending.at( cut - 1 ).isSpace() ) --cut;
+        foreach ( int index, m_spanningRules )
+        {
+            const FilterRegExp& rx = m_matchList.at( index );
+            int pos = rx.indexIn( m_pending, qMax( 0, cut - m_holdback ) );
+            while ( pos != -1 && pos < cut )
+            {
+                const int end = pos + qMax( rx.matchedLength(), 1 );
+                if ( end > cut )
+                {
+                    cut = pos;
+                    moved = true;
+                    break;
+                }
+                pos = rx.indexIn( m_pending, end );
+            }
+        }
+    }
+    if ( cut <= 0 && m_pending.length() >= MaxPendingStream )
+        return limit;
+    return cut;
+}
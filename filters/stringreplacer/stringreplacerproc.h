@@ -28,11 +28,12 @@
 // Qt includes.
 #include <QtCore/QObject>
 #include <QtCore/QTextStream>
-#include <QtCore/QRegExp>
 #include <QtCore/QStringList>
 
 // KTTS includes.
 #include "filterproc.h"
+#include "filterregexp.h"
+#include "chartable.h"
 
 class StringReplacerProc : public KttsFilterProc
 {
@@ -77,18 +78,72 @@ public:
      */
     virtual bool wasModified();
 
+    /**
+     * Returns True unless a rule has ^ or $.  Other word lists can be
+     * applied to a text in pieces.
+     */
+    virtual bool supportsStreaming();
+
+    /**
+     * Returns the number of trailing characters held back so that matches
+     * spanning whitespace are not cut in two.
+     */
+    virtual int holdback();
+
+    /**
+     * Returns True if part of the stream has not been converted yet.
+     */
+    virtual bool isHolding();
+
+    /**
+     * Returns True if no rule can match across whitespace, so no match can
+     * span a sentence boundary, and no rule has ^ or $.
+     */
+    virtual bool supportsSplitting();
+
+    /**
+     * Returns True if every rule lists the characters its matches begin
+     * with, and gives all of them.  No rule can match a text without any.
+     */
+    virtual bool firstChars(QString* chars);
+
+    /**
+     * Convert the next piece of a stream.  Text is converted up to a whitespace
+     * that is not inside a match of any rule that can span whitespace.
+     */
+    virtual QString feed(const QString& chunk, TalkerCode* talkerCode, const QString& appId);
+
+    /**
+     * Ends a stream and converts the rest of the text.
+     */
+    virtual QString flush(TalkerCode* talkerCode, const QString& appId);
+
 private:
+    // Returns how much of the pending stream text can be converted now.
+    int streamCut() const;
+
     // Language codes supported by the filter.
     QStringList m_languageCodeList;
     // If not empty, apply filter only to apps containing one or more of these strings.
     QStringList m_appIdList;
 
     // List of regular expressions to match.
-    QList<QRegExp> m_matchList;
+    QList<FilterRegExp> m_matchList;
     // List of substitutions to replace matches.
     QList<QString> m_substList;
+    // Character tables.  Where one is not empty, it takes the place of the
+    // rule at the same index in m_matchList.
+    QList<CharTable> m_tableList;
     // True if this filter did anything to the text.
     bool m_wasModified;
+    // Indexes into m_matchList of rules that may match across whitespace.
+    QList<int> m_spanningRules;
+    // Longest match expected from a rule in m_spanningRules.
+    int m_holdback;
+    // True if a rule has ^ or $, so the text is converted whole.
+    bool m_anchored;
+    // Stream text not converted yet.
+    QString m_pending;
 };
 
 #endif      // STRINGREPLACERPROC_H
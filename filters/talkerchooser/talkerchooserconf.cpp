@@ -42,6 +42,7 @@
 
 // KTTS includes.
 #include "selecttalkerdlg.h"
+#include "filterregexp.h"
 
 /**
 * Constructor
@@ -63,6 +64,8 @@ TalkerChooserConf::TalkerChooserConf( QWidget *parent, const QVariantList & args
             this, SLOT(configChanged()));
     connect(reLineEdit, SIGNAL(textChanged(QString)),
             this, SLOT(configChanged()));
+    connect(reLineEdit, SIGNAL(textChanged(QString)),
+            this, SLOT(slotReLineEdit_textChanged(QString)));
     connect(reEditorButton, SIGNAL(clicked()),
             this, SLOT(slotReEditorButton_clicked()));
     connect(appIdLineEdit, SIGNAL(textChanged(QString)),
@@ -190,6 +193,13 @@ void TalkerChooserConf::slotReEditorButton_clicked()
     } else return;
 }
 
+void TalkerChooserConf::slotReLineEdit_textChanged(const QString& text)
+{
+    // Tell at once if the filter will not use the expression, or why it may
+    // give up on it.
+    reWarningLabel->setText( text.isEmpty() ? QString() : FilterRegExp( text ).warning() );
+}
+
 void TalkerChooserConf::slotTalkerButton_clicked()
 {
     QString talkerCode = m_talkerCode.getTalkerCode();
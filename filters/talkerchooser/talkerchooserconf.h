@@ -115,6 +115,7 @@ class TalkerChooserConf : public KttsFilterConf, public Ui::TalkerChooserConfWid
 
     private slots:
         void slotReEditorButton_clicked();
+        void slotReLineEdit_textChanged(const QString& text);
         void slotTalkerButton_clicked();
         void slotLoadButton_clicked();
         void slotSaveButton_clicked();
@@ -25,9 +25,6 @@
 #include "talkerchooserproc.h"
 #include "talkerchooserproc.moc"
 
-// Qt includes.
-#include <QtCore/QRegExp>
-
 // KDE includes.
 #include <kdebug.h>
 #include <kconfig.h>
@@ -36,8 +33,15 @@
 // KTTS includes.
 #include "talkercode.h"
 
+/**
+ * Characters of a stream kept for matching the regular expression across pieces.
+ */
+static const int StreamContext = 256;
+
 TalkerChooserProc::TalkerChooserProc( QObject *parent, const QVariantList& args ) :
-    KttsFilterProc(parent, args) 
+    KttsFilterProc(parent, args),
+    m_usable(true),
+    m_streamMatched(false)
 {
     Q_UNUSED(args);
     // kDebug() << "TalkerChooserProc::TalkerChooserProc: Running";
@@ -52,6 +56,12 @@ bool TalkerChooserProc::init(KConfig* c, const QString& configGroup){
     // kDebug() << "PlugInProc::init: Running";
     KConfigGroup config( c, configGroup );
     m_re = config.readEntry( "MatchRegExp" );
+    m_regExp = FilterRegExp( m_re );
+    // The talker classifier makes the same test for the rule.
+    m_usable = m_re.isEmpty() || m_regExp.isUsable();
+    if ( !m_re.isEmpty() && m_regExp.hazard() != FilterRegExp::NoHazard )
+        kWarning() << "TalkerChooserProc::init: " << m_re << ( m_usable ? ": " : ": not used: " )
+            << m_regExp.warning();
     m_appIdList = config.readEntry( "AppIDs", QStringList() );
     m_chosenTalkerCode = TalkerCode(config.readEntry("TalkerCode"), false);
     // Legacy settings.
@@ -73,34 +83,72 @@ bool TalkerChooserProc::init(KConfig* c, const QString& configGroup){
 /*virtual*/ QString TalkerChooserProc::convert(const QString& inputText, TalkerCode* talkerCode,
     const QString& appId)
 {
+    if ( !m_usable ) return inputText;
     if ( !m_re.isEmpty() )
     {
-        int pos = inputText.indexOf( QRegExp(m_re) );
+        int pos = m_regExp.indexIn( inputText );
         if ( pos < 0 ) return inputText;
     }
     // If appId doesn't match, return input unmolested.
-    if ( !m_appIdList.isEmpty() )
+    if ( !appIdMatches(appId) ) return inputText;
+
+    // Set the talker.
+    *talkerCode = m_chosenTalkerCode;
+    return inputText;
+}
+
+/*virtual*/ bool TalkerChooserProc::wasModified() { return false; }
+
+/*virtual*/ bool TalkerChooserProc::talkerRule(QString* pattern, QStringList* appIds,
+    TalkerCode* talkerCode)
+{
+    *pattern = m_re;
+    *appIds = m_appIdList;
+    *talkerCode = m_chosenTalkerCode;
+    return true;
+}
+
+/*virtual*/ bool TalkerChooserProc::supportsStreaming() { return true; }
+
+/*virtual*/ QString TalkerChooserProc::feed(const QString& chunk, TalkerCode* talkerCode,
+    const QString& appId)
+{
+    if ( !m_streamMatched )
     {
-        // kDebug() << "TalkerChooserProc::convert: converting " << inputText << " if appId "
-        //      << appId << " matches " << m_appIdList << endl;
-        bool found = false;
-        QString appIdStr = appId;
-        for (int ndx=0; ndx < m_appIdList.count(); ++ndx )
+        if ( !m_usable || !appIdMatches(appId) ) return chunk;
+        if ( !m_re.isEmpty() )
         {
-            if ( appIdStr.contains(m_appIdList[ndx]) )
+            QString text = m_streamContext + chunk;
+            if ( m_regExp.indexIn( text ) < 0 )
             {
-                found = true;
-                break;
+                m_streamContext = text.right( StreamContext );
+                return chunk;
             }
+            m_streamContext.clear();
         }
-        if ( !found )
-        {
-            // kDebug() << "TalkerChooserProc::convert: appId not found";
-            return inputText;
-        }
+        m_streamMatched = true;
     }
-
-    // Set the talker.
+    // The chosen talker applies to the rest of the stream.
     *talkerCode = m_chosenTalkerCode;
-    return inputText;
+    return chunk;
+}
+
+/*virtual*/ QString TalkerChooserProc::flush(TalkerCode* /*talkerCode*/, const QString& /*appId*/)
+{
+    m_streamContext.clear();
+    m_streamMatched = false;
+    return QString();
+}
+
+bool TalkerChooserProc::appIdMatches(const QString& appId) const
+{
+    if ( m_appIdList.isEmpty() ) return true;
+    // kDebug() << "TalkerChooserProc::appIdMatches: " << appId << " matches " << m_appIdList;
+    for (int ndx=0; ndx < m_appIdList.count(); ++ndx )
+    {
+        if ( appId.contains(m_appIdList[ndx]) )
+            return true;
+    }
+    // kDebug() << "TalkerChooserProc::appIdMatches: appId not found";
+    return false;
 }
@@ -30,6 +30,7 @@
 
 // KTTS includes.
 #include "filterproc.h"
+#include "filterregexp.h"
 #include "talkercode.h"
 
 class TalkerChooserProc : public KttsFilterProc
@@ -81,11 +82,48 @@ public:
      */
     virtual QString convert(const QString& inputText, TalkerCode* talkerCode, const QString& appId);
 
+    /**
+     * Returns False.  Only the talker is chosen; the text is passed through.
+     */
+    virtual bool wasModified();
+
+    /**
+     * Returns True and the filter's rule, so that the filter manager can
+     * evaluate it along with those of other talker choosers.
+     */
+    virtual bool talkerRule(QString* pattern, QStringList* appIds, TalkerCode* talkerCode);
+
+    /**
+     * Returns True.  The talker is chosen from the first piece of a stream
+     * in which the regular expression matches.
+     */
+    virtual bool supportsStreaming();
+
+    /**
+     * Convert the next piece of a stream.  The text itself is passed through
+     * unchanged and nothing is held back.
+     */
+    virtual QString feed(const QString& chunk, TalkerCode* talkerCode, const QString& appId);
+
+    /**
+     * Ends a stream.
+     */
+    virtual QString flush(TalkerCode* talkerCode, const QString& appId);
+
 private:
+    // True if the filter applies to the application.
+    bool appIdMatches(const QString& appId) const;
 
     QString         m_re;
+    FilterRegExp    m_regExp;
+    // False if the regular expression is invalid or unsafe to match.
+    bool            m_usable;
     QStringList     m_appIdList;
     TalkerCode      m_chosenTalkerCode;
+    // Tail of the stream so far, so matches across pieces are found.
+    QString         m_streamContext;
+    // True once the talker has been chosen for the current stream.
+    bool            m_streamMatched;
 };
 
 #endif      // TALKERCHOOSERPROC_H
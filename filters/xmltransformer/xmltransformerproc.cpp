@@ -28,7 +28,6 @@
 // Qt includes.
 #include <QtCore/QFile>
 #include <QtCore/QLatin1String>
-#include <QtCore/QRegExp>
 #include <QtCore/QTextStream>
 
 // KDE includes.
@@ -42,13 +41,21 @@
 // KTTS includes.
 #include "filterproc.h"
 
+/**
+ * Milliseconds convert() waits for xsltproc before killing it.
+ */
+static const int XsltprocTimeout = 15000;
+
 /**
  * Constructor.
  */
 XmlTransformerProc::XmlTransformerProc( QObject *parent, const QVariantList& args) :
-    KttsFilterProc(parent, args)
+    KttsFilterProc(parent, args),
+    m_ampersand(QLatin1String( "&(?!amp;)" ))
 {
     m_xsltProc = 0;
+    m_state = fsIdle;
+    m_wasModified = false;
 }
 
 /**
@@ -101,6 +108,7 @@ bool XmlTransformerProc::init(KConfig* c, const QString& configGroup)
     const QString& appId)
 {
     // kDebug() << "XmlTransformerProc::convert: Running.";
+    m_wasModified = false;
     // If not properly configured, do nothing.
     if ( m_xsltFilePath.isEmpty() || m_xsltprocPath.isEmpty() )
     {
@@ -205,7 +213,7 @@ bool XmlTransformerProc::asyncConvert(const QString& inputText, TalkerCode* talk
     // This will change & inside a CDATA section, which is not good, and also within comments and
     // processing instructions, which is OK because we don't speak those anyway.
     QString text = inputText;
-    text.replace(QRegExp(QLatin1String( "&(?!amp;)") ),QLatin1String( "&amp;" ));
+    m_ampersand.replace(text, QLatin1String( "&amp;" ));
     wstream << text;
     inFile.flush();
 
@@ -218,6 +226,7 @@ bool XmlTransformerProc::asyncConvert(const QString& inputText, TalkerCode* talk
     m_outFilename = outFile.fileName();
 
     /// Spawn an xsltproc process to apply our stylesheet to input file.
+    delete m_xsltProc;
     m_xsltProc = new KProcess;
     m_xsltProc->setOutputChannelMode(KProcess::SeparateChannels);
     *m_xsltProc << m_xsltprocPath;
@@ -228,8 +237,10 @@ bool XmlTransformerProc::asyncConvert(const QString& inputText, TalkerCode* talk
     //     m_xsltProc->args() << endl;
 
     m_state = fsFiltering;
+    // The filter may be waited for on a thread other than its own, with no
+    // event loop, so the output must be processed as soon as xsltproc exits.
     connect(m_xsltProc, SIGNAL(finished(int,QProcess::ExitStatus)),
-            this, SLOT(slotProcessExited(int,QProcess::ExitStatus)));
+            this, SLOT(slotProcessExited(int,QProcess::ExitStatus)), Qt::DirectConnection);
     connect(m_xsltProc, SIGNAL(readyReadStandardOutput()),
             this, SLOT(slotReceivedStdout()));
     connect(m_xsltProc, SIGNAL(readyReadStandardError()),
@@ -255,8 +266,8 @@ void XmlTransformerProc::processOutput()
     else
         kDebug() << "XmlTransformerProc::processOutput: xsltproc was killed.";
 
-    delete m_xsltProc;
-    m_xsltProc = 0;
+    // m_xsltProc is still emitting its finished signal; it is deleted with
+    // the next conversion.
 
     if (exitStatus != 0)
     {
@@ -274,10 +285,17 @@ void XmlTransformerProc::processOutput()
         kDebug() << "XmlTransformerProc::processOutput: Could not read file " << m_outFilename;
         m_state = fsFinished;
         emit filteringFinished();
+        return;
     }
     QTextStream rstream(&readfile);
-    m_text = rstream.readAll();
+    const QString output = rstream.readAll();
     readfile.close();
+    // Keep passing the input on if the stylesheet left it as it was.
+    if (output != m_text)
+    {
+        m_text = output;
+        m_wasModified = true;
+    }
 
     kDebug() << QLatin1String( "XmlTransformerProc::processOutput: Read file at " ) + m_inFilename + QLatin1String( " and created " ) + m_outFilename + QLatin1String( " based on the stylesheet at " ) << m_xsltFilePath;
 
@@ -285,7 +303,6 @@ void XmlTransformerProc::processOutput()
     QFile::remove(m_outFilename);
 
     m_state = fsFinished;
-    m_wasModified = true;
     emit filteringFinished();
 }
 
@@ -294,20 +311,24 @@ void XmlTransformerProc::processOutput()
  */
 /*virtual*/ void XmlTransformerProc::waitForFinished()
 {
-    if (m_xsltProc)
+    if ( !waitForFinished( XsltprocTimeout ) )
     {
-        if (m_xsltProc->state() != QProcess::NotRunning)
-        {
-            if ( !m_xsltProc->waitForFinished( 15 ) )
-            {
-                m_xsltProc->kill();
-                kDebug() << "XmlTransformerProc::waitForFinished: After waiting 15 seconds, xsltproc process seems to hung.  Killing it.";
-                processOutput();
-            }
-        }
+        kWarning() << "XmlTransformerProc::waitForFinished: After waiting" << XsltprocTimeout / 1000
+                   << "seconds, xsltproc process seems to hang.  Killing it.";
+        stopFiltering();
     }
 }
 
+/**
+ * Waits at most msecs milliseconds for a previous call to asyncConvert to finish.
+ */
+/*virtual*/ bool XmlTransformerProc::waitForFinished(int msecs)
+{
+    if (m_xsltProc && m_xsltProc->state() != QProcess::NotRunning)
+        return m_xsltProc->waitForFinished( msecs );
+    return true;
+}
+
 /**
  * Returns the state of the Filter.
  */
@@ -334,7 +355,15 @@ void XmlTransformerProc::processOutput()
 /*virtual*/ void XmlTransformerProc::stopFiltering()
 {
     m_state = fsStopping;
-    m_xsltProc->kill();
+    if (m_xsltProc && m_xsltProc->state() != QProcess::NotRunning)
+    {
+        // Reaping xsltproc processes the output of the killed process, which
+        // leaves the input text as it was.
+        m_xsltProc->kill();
+        m_xsltProc->waitForFinished();
+    }
+    m_state = fsIdle;
+    emit filteringStopped();
 }
 
 /**
@@ -343,6 +372,23 @@ void XmlTransformerProc::processOutput()
  */
 /*virtual*/ bool XmlTransformerProc::wasModified() { return m_wasModified; }
 
+/**
+ * Returns True, and "<", if the filter only applies to texts with a given
+ * root element or DOCTYPE.  A filter that is not configured changes nothing.
+ */
+/*virtual*/ bool XmlTransformerProc::firstChars(QString* chars)
+{
+    if ( m_xsltFilePath.isEmpty() || m_xsltprocPath.isEmpty() )
+    {
+        chars->clear();
+        return true;
+    }
+    if ( m_rootElementList.isEmpty() && m_doctypeList.isEmpty() )
+        return false;
+    *chars = QLatin1String( "<" );
+    return true;
+}
+
 void XmlTransformerProc::slotProcessExited(int /*exitCode*/, QProcess::ExitStatus /*exitStatus*/)
 {
     // kDebug() << "XmlTransformerProc::slotProcessExited: xsltproc has exited.";
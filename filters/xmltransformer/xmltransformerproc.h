@@ -33,6 +33,7 @@
 
 // KTTS includes.
 #include "filterproc.h"
+#include "filterregexp.h"
 #include "talkercode.h"
 
 class XmlTransformerProc : public KttsFilterProc
@@ -105,6 +106,13 @@ public:
      */
     virtual void waitForFinished();
 
+    /**
+     * Waits at most @p msecs milliseconds for a previous call to asyncConvert
+     * to finish.
+     * @return                  True if xsltproc has finished.
+     */
+    virtual bool waitForFinished(int msecs);
+
     /**
      * Returns the state of the Filter.
      */
@@ -132,6 +140,12 @@ public:
      */
     virtual bool wasModified();
 
+    /**
+     * Returns True, and "<", if the filter only applies to texts with a
+     * given root element or DOCTYPE.
+     */
+    virtual bool firstChars(QString* chars);
+
 private slots:
     void slotProcessExited(int exitCode, QProcess::ExitStatus exitStatus);
     void slotReceivedStdout();
@@ -180,6 +194,8 @@ private:
     QString m_xsltprocPath;
     // Did this filter modify the text?
     bool m_wasModified;
+    // Ampersands that are not the start of "&amp;".
+    FilterRegExp m_ampersand;
 };
 
 #endif      // XMLTRANSFORMERPROC_H
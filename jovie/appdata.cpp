@@ -26,17 +26,19 @@
 
 #include "kdebug.h"
 
+#include "configdata.h"
+
 /* -------------------------------------------------------------------------- */
 
 class AppDataPrivate
 {
 public:
-    AppDataPrivate(const QString& newAppId) :
+    AppDataPrivate(const QString& newAppId, const ConfigDataPtr& config) :
         appId(newAppId),
         applicationName(appId),
-        defaultPriority(KSpeech::jpMessage),
-        sentenceDelimiter(QLatin1String( "([\\.\\?\\!\\:\\;])(\\s|$|(\\n *\\n))" )),
-        filteringOn(true),
+        defaultPriority(config->defaultPriority),
+        sentenceDelimiter(config->sentenceDelimiter),
+        filteringOn(config->filteringOn),
         isApplicationPaused(false),
         autoConfigureTalkersOn(false),
         isSystemManager(false),
@@ -63,7 +65,7 @@ protected:
 
 /* -------------------------------------------------------------------------- */
 
-AppData::AppData(const QString& appId) { d = new AppDataPrivate(appId); }
+AppData::AppData(const QString& appId) { d = new AppDataPrivate(appId, ConfigData::current()); }
 AppData::~AppData() { delete d; }
 
 QString AppData::appId() const { return d->appId; }
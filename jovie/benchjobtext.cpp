@@ -0,0 +1,159 @@
+#include <QtTest>
+#include <QtCore/QRegExp>
+#include "benchjobtext.h"
+#include "jobtext.h"
+
+// Counts the heap allocations a job's text costs on its way from the
+// filtered QString to the sentence handed to speech-dispatcher, and times
+// indexing a long document.  Allocations are counted by wrapping glibc's
+// malloc; elsewhere only the timings are reported.
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static bool s_counting = false;
+static int s_allocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    if (s_counting)
+        ++s_allocations;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if (s_counting)
+        ++s_allocations;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (s_counting)
+        ++s_allocations;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+#define COUNT_ALLOCATIONS 1
+#endif
+
+static const QRegExp sentenceDelimiter(QLatin1String("([\\.\\?\\!\\:\\;])(\\s|$|(\\n *\\n))"));
+
+static void startCounting()
+{
+#ifdef COUNT_ALLOCATIONS
+    s_allocations = 0;
+    s_counting = true;
+#endif
+}
+
+// Returns the allocations since startCounting(), or -1 if they are not counted.
+static int stopCounting()
+{
+#ifdef COUNT_ALLOCATIONS
+    s_counting = false;
+    return s_allocations;
+#else
+    return -1;
+#endif
+}
+
+void BenchJobText::allocations_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("sentences");
+    QTest::newRow("short message") << QString::fromLatin1("You have new mail.") << 1;
+    QString paragraph;
+    for (int i = 0; i < 100; ++i)
+        paragraph += QString::fromUtf8("Sentence number %1 of a paragraph, with a word or two: caf\xc3\xa9. ").arg(i);
+    QTest::newRow("paragraph") << paragraph << 200;
+}
+
+void BenchJobText::allocations()
+{
+    QFETCH(QString, text);
+    QFETCH(int, sentences);
+
+    startCounting();
+    {
+        JobText jobText;
+        jobText.appendText(text, sentenceDelimiter);
+        jobText.squeeze();
+        for (int i = 0; i < jobText.sentenceCount(); ++i)
+            QVERIFY(jobText.sentenceData(i)[0] != '\0');
+        QCOMPARE(jobText.sentenceCount(), sentences);
+    }
+    int allocations = stopCounting();
+    if (allocations >= 0)
+        qDebug() << QTest::currentDataTag() << ":" << allocations << "allocations for"
+                 << sentences << "sentences";
+}
+
+void BenchJobText::sentenceInPlace()
+{
+    JobText jobText;
+    jobText.appendText(QString::fromLatin1("One. Two. Three."), sentenceDelimiter);
+    QCOMPARE(jobText.sentence(1), QByteArray("Two."));
+
+    // Fetching sentences of the same block hands out pointers into it.
+    startCounting();
+    const char *first = jobText.sentenceData(0);
+    const char *third = jobText.sentenceData(2);
+    int allocations = stopCounting();
+    QCOMPARE(QByteArray(first), QByteArray("One."));
+    QCOMPARE(QByteArray(third), QByteArray("Three."));
+    if (allocations >= 0)
+        QCOMPARE(allocations, 0);
+}
+
+void BenchJobText::document()
+{
+    QString document;
+    for (int i = 0; i < 20000; ++i)
+        document += QString::fromLatin1("This is sentence %1 of a long document. ").arg(i);
+
+    JobText jobText;
+    QBENCHMARK_ONCE {
+        jobText.appendText(document, sentenceDelimiter);
+        jobText.squeeze();
+    }
+    QCOMPARE(jobText.sentenceCount(), 20000);
+    QCOMPARE(jobText.sentence(12345), QByteArray("This is sentence 12345 of a long document."));
+    qDebug() << "document:" << jobText.size() << "bytes," << JobText::residentBytes()
+             << "bytes compressed in memory";
+}
+
+void BenchJobText::nonAsciiDocument()
+{
+    // Three UTF-8 bytes to each character, so a block fills up three times
+    // faster than the character count of its sentences suggests.
+    const QString sentence = QString::fromUtf8("\xe6\x96\x87\xe7\xab\xa0 %1 \xe3\x81\xae\xe6\x96\x87\xe3\x81\xa7\xe3\x81\x99.");
+    QString document;
+    for (int i = 0; i < 20000; ++i)
+        document += sentence.arg(i) + QLatin1Char(' ');
+
+    JobText jobText;
+    QBENCHMARK_ONCE {
+        jobText.appendText(document, sentenceDelimiter);
+        jobText.squeeze();
+    }
+    QCOMPARE(jobText.sentenceCount(), 20000);
+    QCOMPARE(jobText.sentence(0), sentence.arg(0).toUtf8());
+    QCOMPARE(jobText.sentence(12345), sentence.arg(12345).toUtf8());
+    QCOMPARE(jobText.sentence(19999), sentence.arg(19999).toUtf8());
+    QCOMPARE(jobText.size(), document.trimmed().toUtf8().size() - 19999);
+    qDebug() << "non-ASCII document:" << jobText.size() << "bytes," << JobText::residentBytes()
+             << "bytes compressed in memory";
+}
+
+QTEST_MAIN(BenchJobText)
+#include "benchjobtext.moc"
@@ -0,0 +1,18 @@
+#ifndef BENCHJOBTEXT_H
+#define BENCHJOBTEXT_H
+
+#include <QObject>
+
+class BenchJobText : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void allocations_data();
+    void allocations();
+    void sentenceInPlace();
+    void document();
+    void nonAsciiDocument();
+};
+
+#endif // BENCHJOBTEXT_H
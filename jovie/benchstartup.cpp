@@ -0,0 +1,93 @@
+#include <QtTest>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QProcess>
+#include <QtDBus/QtDBus>
+#include "benchstartup.h"
+
+// Measures how long a freshly started daemon takes to answer on /KSpeech
+// and to accept its first job, and how much memory it holds by then.  Runs
+// once for jovie and once for jovie-headless.  Needs a session bus and no
+// running Jovie.  Set JOVIE_BIN to benchmark a binary other than the ones
+// built alongside.
+
+static const int StartupTimeout = 30000;
+
+static QString jovieBinary(const QString& name)
+{
+    QString program = QString::fromLocal8Bit(qgetenv("JOVIE_BIN"));
+    if (program.isEmpty())
+        program = QCoreApplication::applicationDirPath() + QLatin1Char('/') + name;
+    return program;
+}
+
+// Resident set size of a process in kB, or -1 where /proc is not available.
+static int residentKb(Q_PID pid)
+{
+    QFile status(QString::fromLatin1("/proc/%1/status").arg(pid));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+    foreach (const QByteArray& line, status.readAll().split('\n')) {
+        if (line.startsWith("VmRSS:"))
+            return line.mid(6).trimmed().split(' ').first().toInt();
+    }
+    return -1;
+}
+
+void BenchStartup::initTestCase()
+{
+    if (!QDBusConnection::sessionBus().isConnected())
+        QSKIP("No D-Bus session bus", SkipAll);
+    if (QDBusConnection::sessionBus().interface()->isServiceRegistered(QLatin1String("org.kde.KSpeech")))
+        QSKIP("Jovie is already running", SkipAll);
+}
+
+void BenchStartup::startup_data()
+{
+    QTest::addColumn<QString>("binary");
+    QTest::newRow("jovie") << QString::fromLatin1("jovie");
+    QTest::newRow("headless") << QString::fromLatin1("jovie-headless");
+}
+
+void BenchStartup::startup()
+{
+    QFETCH(QString, binary);
+    if (!QFile::exists(jovieBinary(binary)))
+        QSKIP("Jovie binary not found", SkipSingle);
+
+    QProcess jovie;
+    QElapsedTimer timer;
+    qint64 registered = -1;
+    qint64 firstJob = -1;
+
+    QBENCHMARK_ONCE {
+        timer.start();
+        jovie.start(jovieBinary(binary), QStringList() << QLatin1String("--nofork"));
+        QVERIFY(jovie.waitForStarted());
+
+        QDBusInterface kspeech(QLatin1String("org.kde.KSpeech"), QLatin1String("/KSpeech"),
+                               QLatin1String("org.kde.KSpeech"));
+        while (timer.elapsed() < StartupTimeout) {
+            QDBusReply<QString> version = kspeech.call(QLatin1String("version"));
+            if (version.isValid())
+                break;
+            QTest::qWait(2);
+        }
+        registered = timer.elapsed();
+
+        QDBusReply<int> jobNum = kspeech.call(QLatin1String("say"), QString::fromLatin1("Hello."), 0);
+        QVERIFY(jobNum.isValid());
+        firstJob = timer.elapsed();
+    }
+
+    qDebug() << binary << ": /KSpeech answered after" << registered << "ms, first job accepted after"
+             << firstJob << "ms, resident" << residentKb(jovie.pid()) << "kB";
+    QVERIFY(registered < StartupTimeout);
+
+    QDBusInterface(QLatin1String("org.kde.KSpeech"), QLatin1String("/KSpeech"),
+                   QLatin1String("org.kde.KSpeech")).call(QLatin1String("kttsdExit"));
+    if (!jovie.waitForFinished(5000))
+        jovie.kill();
+}
+
+QTEST_MAIN(BenchStartup)
+#include "benchstartup.moc"
@@ -0,0 +1,16 @@
+#ifndef BENCHSTARTUP_H
+#define BENCHSTARTUP_H
+
+#include <QObject>
+
+class BenchStartup : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void startup_data();
+    void startup();
+};
+
+#endif // BENCHSTARTUP_H
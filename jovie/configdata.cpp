@@ -0,0 +1,152 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Immutable snapshot of the Jovie configuration (kttsdrc).
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#include "configdata.h"
+
+// Qt includes.
+#include <QtCore/QAtomicPointer>
+
+// KDE includes.
+#include <kdebug.h>
+#include <kconfig.h>
+#include <kconfiggroup.h>
+#include <kservicetypetrader.h>
+
+static QAtomicPointer<ConfigData> s_current(0);
+
+ConfigData::ConfigData() :
+    defaultPriority(KSpeech::jpMessage),
+    sentenceDelimiter(QLatin1String( "([\\.\\?\\!\\:\\;])(\\s|$|(\\n *\\n))" )),
+    filteringOn(true),
+    broadcastJobSignals(false),
+    socketEnabled(false),
+    m_config(new KConfig(QLatin1String( "kttsdrc" )))
+{
+}
+
+ConfigData::~ConfigData()
+{
+    delete m_config;
+}
+
+KConfig* ConfigData::config() const
+{
+    return m_config;
+}
+
+ConfigDataPtr ConfigData::current()
+{
+    ConfigData* data = s_current;
+    if (!data)
+        return reload();
+    return ConfigDataPtr(data);
+}
+
+ConfigDataPtr ConfigData::reload()
+{
+    ConfigData* data = new ConfigData;
+    data->load();
+    publish(data);
+    return ConfigDataPtr(data);
+}
+
+void ConfigData::publish(ConfigData* data)
+{
+    // The published pointer holds a reference of its own.
+    data->ref.ref();
+    ConfigData* old = s_current.fetchAndStoreOrdered(data);
+    if (old && !old->ref.deref())
+        delete old;
+}
+
+void ConfigData::load()
+{
+    KConfigGroup general(m_config, "General");
+
+    // Talkers.
+    talkerIds = general.readEntry("TalkerIDs", QStringList());
+    KConfigGroup talkGroup(m_config, "Talkers");
+    foreach (const QString& talkerID, talkerIds)
+    {
+        QString talkerCode = talkGroup.readEntry(talkerID);
+        kDebug() << "ConfigData::load: talkerID = " << talkerID << " talkerCode = " << talkerCode;
+        talkers.append(TalkerCode(talkerCode, true));
+    }
+    if (!talkers.isEmpty())
+        defaultTalker = talkers.first();
+
+    // Filters.
+    QStringList filterIDsList = general.readEntry("FilterIDs", QStringList());
+    kDebug() << "ConfigData::load: FilterIDs = " << filterIDsList;
+    foreach (const QString& filterID, filterIDsList)
+    {
+        FilterEntry entry;
+        entry.filterId = filterID;
+        entry.groupName = QLatin1String( "Filter_" ) + filterID;
+        KConfigGroup thisgroup(m_config, entry.groupName);
+        entry.desktopEntryName = thisgroup.readEntry("DesktopEntryName");
+        // If a DesktopEntryName is not in the config file, it was configured before
+        // we started using them, when we stored translated plugin names instead.
+        // Try to convert the translated plugin name to a DesktopEntryName.
+        // DesktopEntryNames are better because user can change their desktop language
+        // and DesktopEntryName won't change.
+        if (entry.desktopEntryName.isEmpty())
+        {
+            QString filterPlugInName = thisgroup.readEntry("PlugInName", QString());
+            // See if the translated name will untranslate.  If not, well, sorry.
+            entry.desktopEntryName = filterNameToDesktopEntryName(filterPlugInName);
+            // Record the DesktopEntryName from now on.
+            if (!entry.desktopEntryName.isEmpty())
+                thisgroup.writeEntry("DesktopEntryName", entry.desktopEntryName);
+        }
+        entry.userFilterName = thisgroup.readEntry("UserFilterName", entry.desktopEntryName);
+        entry.enabled = thisgroup.readEntry("Enabled", false);
+        entry.isSBD = thisgroup.readEntry("IsSBD", false);
+        entry.latencyBudget = qMax(0, thisgroup.readEntry("LatencyBudget", 5000));
+        entry.overrunLimit = qMax(0, thisgroup.readEntry("OverrunLimit", 3));
+        entry.bypassSeconds = qMax(0, thisgroup.readEntry("BypassSeconds", 60));
+        filters.append(entry);
+    }
+
+    // Application defaults.
+    int priority = general.readEntry("DefaultPriority", int(defaultPriority));
+    if (priority >= KSpeech::jpScreenReaderOutput && priority <= KSpeech::jpProgress)
+        defaultPriority = static_cast<KSpeech::JobPriority>(priority);
+    sentenceDelimiter = general.readEntry("SentenceDelimiter", sentenceDelimiter);
+    filteringOn = general.readEntry("FilteringOn", filteringOn);
+
+    // Job signals.
+    broadcastJobSignals = general.readEntry("BroadcastJobSignals", broadcastJobSignals);
+
+    // Local socket protocol.
+    socketEnabled = general.readEntry("EnableSocket", socketEnabled);
+    socketPath = general.readEntry("SocketPath", QString());
+}
+
+QString ConfigData::filterNameToDesktopEntryName(const QString& name)
+{
+    if (name.isEmpty()) return QString();
+    KService::List offers = KServiceTypeTrader::self()->query(QLatin1String( "Jovie/FilterPlugin" ),
+    QString(QLatin1String( "Name == '%1'" )).arg(name));
+
+    if (offers.count() == 1)
+        return offers[0]->desktopEntryName();
+    else
+        return QString();
+}
@@ -0,0 +1,132 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Immutable snapshot of the Jovie configuration (kttsdrc).
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef CONFIGDATA_H
+#define CONFIGDATA_H
+
+// Qt includes.
+#include <QtCore/QList>
+#include <QtCore/QSharedData>
+#include <QtCore/QStringList>
+
+// KDE includes.
+#include <kspeech.h>
+
+// KTTS includes.
+#include "talkercode.h"
+
+class KConfig;
+class ConfigData;
+
+typedef QExplicitlySharedDataPointer<const ConfigData> ConfigDataPtr;
+
+/**
+ * @class ConfigData
+ *
+ * Typed, read-only view of kttsdrc.  The file is parsed once per (re)load into
+ * a new ConfigData, which is then published with an atomic pointer swap.
+ * Code that needs a consistent view, such as a job being filtered, holds on to
+ * the ConfigDataPtr it started with; a reload never changes an existing snapshot.
+ *
+ * @ref reload and @ref current must be called from the main thread.  Other
+ * threads only use snapshots handed to them.
+ */
+class ConfigData : public QSharedData
+{
+public:
+    /**
+     * One configured filter.
+     */
+    struct FilterEntry
+    {
+        QString filterId;
+        QString groupName;
+        QString desktopEntryName;
+        QString userFilterName;
+        bool enabled;
+        bool isSBD;
+        /** Milliseconds the filter may take for one text, or 0 for no limit. */
+        int latencyBudget;
+        /** Overruns in a row after which the filter is bypassed, or 0 never to. */
+        int overrunLimit;
+        /** Seconds the filter is bypassed for. */
+        int bypassSeconds;
+    };
+
+    /**
+     * Returns the current snapshot, loading one first if there is none yet.
+     */
+    static ConfigDataPtr current();
+
+    /**
+     * Parses kttsdrc into a new snapshot and makes it current.
+     * @return               The new snapshot.
+     */
+    static ConfigDataPtr reload();
+
+    /**
+     * Destructor.
+     */
+    ~ConfigData();
+
+    /**
+     * The parsed kttsdrc.  Only meant for handing to plugins that read their
+     * own settings (@ref KttsFilterProc::init); do not write to it.
+     */
+    KConfig* config() const;
+
+    /** Configured talker IDs and their parsed talker codes, in the same order. */
+    QStringList talkerIds;
+    TalkerCode::TalkerCodeList talkers;
+
+    /** The first configured talker, or an empty TalkerCode if there is none. */
+    TalkerCode defaultTalker;
+
+    /** Configured filters, in filtering order. */
+    QList<FilterEntry> filters;
+
+    /** Defaults for applications that have not set their own. */
+    KSpeech::JobPriority defaultPriority;
+    QString sentenceDelimiter;
+    bool filteringOn;
+
+    /** Whether job signals are also broadcast from /KSpeech.  Otherwise
+     *  they only come from the per-job objects.  @see SpeechJobAdaptor */
+    bool broadcastJobSignals;
+
+    /** Whether to serve the local socket protocol, and where.  An empty
+     *  path means the default location.  @see SocketServer */
+    bool socketEnabled;
+    QString socketPath;
+
+private:
+    ConfigData();
+    Q_DISABLE_COPY(ConfigData)
+
+    // Reads everything from m_config.
+    void load();
+    // Makes data the current snapshot, releasing the previous one.
+    static void publish(ConfigData* data);
+    // Uses KTrader to convert a translated Filter Plugin Name to DesktopEntryName.
+    static QString filterNameToDesktopEntryName(const QString& name);
+
+    KConfig* m_config;
+};
+
+#endif      // CONFIGDATA_H
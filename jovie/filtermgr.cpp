@@ -27,16 +27,177 @@
 #include "filtermgr.h"
 #include "filtermgr.moc"
 
+// System includes.
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 // Qt includes
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
 
 // KDE includes.
 #include <kdebug.h>
-#include <kconfig.h>
-#include <kconfiggroup.h>
+#include <kglobal.h>
 #include <kpluginloader.h>
-#include <ksharedconfig.h>
 #include <kservicetypetrader.h>
 
+// KTTS includes.
+#include "talkercode.h"
+
+/**
+ * Characters of a stream kept for matching talker chooser rules across pieces.
+ */
+static const int StreamContext = 256;
+
+/**
+ * Returns True if a text contains a character whose bit is set.  @p low and
+ * @p high are the lowest and highest character with a bit set.  The bits
+ * are tested a code unit at a time; text outside the table is skipped with
+ * one comparison.  With SSE2, eight code units at a time are skipped while
+ * none lies between @p low and @p high, as most text does for filters that
+ * wait for a < or an &.
+ */
+static bool containsAny(const QString& text, const QVector<quint32>& bits, ushort low, ushort high)
+{
+    if (low > high)
+        return false;
+    const uint limit = bits.size() * 32;
+    const quint32* table = bits.constData();
+    const ushort* p = text.utf16();
+    const ushort* end = p + text.length();
+#if defined(__SSE2__)
+    // SSE2 only compares signed words, so the offsets from low are biased.
+    const __m128i bias = _mm_set1_epi16(short(0x8000));
+    const __m128i lowest = _mm_set1_epi16(short(low));
+    const __m128i span = _mm_set1_epi16(short((high - low) ^ 0x8000));
+    while (end - p >= 8)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i offset = _mm_xor_si128(_mm_sub_epi16(chunk, lowest), bias);
+        int inside = ~_mm_movemask_epi8(_mm_cmpgt_epi16(offset, span)) & 0xffff;
+        // Two mask bits to each code unit.
+        while (inside)
+        {
+            const uint code = p[__builtin_ctz(inside) / 2];
+            if (table[code >> 5] & (1u << (code & 31)))
+                return true;
+            inside &= inside - 1;
+            inside &= inside - 1;
+        }
+        p += 8;
+    }
+#endif
+    for (; p != end; ++p)
+    {
+        const uint code = *p;
+        if (code < limit && (table[code >> 5] & (1u << (code & 31))))
+            return true;
+    }
+    return false;
+}
+
+K_GLOBAL_STATIC(FilterHealth, s_filterHealth)
+
+FilterHealth* FilterHealth::instance()
+{
+    return s_filterHealth;
+}
+
+void FilterHealth::setConfig(const ConfigDataPtr& configData)
+{
+    QMutexLocker locker(&m_mutex);
+    if (configData == m_configData)
+        return;
+    foreach (const Entry& entry, m_entries)
+    {
+        const FilterStats& stats = entry.stats;
+        if (stats.runs)
+            kDebug() << "FilterHealth::setConfig: filter " << stats.filterId << " left " << stats.unchanged
+                     << " of " << stats.runs << " texts unchanged";
+        if (stats.skipped)
+            kDebug() << "FilterHealth::setConfig: filter " << stats.filterId << " was not needed for "
+                     << stats.skipped << " texts";
+        if (stats.overruns)
+            kDebug() << "FilterHealth::setConfig: filter " << stats.filterId << " overran its budget "
+                     << stats.overruns << " times, was bypassed " << stats.trips
+                     << " times and skipped " << stats.bypassed << " texts; longest call "
+                     << stats.maxMsecs << " ms";
+    }
+    m_entries.clear();
+    m_configData = configData;
+}
+
+FilterHealth::Entry& FilterHealth::entry(const QString& filterId)
+{
+    QHash<QString, Entry>::iterator it = m_entries.find(filterId);
+    if (it == m_entries.end())
+    {
+        it = m_entries.insert(filterId, Entry());
+        it->stats.filterId = filterId;
+    }
+    return *it;
+}
+
+bool FilterHealth::admit(const QString& filterId, int overrunLimit, int bypassMsecs)
+{
+    QMutexLocker locker(&m_mutex);
+    Entry& e = entry(filterId);
+    if (!e.opened.isValid())
+        return true;
+    if (!e.opened.hasExpired(bypassMsecs))
+    {
+        ++e.stats.bypassed;
+        return false;
+    }
+    // Try the filter again.  One more overrun bypasses it again.
+    e.opened.invalidate();
+    e.overruns = overrunLimit - 1;
+    return true;
+}
+
+void FilterHealth::countSkipped(const QString& filterId)
+{
+    QMutexLocker locker(&m_mutex);
+    ++entry(filterId).stats.skipped;
+}
+
+bool FilterHealth::countRun(const QString& filterId, qint64 msecs, bool overran, bool modified, int overrunLimit)
+{
+    QMutexLocker locker(&m_mutex);
+    Entry& e = entry(filterId);
+    FilterStats& stats = e.stats;
+    ++stats.runs;
+    stats.totalMsecs += msecs;
+    stats.maxMsecs = qMax(stats.maxMsecs, msecs);
+    if (!overran)
+    {
+        e.overruns = 0;
+        if (!modified)
+            ++stats.unchanged;
+        return false;
+    }
+    ++stats.overruns;
+    if (overrunLimit <= 0 || ++e.overruns < overrunLimit || e.opened.isValid())
+        return false;
+    ++stats.trips;
+    e.opened.start();
+    return true;
+}
+
+QList<FilterStats> FilterHealth::stats(const QStringList& filterIds) const
+{
+    QMutexLocker locker(&m_mutex);
+    QList<FilterStats> result;
+    foreach (const QString& filterId, filterIds)
+    {
+        FilterStats stats = m_entries.value(filterId).stats;
+        stats.filterId = filterId;
+        result.append(stats);
+    }
+    return result;
+}
+
 /**
  * Constructor.
  */
@@ -46,6 +207,10 @@ FilterMgr::FilterMgr( QObject *parent) :
     // kDebug() << "FilterMgr::FilterMgr: Running";
     m_state = fsIdle;
     m_talkerCode = 0;
+    m_filterIndex = -1;
+    m_lastFilter = 0;
+    m_streamChosen = false;
+    m_loaded = false;
 }
 
 /**
@@ -59,58 +224,89 @@ FilterMgr::~FilterMgr()
 }
 
 /**
- * Loads and initializes the filters.
+ * Prepares the filters for loading.
  * @return                False if FilterMgr is not ready to filter.
  */
 bool FilterMgr::init()
 {
-    // Load each of the filters and initialize.
-    KSharedConfig::Ptr pConfig = KSharedConfig::openConfig( QLatin1String( "kttsdrc" ) );
-    KConfigGroup config( pConfig, "General");
-    KConfig* rawconfig = new KConfig(QLatin1String( "kttsdrc" ));
-    QStringList filterIDsList = config.readEntry("FilterIDs", QStringList());
-    kDebug() << "FilterMgr::init: FilterIDs = " << filterIDsList;
+    QMutexLocker locker(&m_loadMutex);
+    m_breakers.clear();
+    m_prefilters.clear();
+    qDeleteAll(m_filterList);
+    m_filterList.clear();
+    m_classifier.clear();
+    m_loaded = false;
+    m_configData = ConfigData::current();
+    FilterHealth::instance()->setConfig(m_configData);
+    return true;
+}
 
-    if ( !filterIDsList.isEmpty() )
+/**
+ * Loads and initializes the filters.
+ */
+void FilterMgr::load()
+{
+    QMutexLocker locker(&m_loadMutex);
+    if (m_loaded)
+        return;
+    m_loaded = true;
+
+    if (!m_configData)
+        return;
+
+    // Load each of the enabled filters and initialize.
+    foreach (const ConfigData::FilterEntry& entry, m_configData->filters)
     {
-        QStringList::ConstIterator itEnd = filterIDsList.constEnd();
-        for (QStringList::ConstIterator it = filterIDsList.constBegin(); it != itEnd; ++it)
+        if (entry.enabled || entry.isSBD)
         {
-            QString filterID = *it;
-            QString groupName = QLatin1String( "Filter_" ) + filterID;
-            KConfigGroup thisgroup = pConfig->group(groupName);
-            QString desktopEntryName = thisgroup.readEntry( "DesktopEntryName" );
-            // If a DesktopEntryName is not in the config file, it was configured before
-            // we started using them, when we stored translated plugin names instead.
-            // Try to convert the translated plugin name to a DesktopEntryName.
-            // DesktopEntryNames are better because user can change their desktop language
-            // and DesktopEntryName won't change.
-            if (desktopEntryName.isEmpty())
+            kDebug() << "FilterMgr::load: filterID = " << entry.filterId;
+            KttsFilterProc* filterProc = loadFilterPlugin( entry.desktopEntryName );
+            if ( filterProc )
             {
-                QString filterPlugInName = thisgroup.readEntry("PlugInName", QString());
-                // See if the translated name will untranslate.  If not, well, sorry.
-                desktopEntryName = FilterNameToDesktopEntryName(filterPlugInName);
-                // Record the DesktopEntryName from now on.
-                if (!desktopEntryName.isEmpty())
-                    thisgroup.writeEntry("DesktopEntryName", desktopEntryName);
-            }
-            if (thisgroup.readEntry("Enabled",false) || thisgroup.readEntry("IsSBD",false))
-            {
-                kDebug() << "FilterMgr::init: filterID = " << filterID;
-                KttsFilterProc* filterProc = loadFilterPlugin( desktopEntryName );
-                if ( filterProc )
+                filterProc->init( m_configData->config(), entry.groupName );
+                QString pattern;
+                QStringList appIds;
+                TalkerCode talkerCode;
+                if ( filterProc->talkerRule( &pattern, &appIds, &talkerCode ) )
                 {
-                    filterProc->init( rawconfig, groupName );
-                    m_filterList.append( filterProc );
+                    // Evaluated along with the other talker choosers.
+                    m_classifier.addRule( pattern, appIds, talkerCode );
+                    delete filterProc;
+                    continue;
                 }
-                //if (thisgroup.readEntry("DocType").contains("html") ||
-                //    thisgroup.readEntry("RootElement").contains("html"))
-                    //m_supportsHTML = true;
+                // Plugins loaded ahead of time belong to the loading thread.
+                if (filterProc->thread() != thread())
+                    filterProc->moveToThread(thread());
+                m_filterList.append( filterProc );
+                Breaker breaker;
+                breaker.filterId = entry.filterId;
+                breaker.budget = entry.latencyBudget;
+                breaker.overrunLimit = entry.overrunLimit;
+                breaker.bypassMsecs = entry.bypassSeconds * 1000;
+                m_breakers.append( breaker );
+                Prefilter prefilter;
+                prefilter.low = 0xffff;
+                prefilter.high = 0;
+                QString chars;
+                prefilter.known = filterProc->firstChars( &chars );
+                if ( prefilter.known )
+                {
+                    foreach ( const QChar& c, chars )
+                    {
+                        prefilter.low = qMin( prefilter.low, c.unicode() );
+                        prefilter.high = qMax( prefilter.high, c.unicode() );
+                        const int word = c.unicode() >> 5;
+                        if ( word >= prefilter.bits.size() )
+                            prefilter.bits.resize( word + 1 );
+                        prefilter.bits[word] |= 1u << ( c.unicode() & 31 );
+                    }
+                    kDebug() << "FilterMgr::load: " << entry.filterId << " only changes texts with one of "
+                             << chars;
+                }
+                m_prefilters.append( prefilter );
             }
         }
     }
-    delete rawconfig;
-    return true;
 }
 
 /**
@@ -125,10 +321,31 @@ bool FilterMgr::init()
  */
 QString FilterMgr::convert(const QString& inputText, TalkerCode* talkerCode, const QString& appId)
 {
+    load();
+    chooseTalker(inputText, talkerCode, appId);
+    return convert(inputText, 0, m_filterList.count(), talkerCode, appId);
+}
+
+/**
+ * Chooses the talker for a text by the rules of all talker chooser filters.
+ */
+bool FilterMgr::chooseTalker(const QString& text, TalkerCode* talkerCode, const QString& appId)
+{
+    load();
+    return m_classifier.classify(text, appId, talkerCode);
+}
+
+/**
+ * Runs a text through the filters from first up to, but not including, last.
+ */
+QString FilterMgr::convert(const QString& inputText, int first, int last, TalkerCode* talkerCode, const QString& appId)
+{
+    load();
     m_text = inputText;
     m_talkerCode = talkerCode;
     m_appId = appId;
-    m_filterIndex = -1;
+    m_filterIndex = first - 1;
+    m_lastFilter = qMin(last, m_filterList.count());
     m_filterProc = 0;
     m_state = fsFiltering;
     //m_async = false;
@@ -137,21 +354,227 @@ QString FilterMgr::convert(const QString& inputText, TalkerCode* talkerCode, con
     return m_text;
 }
 
+/**
+ * Returns the number of loaded filters.
+ */
+int FilterMgr::filterCount()
+{
+    load();
+    return m_filterList.count();
+}
+
+/**
+ * Returns True if filter number index supports splitting.
+ */
+bool FilterMgr::filterSupportsSplitting(int index)
+{
+    load();
+    return m_filterList.at(index)->supportsSplitting();
+}
+
+/**
+ * Returns run and no-op counts of each loaded filter.
+ */
+QList<FilterStats> FilterMgr::stats() const
+{
+    QStringList filterIds;
+    foreach (const Breaker& breaker, m_breakers)
+        filterIds.append(breaker.filterId);
+    return FilterHealth::instance()->stats(filterIds);
+}
+
+/**
+ * Returns True if every loaded filter supports streaming.
+ */
+bool FilterMgr::supportsStreaming()
+{
+    load();
+    foreach (KttsFilterProc* filterProc, m_filterList)
+    {
+        if (!filterProc->supportsStreaming())
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Returns the number of characters the whole filter chain may hold back.
+ */
+int FilterMgr::holdback()
+{
+    load();
+    int total = 0;
+    foreach (KttsFilterProc* filterProc, m_filterList)
+        total += filterProc->holdback();
+    return total;
+}
+
+/**
+ * Runs the next piece of a stream through the filters.
+ */
+QString FilterMgr::feed(const QString& chunk, TalkerCode* talkerCode, const QString& appId)
+{
+    if (!supportsStreaming())
+    {
+        m_streamText += chunk;
+        return QString();
+    }
+    if (!m_streamChosen && !m_classifier.isEmpty())
+    {
+        const QString text = m_streamContext + chunk;
+        if (m_classifier.classify(text, appId, &m_streamTalker))
+        {
+            m_streamChosen = true;
+            m_streamContext.clear();
+        }
+        else
+            m_streamContext = text.right(StreamContext);
+    }
+    // The chosen talker applies to the rest of the stream.
+    if (m_streamChosen)
+        *talkerCode = m_streamTalker;
+    QString text = chunk;
+    for (int index = 0; index < m_filterList.count() && !text.isEmpty(); ++index)
+        text = streamFilter(index, text, false, talkerCode, appId);
+    return text;
+}
+
+/**
+ * Ends a stream, flushing each filter into the next.
+ */
+QString FilterMgr::flush(TalkerCode* talkerCode, const QString& appId)
+{
+    if (!supportsStreaming())
+    {
+        QString text = m_streamText;
+        m_streamText.clear();
+        return convert(text, talkerCode, appId);
+    }
+    m_streamContext.clear();
+    m_streamChosen = false;
+    QString text;
+    for (int index = 0; index < m_filterList.count(); ++index)
+        text = streamFilter(index, text, true, talkerCode, appId);
+    return text;
+}
+
+// Feeds a piece of a stream to filter number index and, if end is True,
+// flushes it.  A piece cannot be taken back from a streaming filter, so its
+// output is kept even when the filter ran over budget; the overrun only
+// counts towards opening the breaker.  While the breaker is open the piece
+// passes as it is, after whatever text the filter was holding back.
+QString FilterMgr::streamFilter(int index, const QString& text, bool end, TalkerCode* talkerCode, const QString& appId)
+{
+    KttsFilterProc* filterProc = m_filterList.at(index);
+    const Breaker& breaker = m_breakers.at(index);
+    FilterHealth* health = FilterHealth::instance();
+    // Filters cut streams after whitespace, so a piece that ends in one and
+    // holds none of the filter's first characters can go past it, as long as
+    // the filter is not holding back text the piece would follow.
+    const Prefilter& prefilter = m_prefilters.at(index);
+    if (!end && prefilter.known && text.at(text.length() - 1).isSpace() && !filterProc->isHolding()
+        && !containsAny(text, prefilter.bits, prefilter.low, prefilter.high))
+    {
+        health->countSkipped(breaker.filterId);
+        return text;
+    }
+    if (!health->admit(breaker.filterId, breaker.overrunLimit, breaker.bypassMsecs))
+        return filterProc->flush(talkerCode, appId) + text;
+
+    QElapsedTimer timer;
+    timer.start();
+    QString output;
+    if (!text.isEmpty())
+        output = filterProc->feed(text, talkerCode, appId);
+    if (end)
+        output += filterProc->flush(talkerCode, appId);
+    const qint64 msecs = timer.elapsed();
+    const bool overran = breaker.budget > 0 && msecs > breaker.budget;
+    if (overran)
+        kWarning() << "FilterMgr::streamFilter: filter " << breaker.filterId << " took " << msecs
+                   << " ms, over its budget of " << breaker.budget << " ms.";
+    if (health->countRun(breaker.filterId, msecs, overran, filterProc->wasModified(), breaker.overrunLimit))
+        kWarning() << "FilterMgr::streamFilter: filter " << breaker.filterId << " overran "
+                   << breaker.overrunLimit << " times in a row.  Bypassing it for "
+                   << breaker.bypassMsecs / 1000 << " seconds.";
+    return output;
+}
+
 // Finishes up with current filter (if any) and goes on to the next filter.
 void FilterMgr::nextFilter()
 {
     ++m_filterIndex;
-    if (m_filterIndex == m_filterList.count())
+    if (m_filterIndex >= m_lastFilter)
     {
         m_state = fsFinished;
         return;
     }
     m_filterProc = m_filterList.at(m_filterIndex);
-    m_text = m_filterProc->convert( m_text, m_talkerCode, m_appId );
-    if (m_filterProc->wasModified())
+    const Breaker& breaker = m_breakers.at(m_filterIndex);
+    FilterHealth* health = FilterHealth::instance();
+    const Prefilter& prefilter = m_prefilters.at(m_filterIndex);
+    if (prefilter.known && !containsAny(m_text, prefilter.bits, prefilter.low, prefilter.high))
+    {
+        // The filter would hand back the text as it is.
+        health->countSkipped(breaker.filterId);
+        return;
+    }
+    if (!health->admit(breaker.filterId, breaker.overrunLimit, breaker.bypassMsecs))
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+    QString output;
+    bool inBudget = runFilter(breaker.budget, &output);
+    const qint64 msecs = timer.elapsed();
+    if (breaker.budget > 0 && msecs > breaker.budget)
+        inBudget = false;
+
+    if (!inBudget)
+    {
+        // The text goes on as it was.
+        kWarning() << "FilterMgr::nextFilter: filter " << breaker.filterId << " took " << msecs
+                   << " ms, over its budget of " << breaker.budget << " ms.  Skipped it.";
+        if (health->countRun(breaker.filterId, msecs, true, false, breaker.overrunLimit))
+            kWarning() << "FilterMgr::nextFilter: filter " << breaker.filterId << " overran "
+                       << breaker.overrunLimit << " times in a row.  Bypassing it for "
+                       << breaker.bypassMsecs / 1000 << " seconds.";
+        return;
+    }
+    // A filter that does nothing hands back the same text, so this is cheap.
+    m_text = output;
+    const bool modified = m_filterProc->wasModified();
+    health->countRun(breaker.filterId, msecs, false, modified, breaker.overrunLimit);
+    if (modified)
         kDebug() << "FilterMgr::nextFilter: Filter# " << m_filterIndex << " modified the text.";
 }
 
+// Runs the current filter on m_text.  A filter that can convert
+// asynchronously is stopped when the budget runs out; others cannot be
+// interrupted, and the caller checks how long they took.
+bool FilterMgr::runFilter(int budget, QString* output)
+{
+    if (budget <= 0 || !m_filterProc->supportsAsync())
+    {
+        *output = m_filterProc->convert( m_text, m_talkerCode, m_appId );
+        return true;
+    }
+    if (!m_filterProc->asyncConvert( m_text, m_talkerCode, m_appId ))
+    {
+        // Nothing for the filter to do.
+        *output = m_text;
+        return true;
+    }
+    if (!m_filterProc->waitForFinished( budget ))
+    {
+        m_filterProc->stopFiltering();
+        return false;
+    }
+    *output = m_filterProc->getOutput();
+    m_filterProc->ackFinished();
+    return true;
+}
+
 // Loads the processing plug in for a filter plug in given its DesktopEntryName.
 KttsFilterProc* FilterMgr::loadFilterPlugin(const QString& desktopEntryName)
 {
@@ -213,21 +636,64 @@ KttsFilterProc* FilterMgr::loadFilterPlugin(const QString& desktopEntryName)
     return NULL;
 }
 
-/**
- * Uses KTrader to convert a translated Filter Plugin Name to DesktopEntryName.
- * @param name                   The translated plugin name.  From Name= line in .desktop file.
- * @return                       DesktopEntryName.  The name of the .desktop file (less .desktop).
- *                               QString() if not found.
- */
-QString FilterMgr::FilterNameToDesktopEntryName(const QString& name)
+
+FilterMgrPool::FilterMgrPool(int size) :
+    m_size(size > 0 ? size : qMax(1, QThread::idealThreadCount()))
 {
-    if (name.isEmpty()) return QString();
-    KService::List offers = KServiceTypeTrader::self()->query(QLatin1String( "Jovie/FilterPlugin" ),
-    QString(QLatin1String( "Name == '%1'" )).arg(name));
+    for (int i = 0; i < m_size; ++i)
+        m_all.append(new FilterMgr());
+    m_free = m_all;
+}
 
-    if (offers.count() == 1)
-        return offers[0]->desktopEntryName();
-    else
-        return QString();
+FilterMgrPool::~FilterMgrPool()
+{
+    qDeleteAll(m_all);
+}
+
+void FilterMgrPool::init()
+{
+    // A new generation takes the place of the old one.  Free members of the
+    // old one go now, leased ones when they come back; nobody waits.
+    QList<FilterMgr*> generation;
+    for (int i = 0; i < m_size; ++i)
+    {
+        FilterMgr* filterMgr = new FilterMgr();
+        filterMgr->init();
+        generation.append(filterMgr);
+    }
+    QList<FilterMgr*> retired;
+    {
+        QMutexLocker locker(&m_mutex);
+        retired = m_free;
+        m_all = generation;
+        m_free = generation;
+        m_released.wakeAll();
+    }
+    qDeleteAll(retired);
 }
 
+FilterMgr* FilterMgrPool::acquire()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_free.isEmpty())
+        m_released.wait(&m_mutex);
+    return m_free.takeLast();
+}
+
+void FilterMgrPool::release(FilterMgr* filterMgr)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_all.contains(filterMgr))
+    {
+        // Retired by init() while leased.  It belongs to the main thread.
+        filterMgr->deleteLater();
+        return;
+    }
+    m_free.append(filterMgr);
+    m_released.wakeAll();
+}
+
+int FilterMgrPool::size() const
+{
+    return m_size;
+}
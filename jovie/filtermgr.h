@@ -28,21 +28,127 @@
 #define FILTERMGR_H
 
 // Qt includes.
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
 #include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
 
 // KTTS includes.
 #include "filterproc.h"
+#include "configdata.h"
+#include "talkerclassifier.h"
 
 class TalkerCode;
 
 typedef QList<KttsFilterProc*> FilterList;
 
+/**
+ * How often a filter was run by @ref FilterMgr::convert, how often it left
+ * the text as it was, how often it was not needed, and how often it took
+ * longer than its latency budget.
+ */
+struct FilterStats
+{
+    FilterStats() : runs(0), unchanged(0), skipped(0), overruns(0), trips(0), bypassed(0),
+        totalMsecs(0), maxMsecs(0) { }
+    QString filterId;                   /* Filter ID from kttsdrc. */
+    qint64 runs;                        /* Calls to convert. */
+    qint64 unchanged;                   /* Calls that did not modify the text. */
+    qint64 skipped;                     /* Texts without any of the filter's first characters. */
+    qint64 overruns;                    /* Calls over budget, whose output was dropped. */
+    qint64 trips;                       /* Times the filter was bypassed after overruns. */
+    qint64 bypassed;                    /* Texts passed on without calling the filter. */
+    qint64 totalMsecs;                  /* Time spent in the filter. */
+    qint64 maxMsecs;                    /* Longest call. */
+};
+
+/**
+ * @class FilterHealth
+ *
+ * Statistics and circuit breaker state of the filters, by filter ID, shared
+ * by every FilterMgr: the main thread's and those of the pool.  A filter
+ * that keeps overrunning its budget is bypassed by all of them at once, and
+ * the statistics count the texts of all of them.  Counting starts over with
+ * each ConfigData snapshot.  All methods are thread safe.
+ */
+class FilterHealth
+{
+    public:
+        /**
+         * Returns the one instance.
+         */
+        static FilterHealth* instance();
+
+        /**
+         * Logs the statistics and starts over if @p configData is not the
+         * snapshot counted for so far.
+         */
+        void setConfig(const ConfigDataPtr& configData);
+
+        /**
+         * Returns False, and counts the text as bypassed, while the breaker
+         * of a filter is open.  Once it has been open for @p bypassMsecs it
+         * closes, and one more overrun opens it again.
+         */
+        bool admit(const QString& filterId, int overrunLimit, int bypassMsecs);
+
+        /**
+         * Counts a text the filter was not needed for.
+         */
+        void countSkipped(const QString& filterId);
+
+        /**
+         * Counts a call of a filter.
+         * @param overran           True if the call was over budget.
+         * @param modified          True if the filter changed the text.
+         * @return                  True if this overrun opened the breaker.
+         */
+        bool countRun(const QString& filterId, qint64 msecs, bool overran, bool modified, int overrunLimit);
+
+        /**
+         * Returns the statistics of some filters, in the order given.
+         */
+        QList<FilterStats> stats(const QStringList& filterIds) const;
+
+    private:
+        struct Entry
+        {
+            Entry() : overruns(0) { opened.invalidate(); }
+            FilterStats stats;
+            int overruns;               // Overruns in a row so far.
+            QElapsedTimer opened;       // Valid while the breaker is open.
+        };
+
+        // Returns the entry of a filter.  m_mutex must be held.
+        Entry& entry(const QString& filterId);
+
+        mutable QMutex m_mutex;
+        ConfigDataPtr m_configData;
+        QHash<QString, Entry> m_entries;
+};
+
 /**
  * @class FilterMgr
  *
  * Manager for filter objects. Loads and configures filters that have been
  * set up by the user as per the config file. Also filters text to bee spoken
  * by running it through all the configured filters.
+ *
+ * Each filter has a latency budget, LatencyBudget milliseconds in its
+ * kttsdrc group.  A filter that supports asynchronous conversion is given
+ * up on when its budget runs out; any other filter's output is dropped if
+ * it took too long.  Either way the text goes on to the next filter as it
+ * was.  After OverrunLimit overruns in a row the filter is bypassed
+ * altogether for BypassSeconds, and then tried again.  The overruns of all
+ * FilterMgr objects count; see @ref FilterHealth.  A streaming filter
+ * cannot be given up on in the middle of a piece, so in @ref feed and
+ * @ref flush an overrun only counts towards the bypass.
+ *
+ * A filter that can only change texts containing some characters, see
+ * @ref KttsFilterProc::firstChars, is not called for texts without any.
  */
 class FilterMgr : public KttsFilterProc
 {
@@ -65,9 +171,23 @@ class FilterMgr : public KttsFilterProc
          *
          * Note: The parameters are for reading from kttsdrc file.  Plugins may wish to maintain
          * separate configuration files of their own.
+         *
+         * The current @ref ConfigData snapshot is taken here; the filters
+         * keep using it until the next call.  Must be called from the main thread.
+         *
+         * The filter plugins themselves are not loaded here.  They are loaded by
+         * @ref load, either ahead of time from a background thread or on the first
+         * call to @ref convert.
          */
         virtual bool init();
 
+        /**
+         * Loads and initializes the configured filter plugins if that has not
+         * been done yet.  Safe to call from a worker thread; the plugins are
+         * moved to the thread FilterMgr lives in.
+         */
+        void load();
+
         /** 
          * Synchronously convert text.
          * @param inputText         Input text.
@@ -80,23 +200,124 @@ class FilterMgr : public KttsFilterProc
          */
         virtual QString convert(const QString& inputText, TalkerCode* talkerCode, const QString& appId);
 
+        /**
+         * Chooses the talker for a text by the rules of all talker chooser
+         * filters.  @ref convert does this before running the other filters.
+         * @return                  True if a rule matched.  @p talkerCode is
+         *                          only changed then.
+         */
+        bool chooseTalker(const QString& text, TalkerCode* talkerCode, const QString& appId);
+
+        /**
+         * Runs a text through some of the filters only.  The talker is not
+         * chosen; @see chooseTalker.
+         * @param first             Index of the first filter to run.
+         * @param last              Index after the last filter to run.
+         * @see convert
+         */
+        QString convert(const QString& inputText, int first, int last, TalkerCode* talkerCode, const QString& appId);
+
+        /**
+         * Returns the number of loaded filters.  Loads the filters.
+         */
+        int filterCount();
+
+        /**
+         * Returns True if filter number @p index supports splitting.
+         * @see KttsFilterProc::supportsSplitting
+         */
+        bool filterSupportsSplitting(int index);
+
+        /**
+         * Returns run, no-op, skip and overrun counts of each loaded filter,
+         * in filter order, since the configuration was last reloaded.  The
+         * counts are those of all FilterMgr objects; see @ref FilterHealth.
+         */
+        QList<FilterStats> stats() const;
+
+        /**
+         * Returns True if every loaded filter supports streaming, so that
+         * @ref feed and @ref flush run in constant memory.  Loads the filters.
+         */
+        virtual bool supportsStreaming();
+
+        /**
+         * Returns the number of characters the whole filter chain may hold back.
+         */
+        virtual int holdback();
+
+        /**
+         * Runs the next piece of a stream through the filters.  Each filter's
+         * output goes straight on to the next filter, so nothing accumulates
+         * between them.  If any filter does not support streaming, the text is
+         * collected and converted as a whole by @ref flush.
+         * @return                  Filtered text that is ready.
+         */
+        virtual QString feed(const QString& chunk, TalkerCode* talkerCode, const QString& appId);
+
+        /**
+         * Ends a stream, flushing each filter into the next.
+         * @return                  Filtered text the filters were holding back.
+         */
+        virtual QString flush(TalkerCode* talkerCode, const QString& appId);
+
     private:
         // Loads the processing plug in for a named filter plug in.
         KttsFilterProc* loadFilterPlugin(const QString& plugInName);
         // Finishes up with current filter (if any) and goes on to the next filter.
         void nextFilter();
-        // Uses KTrader to convert a translated Filter Plugin Name to DesktopEntryName.
-        // @param name                   The translated plugin name.  From Name= line in .desktop file.
-        // @return                       DesktopEntryName.  The name of the .desktop file (less .desktop).
-        //                               QString() if not found.
-        QString FilterNameToDesktopEntryName(const QString& name);
+        // Runs the current filter within its budget.  Returns False if it overran.
+        bool runFilter(int budget, QString* output);
+        // Runs a piece of a stream through one filter under its breaker.
+        QString streamFilter(int index, const QString& text, bool end, TalkerCode* talkerCode, const QString& appId);
+
+        // Latency budget and circuit breaker settings of a filter.  The
+        // breaker itself is in FilterHealth.
+        struct Breaker
+        {
+            QString filterId;           // Filter ID from kttsdrc.
+            int budget;                 // Milliseconds, or 0 for no limit.
+            int overrunLimit;           // Overruns in a row that open the breaker.
+            int bypassMsecs;            // How long the breaker stays open.
+        };
 
+        // Characters a filter needs to find in a text before it can change it.
+        struct Prefilter
+        {
+            bool known;                 // False if the filter may change any text.
+            QVector<quint32> bits;      // One bit per character, up to the highest.
+            ushort low;                 // Lowest character with a bit set.
+            ushort high;                // Highest character with a bit set.
+        };
+
+        // Configuration the filters are loaded from.
+        ConfigDataPtr m_configData;
         // List of filters.
         FilterList m_filterList;
+        // Rules of the talker chooser filters, which are not in m_filterList.
+        TalkerClassifier m_classifier;
+        // Tail of the stream so far, so rules matching across pieces are found.
+        QString m_streamContext;
+        // True once the talker has been chosen for the current stream.
+        bool m_streamChosen;
+        // That talker.
+        TalkerCode m_streamTalker;
+        // Breaker of each filter in m_filterList.
+        QList<Breaker> m_breakers;
+        // Prefilter of each filter in m_filterList.
+        QList<Prefilter> m_prefilters;
+        // True once the filter plugins have been loaded.
+        bool m_loaded;
+        // Serializes loading against the first convert().
+        QMutex m_loadMutex;
         // Text being filtered.
         QString m_text;
+        // Stream text collected for a filter chain that cannot stream.
+        QString m_streamText;
         // Index to list of filters.
         int m_filterIndex;
+        // Index after the last filter to run.
+        int m_lastFilter;
         // Current filter.
         KttsFilterProc* m_filterProc;
         // Talker Code.
@@ -107,4 +328,85 @@ class FilterMgr : public KttsFilterProc
         int m_state;
 };
 
+/**
+ * @class FilterMgrPool
+ *
+ * A fixed set of FilterMgr objects, one per core, that jobs filtered in the
+ * background lease one at a time.  A FilterMgr keeps the state of the text
+ * it is filtering, so each concurrent job needs one of its own.  All of them
+ * are set up from the same @ref ConfigData snapshot; each loads its own
+ * filter plugins the first time it is used.  Compiled regular expressions
+ * are shared between them; see @ref FilterRegExp.
+ *
+ * A new snapshot is taken by a new generation of FilterMgr objects.  Those
+ * of the old generation that are leased finish their text and are deleted
+ * when they are returned.
+ */
+class FilterMgrPool
+{
+    public:
+        /**
+         * Constructor.
+         * @param size              Number of FilterMgr objects.  If 0, the
+         *                          number of cores.
+         */
+        explicit FilterMgrPool(int size = 0);
+
+        /**
+         * Destructor.  No FilterMgr may be leased.
+         */
+        ~FilterMgrPool();
+
+        /**
+         * Replaces all FilterMgr objects with new ones that take a new
+         * configuration snapshot.  Does not wait for leased ones.  Must be
+         * called from the main thread.
+         */
+        void init();
+
+        /**
+         * Leases a FilterMgr, waiting until one is free.
+         */
+        FilterMgr* acquire();
+
+        /**
+         * Returns a FilterMgr leased with @ref acquire.  If it was replaced
+         * while leased, it is deleted.
+         */
+        void release(FilterMgr* filterMgr);
+
+        /**
+         * Number of FilterMgr objects in the pool.
+         */
+        int size() const;
+
+    private:
+        // Members in each generation.  Set once, so read without the lock.
+        const int m_size;
+        // The current generation.
+        QList<FilterMgr*> m_all;
+        // Members of the current generation not leased.
+        QList<FilterMgr*> m_free;
+        QMutex m_mutex;
+        QWaitCondition m_released;
+};
+
+/**
+ * Leases a FilterMgr from a pool for as long as it is in scope.
+ */
+class FilterMgrLease
+{
+    public:
+        explicit FilterMgrLease(FilterMgrPool* pool) :
+            m_pool(pool), m_filterMgr(pool->acquire()) { }
+        ~FilterMgrLease() { m_pool->release(m_filterMgr); }
+        FilterMgr* operator->() const { return m_filterMgr; }
+        FilterMgr* get() const { return m_filterMgr; }
+
+    private:
+        Q_DISABLE_COPY(FilterMgrLease)
+        FilterMgrPool* m_pool;
+        FilterMgr* m_filterMgr;
+};
+
 #endif      // FILTERMGR_H
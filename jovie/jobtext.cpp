@@ -0,0 +1,315 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Filtered text of a speech job, indexed by sentence.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#include "jobtext.h"
+
+// Qt includes.
+#include <QtCore/QList>
+#include <QtCore/QRegExp>
+#include <QtCore/QVector>
+
+// KDE includes.
+#include <kdebug.h>
+#include <ktemporaryfile.h>
+
+/**
+ * Blocks are closed and compressed once they hold this many bytes.
+ */
+static const int BlockSize = 32768;
+
+/**
+ * Compressed blocks beyond this many bytes, counting all jobs, are spilled
+ * to a temporary file.
+ */
+static const int MaxResidentBytes = 2 * 1024 * 1024;
+
+static int s_residentBytes = 0;
+
+// Number of bytes the UTF-8 encoding of a range of UTF-16 text takes.
+static int utf8Length(const QChar *begin, const QChar *end)
+{
+    int length = 0;
+    for (const QChar *c = begin; c < end; ++c)
+    {
+        const ushort u = c->unicode();
+        if (u < 0x80)
+            length += 1;
+        else if (u < 0x800)
+            length += 2;
+        else if (c->isHighSurrogate() && c + 1 < end && (c + 1)->isLowSurrogate())
+        {
+            length += 4;
+            ++c;
+        }
+        else
+            length += 3;
+    }
+    return length;
+}
+
+// Appends the UTF-8 encoding of a range of UTF-16 text, length bytes as
+// given by utf8Length().  Unlike QString::toUtf8() this writes straight
+// into the block, without a temporary array per sentence.
+static void appendUtf8(QByteArray &out, const QChar *begin, const QChar *end, int length)
+{
+    const int size = out.size();
+    out.resize(size + length);
+    char *p = out.data() + size;
+    for (const QChar *c = begin; c < end; ++c)
+    {
+        uint u = c->unicode();
+        if (u < 0x80)
+            *p++ = char(u);
+        else if (u < 0x800)
+        {
+            *p++ = char(0xc0 | (u >> 6));
+            *p++ = char(0x80 | (u & 0x3f));
+        }
+        else if (c->isHighSurrogate() && c + 1 < end && (c + 1)->isLowSurrogate())
+        {
+            u = QChar::surrogateToUcs4(ushort(u), (++c)->unicode());
+            *p++ = char(0xf0 | (u >> 18));
+            *p++ = char(0x80 | ((u >> 12) & 0x3f));
+            *p++ = char(0x80 | ((u >> 6) & 0x3f));
+            *p++ = char(0x80 | (u & 0x3f));
+        }
+        else
+        {
+            // Unpaired surrogates become U+FFFD, like QString::toUtf8().
+            if (c->isHighSurrogate() || c->isLowSurrogate())
+                u = QChar::ReplacementCharacter;
+            *p++ = char(0xe0 | (u >> 12));
+            *p++ = char(0x80 | ((u >> 6) & 0x3f));
+            *p++ = char(0x80 | (u & 0x3f));
+        }
+    }
+}
+
+class JobTextPrivate : public QSharedData
+{
+public:
+    JobTextPrivate() :
+        size(0),
+        cachedBlock(-1),
+        spillFile(0) {}
+
+    ~JobTextPrivate()
+    {
+        foreach (const Block &block, blocks)
+            s_residentBytes -= block.data.size();
+        delete spillFile;
+    }
+
+    struct Block
+    {
+        QByteArray data;                /* Compressed text, empty if spilled. */
+        qint64 spillOffset;             /* Position in the spill file. */
+        int spillSize;                  /* Compressed size in the spill file. */
+    };
+
+    // Compresses the open block and stores it, in memory or in the spill file.
+    void closeBlock()
+    {
+        if (open.isEmpty())
+            return;
+        Block block;
+        block.data = qCompress(open);
+        block.spillOffset = -1;
+        block.spillSize = 0;
+        open.clear();
+        if (s_residentBytes + block.data.size() > MaxResidentBytes && spill(block))
+            block.data.clear();
+        else
+            s_residentBytes += block.data.size();
+        blocks.append(block);
+    }
+
+    // Writes a block to the spill file.
+    bool spill(Block &block)
+    {
+        if (!spillFile)
+        {
+            spillFile = new KTemporaryFile();
+            spillFile->setPrefix(QLatin1String( "jovie-" ));
+            if (!spillFile->open())
+            {
+                kWarning() << "JobText: cannot create spill file";
+                delete spillFile;
+                spillFile = 0;
+                return false;
+            }
+        }
+        qint64 offset = spillFile->size();
+        if (!spillFile->seek(offset) || spillFile->write(block.data) != block.data.size())
+        {
+            kWarning() << "JobText: cannot write spill file " << spillFile->fileName();
+            return false;
+        }
+        block.spillOffset = offset;
+        block.spillSize = block.data.size();
+        return true;
+    }
+
+    // Appends a range of text as one sentence, trimmed.
+    void appendSentence(const QChar *begin, const QChar *end)
+    {
+        while (begin < end && begin->isSpace())
+            ++begin;
+        while (end > begin && (end - 1)->isSpace())
+            --end;
+        if (begin == end)
+            return;
+        // Blocks end on a sentence boundary.
+        const int length = utf8Length(begin, end);
+        if (!open.isEmpty() && open.size() + length > BlockSize)
+            closeBlock();
+        if (open.isEmpty())
+            open.reserve(BlockSize + 1);
+        blockOf.append(blocks.count());
+        offsets.append(open.size());
+        appendUtf8(open, begin, end, length);
+        // Terminate each sentence so it can go to speech-dispatcher in place.
+        open.append('\0');
+        size += length;
+    }
+
+    // Returns the decompressed text of a block.
+    const QByteArray &blockText(int blockNum)
+    {
+        if (blockNum == blocks.count())
+            return open;
+        if (blockNum != cachedBlock)
+        {
+            const Block &block = blocks.at(blockNum);
+            QByteArray data = block.data;
+            if (block.spillOffset >= 0)
+            {
+                if (spillFile->seek(block.spillOffset))
+                    data = spillFile->read(block.spillSize);
+                if (data.size() != block.spillSize)
+                    kWarning() << "JobText: cannot read spill file " << spillFile->fileName();
+            }
+            cachedText = qUncompress(data);
+            cachedBlock = blockNum;
+        }
+        return cachedText;
+    }
+
+    // Block of each sentence.  Sentences in the open block have
+    // blocks.count() here.
+    QVector<int> blockOf;
+    // Offset of each sentence in the text of its block.
+    QVector<int> offsets;
+    // Closed blocks.
+    QList<Block> blocks;
+    // Block still being filled.
+    QByteArray open;
+    // Size of all text before compression.
+    int size;
+    // Most recently decompressed block.
+    int cachedBlock;
+    QByteArray cachedText;
+    // Where blocks go under memory pressure.
+    KTemporaryFile *spillFile;
+};
+
+JobText::JobText()
+{
+}
+
+JobText::JobText(const JobText &other) :
+    d(other.d)
+{
+}
+
+JobText &JobText::operator=(const JobText &other)
+{
+    d = other.d;
+    return *this;
+}
+
+JobText::~JobText()
+{
+}
+
+void JobText::appendText(const QString& text, const QRegExp& delimiter)
+{
+    if (!d)
+        d = new JobTextPrivate;
+    // Sentences are encoded from the text in place, not copied out first.
+    const QChar *data = text.constData();
+    QRegExp rx(delimiter);
+    int start = 0;
+    int pos;
+    while ((pos = rx.indexIn(text, start)) != -1)
+    {
+        int end = pos + rx.matchedLength();
+        if (end == start)
+            break;
+        d->appendSentence(data + start, data + end);
+        start = end;
+    }
+    d->appendSentence(data + start, data + text.length());
+}
+
+void JobText::appendSentence(const QString& sentence)
+{
+    if (!d)
+        d = new JobTextPrivate;
+    d->appendSentence(sentence.constData(), sentence.constData() + sentence.length());
+}
+
+void JobText::squeeze()
+{
+    if (!d)
+        return;
+    d->closeBlock();
+    d->cachedBlock = -1;
+    d->cachedText.clear();
+}
+
+int JobText::sentenceCount() const
+{
+    return d ? d->blockOf.count() : 0;
+}
+
+QByteArray JobText::sentence(int sentenceNum) const
+{
+    return QByteArray(sentenceData(sentenceNum));
+}
+
+const char *JobText::sentenceData(int sentenceNum) const
+{
+    if (sentenceNum < 0 || sentenceNum >= sentenceCount())
+        return "";
+    const QByteArray &text = d->blockText(d->blockOf.at(sentenceNum));
+    if (text.isEmpty())
+        return "";
+    return text.constData() + d->offsets.at(sentenceNum);
+}
+
+int JobText::size() const
+{
+    return d ? d->size : 0;
+}
+
+int JobText::residentBytes()
+{
+    return s_residentBytes;
+}
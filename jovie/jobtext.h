@@ -0,0 +1,114 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Filtered text of a speech job, indexed by sentence.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef JOBTEXT_H
+#define JOBTEXT_H
+
+// Qt includes.
+#include <QtCore/QByteArray>
+#include <QtCore/QSharedData>
+#include <QtCore/QString>
+
+class QRegExp;
+class JobTextPrivate;
+
+/**
+ * @class JobText
+ *
+ * The filtered text of a job, UTF-8 encoded, along with the place where
+ * each sentence starts.  The text is encoded straight into the job's blocks
+ * and each sentence is NUL terminated there, so a sentence goes to
+ * speech-dispatcher without being copied.  Any sentence can be fetched without going through
+ * the ones before it, so speech can restart anywhere in the job without
+ * filtering it again.
+ *
+ * Sentences are packed into blocks of about 32 KiB, each block ending on a
+ * sentence boundary.  Full blocks are compressed.  Fetching a sentence
+ * decompresses its block, which is kept until a sentence from another block
+ * is needed.  Once the compressed blocks of all jobs together take more than
+ * 2 MiB, further blocks go to a temporary file instead of memory.
+ *
+ * Copies share the same text.  JobText is meant for the main thread only.
+ */
+class JobText
+{
+public:
+    JobText();
+    JobText(const JobText &other);
+    JobText &operator=(const JobText &other);
+    ~JobText();
+
+    /**
+     * Splits filtered text into sentences and appends them.  Whitespace
+     * around the sentences is dropped, as are empty sentences.
+     * @param text           Filtered text.
+     * @param delimiter      Sentence delimiter.  @see AppData::sentenceDelimiter
+     */
+    void appendText(const QString& text, const QRegExp& delimiter);
+
+    /**
+     * Appends text as a single sentence.
+     */
+    void appendSentence(const QString& sentence);
+
+    /**
+     * Compresses the block still being filled and drops the decompressed
+     * block.  Call when no more text is expected for a while.  Appending
+     * afterwards is fine.
+     */
+    void squeeze();
+
+    /**
+     * Number of sentences.
+     */
+    int sentenceCount() const;
+
+    /**
+     * Returns a sentence.
+     * @param sentenceNum    Sentence number, starting with 0.
+     * @return               The sentence, UTF-8 encoded, or an empty array if
+     *                       there is no such sentence.
+     */
+    QByteArray sentence(int sentenceNum) const;
+
+    /**
+     * Returns a sentence without copying it.
+     * @param sentenceNum    Sentence number, starting with 0.
+     * @return               The sentence, UTF-8 encoded and NUL terminated, or
+     *                       an empty string.  Points into the text of the job
+     *                       and stays valid until the next change to the text
+     *                       or the next sentence fetched from another block.
+     */
+    const char *sentenceData(int sentenceNum) const;
+
+    /**
+     * Size of the text in bytes, before compression.
+     */
+    int size() const;
+
+    /**
+     * Bytes of compressed text all jobs together keep in memory.
+     */
+    static int residentBytes();
+
+private:
+    QExplicitlySharedDataPointer<JobTextPrivate> d;
+};
+
+#endif      // JOBTEXT_H
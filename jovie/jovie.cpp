@@ -28,46 +28,69 @@
 
 #include <kspeech.h>
 
+// System includes.
+#include <limits.h>
+
 // Qt includes.
-#include <QtGui/QApplication>
-#include <QtGui/QClipboard>
+#include <QtCore/QCoreApplication>
 #include <QtCore/QTextStream>
 #include <QtCore/QTextCodec>
 #include <QtCore/QFile>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QProcess>
+#include <QtCore/QTimer>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QHash>
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusMessage>
+#ifndef JOVIE_HEADLESS
+#include <QtGui/QApplication>
+#include <QtGui/QClipboard>
+#endif
 
 // KDE includes.
 #include <kdebug.h>
 #include <kglobal.h>
-#include <kmessagebox.h>
 #include <klocale.h>
 #include <kcomponentdata.h>
-#include <kfiledialog.h>
-#include <KRun>
 #include <kaboutdata.h>
 
 
 // Jovie includes.
 #include "talkermgr.h"
 #include "talkercode.h"
+#include "configdata.h"
 // define spd_debug here to avoid a link error in speech-dispatcher 0.6.7's header file for now
 #define spd_debug spd_debug2
 #include "speaker.h"
+#include "utf8text.h"
+#include "socketserver.h"
+#ifndef JOVIE_HEADLESS
 #include "jovietrayicon.h"
+#else
+class JovieTrayIcon;
+#endif
 
 #include "kspeechadaptor.h"
+#include "jovieadaptor.h"
+#include "speechjobadaptor.h"
 
 /* JoviePrivate Class ================================================== */
 
 class JoviePrivate
 {
-    JoviePrivate()
+    JoviePrivate() :
+        trayIcon(0),
+        socketServer(0)
     {
-        trayIcon = new JovieTrayIcon();
     }
 
     ~JoviePrivate()
     {
+        delete socketServer;
+#ifndef JOVIE_HEADLESS
         delete trayIcon;
+#endif
     }
 
     friend class Jovie;
@@ -79,10 +102,25 @@ protected:
     QString callingAppId;
 
     /*
-    * The tray icon.
+    * The tray icon.  Created once the event loop is running.  Always 0 in
+    * the headless daemon.
     */
     JovieTrayIcon *trayIcon;
 
+    /*
+    * The local socket endpoint, if enabled.
+    */
+    SocketServer *socketServer;
+
+    /*
+    * A filterText, filterTexts or filterFile call waiting for its reply.
+    */
+    struct FilterRequest
+    {
+        QDBusMessage message;
+        bool single;
+    };
+    QHash<QFutureWatcher<QStringList>*, FilterRequest> filterRequests;
 };
 
 /* Jovie Class ========================================================= */
@@ -243,35 +281,95 @@ int Jovie::say(const QString &text, int options) {
     return speaker->say(speaker->getAppData(callingAppId())->applicationName(), text, options);
 }
 
+/**
+ * Reads a text file in the given encoding, or UTF-8 if it is valid UTF-8 and
+ * the locale's encoding if not.  UTF-8 is decoded straight from the mapped
+ * file.  Returns false if the file cannot be read.
+ */
+static bool readTextFile(const QString &filename, const QString &encoding, QString &text)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QTextCodec* codec = 0;
+    if (!encoding.isEmpty())
+        codec = QTextCodec::codecForName(encoding.toLatin1());
+    const bool utf8 = !codec || codec->mibEnum() == 106;
+    const qint64 size = file.size();
+    uchar* map = (utf8 && size > 0 && size <= INT_MAX) ? file.map(0, size) : 0;
+    const char* data = reinterpret_cast<const char*>(map);
+    if (map && isValidUtf8(data, size))
+        text = QString::fromUtf8(data, int(size));
+    else
+    {
+        QTextStream stream(&file);
+        if (codec) stream.setCodec(codec);
+        text = stream.readAll();
+    }
+    if (map)
+        file.unmap(map);
+    return true;
+}
+
 int Jovie::sayFile(const QString &filename, const QString &encoding)
 {
     // kDebug() << "Jovie::setFile: Running";
-    QFile file(filename);
+    QSharedPointer<QFile> file(new QFile(filename));
     int jobNum = 0;
-    if ( file.open(QIODevice::ReadOnly) )
+    if ( file->open(QIODevice::ReadOnly) )
     {
-        QTextStream stream(&file);
+        QTextCodec* codec = 0;
         if (!encoding.isEmpty())
+            codec = QTextCodec::codecForName(encoding.toLatin1());
+        // QTextStream is only needed for encodings other than UTF-8.
+        const bool utf8 = !codec || codec->mibEnum() == 106;
+        const qint64 size = file->size();
+        // UTF-8 is decoded by a worker thread, piece by piece, while the job
+        // is filtered.  Only a file that cannot shrink meanwhile may stay
+        // mapped that long; see isSealedFile().  The mapping goes away with
+        // the QFile, once the speaker is done with the text.
+        if (utf8 && size > 0 && size <= INT_MAX && isSealedFile(file->handle()))
         {
-            QTextCodec* codec = QTextCodec::codecForName(encoding.toLatin1());
-            if (codec) stream.setCodec(codec);
+            uchar* map = file->map(0, size);
+            const char* data = reinterpret_cast<const char*>(map);
+            if (map && isValidUtf8(data, size))
+            {
+                file->close();
+                return Speaker::Instance()->sayUtf8(callingAppId(),
+                    QByteArray::fromRawData(data, int(size)), 0, file);
+            }
+            if (map)
+                file->unmap(map);
         }
+        // Anything else is read into memory before the speaker sees it.
+        QByteArray bytes = file->readAll();
+        file->close();
+        if (utf8 && isValidUtf8(bytes.constData(), bytes.size()))
+            return Speaker::Instance()->sayUtf8(callingAppId(), bytes, 0);
+        if (utf8)
+            kDebug() << "Jovie::sayFile: " << filename << " is not UTF-8";
+        QTextStream stream(&bytes, QIODevice::ReadOnly);
+        if (codec) stream.setCodec(codec);
         jobNum = Speaker::Instance()->say(callingAppId(), stream.readAll(), 0);
-        file.close();
     }
     return jobNum;
 }
 
 int Jovie::sayClipboard()
 {
+#ifdef JOVIE_HEADLESS
+    kDebug() << "Jovie::sayClipboard: no clipboard in the headless daemon";
+    return 0;
+#else
     // Get the clipboard object.
-    QClipboard *cb = qApp->clipboard();
+    QClipboard *cb = QApplication::clipboard();
 
     // Copy text from the clipboard.
     QString text = cb->text();
 
     // Speak it.
     return Speaker::Instance()->say(callingAppId(), text, 0);
+#endif
 }
 
 QStringList Jovie::outputModules()
@@ -391,14 +489,12 @@ void Jovie::removeAllJobs()
 
 int Jovie::getSentenceCount(int jobNum)
 {
-    kDebug() << "not implemented in speech-dispatcher yet";
-    return 0;
+    return Speaker::Instance()->sentenceCount(applyDefaultJobNum(jobNum));
 }
 
 int Jovie::getCurrentJob()
 {
-    kDebug() << "not implemented in speech-dispatcher yet";
-    return 0;
+    return Speaker::Instance()->currentTextJob();
 }
 
 int Jovie::getJobCount(int priority)
@@ -415,8 +511,7 @@ QStringList Jovie::getJobNumbers(int priority)
 
 int Jovie::getJobState(int jobNum)
 {
-    kDebug() << "not implemented in speech-dispatcher yet";
-    return 0;
+    return Speaker::Instance()->jobState(applyDefaultJobNum(jobNum));
 }
 
 QByteArray Jovie::getJobInfo(int jobNum)
@@ -425,10 +520,106 @@ QByteArray Jovie::getJobInfo(int jobNum)
     return QByteArray();
 }
 
+int Jovie::openStream()
+{
+    return Speaker::Instance()->openStream(callingAppId());
+}
+
+bool Jovie::appendText(int jobNum, const QString &text)
+{
+    return Speaker::Instance()->appendText(jobNum, text);
+}
+
+void Jovie::closeStream(int jobNum)
+{
+    Speaker::Instance()->closeStream(jobNum);
+}
+
+int Jovie::registerTemplate(const QString &text)
+{
+    return Speaker::Instance()->registerTemplate(callingAppId(), text);
+}
+
+int Jovie::sayTemplate(int templateId, const QStringList &args, int sayOptions)
+{
+    return Speaker::Instance()->sayTemplate(callingAppId(), templateId, args, sayOptions);
+}
+
+bool Jovie::removeTemplate(int templateId)
+{
+    return Speaker::Instance()->removeTemplate(callingAppId(), templateId);
+}
+
+QString Jovie::filterText(const QString &text, const QString &appId, const QString &talker)
+{
+    return filterInBackground(QStringList(text), appId, talker, true).value(0);
+}
+
+QStringList Jovie::filterTexts(const QStringList &texts, const QString &appId, const QString &talker)
+{
+    return filterInBackground(texts, appId, talker, false);
+}
+
+QString Jovie::filterFile(const QString &filename, const QString &encoding, const QString &appId, const QString &talker)
+{
+    QString text;
+    if (!readTextFile(filename, encoding, text))
+    {
+        kDebug() << "Jovie::filterFile: cannot read " << filename;
+        return QString();
+    }
+    return filterInBackground(QStringList(text), appId, talker, true).value(0);
+}
+
+QStringList Jovie::filterInBackground(const QStringList &texts, const QString &appId, const QString &talker,
+    bool single)
+{
+    QFuture<QStringList> future = Speaker::Instance()->filterTexts(texts,
+        appId.isEmpty() ? callingAppId() : appId, talker);
+    if (!calledFromDBus())
+        return future.result();
+
+    // Long texts take a while; the main thread goes on meanwhile.
+    setDelayedReply(true);
+    QFutureWatcher<QStringList> *watcher = new QFutureWatcher<QStringList>(this);
+    JoviePrivate::FilterRequest request;
+    request.message = message();
+    request.single = single;
+    d->filterRequests.insert(watcher, request);
+    connect(watcher, SIGNAL(finished()), this, SLOT(slotTextsFiltered()));
+    watcher->setFuture(future);
+    return QStringList();
+}
+
+void Jovie::slotTextsFiltered()
+{
+    QFutureWatcher<QStringList> *watcher = static_cast<QFutureWatcher<QStringList>*>(sender());
+    const JoviePrivate::FilterRequest request = d->filterRequests.take(watcher);
+    const QStringList texts = watcher->result();
+    watcher->deleteLater();
+    const QVariant reply = request.single ? QVariant(texts.value(0)) : QVariant(texts);
+    QDBusConnection::sessionBus().send(request.message.createReply(reply));
+}
+
+QString Jovie::watchJob(int jobNum)
+{
+    jobNum = applyDefaultJobNum(jobNum);
+    SpeechJob *job = Speaker::Instance()->jobObject(jobNum);
+    if (!job)
+        return QString();
+    QString path = SpeechJobAdaptor::path(jobNum);
+    // Export each job once, on first request.
+    if (!job->findChild<SpeechJobAdaptor*>())
+    {
+        new SpeechJobAdaptor(job);
+        QDBusConnection::sessionBus().registerObject(path, job, QDBusConnection::ExportAdaptors);
+    }
+    return path;
+}
+
 QString Jovie::getJobSentence(int jobNum, int sentenceNum)
 {
-    kDebug() << "not implemented in speech-dispatcher yet";
-    return QString();
+    return Speaker::Instance()->jobSentence(applyDefaultJobNum(jobNum), sentenceNum);
 }
 
 QStringList Jovie::getTalkerCodes()
@@ -470,35 +661,40 @@ void Jovie::changeJobTalker(int jobNum, const QString &talker)
 
 void Jovie::moveJobLater(int jobNum)
 {
-    kDebug() << "not implemented in speech-dispatcher yet";
+    Speaker::Instance()->moveJobLater(applyDefaultJobNum(jobNum));
 }
 
 int Jovie::moveRelSentence(int jobNum, int n)
 {
-    kDebug() << "not implemented in speech-dispatcher yet";
-    return 0;
+    return Speaker::Instance()->moveRelSentence(applyDefaultJobNum(jobNum), n);
 }
 
 void Jovie::showManagerDialog()
 {
-    QString cmd = QLatin1String( "kcmshell4 kcmkttsd --caption " );
-    cmd += QLatin1Char( '\'' ) + i18n("KDE Text-to-Speech") + QLatin1Char( '\'' );
-    KRun::runCommand(cmd,NULL);
+    QStringList args;
+    args << QLatin1String( "kcmkttsd" ) << QLatin1String( "--caption" ) << i18n("KDE Text-to-Speech");
+    QProcess::startDetached(QLatin1String( "kcmshell4" ), args);
 }
 
 void Jovie::kttsdExit()
 {
     announceEvent(QLatin1String( "kttsdExit" ), QLatin1String( "kttsdExiting" ));
     emit kttsdExiting();
-    qApp->quit();
+    QCoreApplication::quit();
 }
 
 void Jovie::init()
 {
     new KSpeechAdaptor(this);
-    if (ready()) {
-        QDBusConnection::sessionBus().registerObject(QLatin1String( "/KSpeech" ), this, QDBusConnection::ExportAdaptors);
+    new JovieAdaptor(this);
+    // Register right away.  The speech-dispatcher connection and the filters
+    // come up in the background; jobs arriving before then are spooled.
+    QDBusConnection::sessionBus().registerObject(QLatin1String( "/KSpeech" ), this, QDBusConnection::ExportAdaptors);
+    if (!ready()) {
+        QDBusConnection::sessionBus().unregisterObject(QLatin1String( "/KSpeech" ));
+        return;
     }
+    QTimer::singleShot(0, this, SLOT(slotCreateTrayIcon()));
 }
 
 void Jovie::reinit()
@@ -507,13 +703,16 @@ void Jovie::reinit()
     kDebug() << "Jovie::reinit: Running";
     //if (Speaker::Instance()->isSpeaking())
     //    Speaker::Instance()->pause();
-    Speaker::Instance()->init();
+    // ready() publishes a fresh configuration snapshot and reinitializes the Speaker.
     QDBusConnection::sessionBus().unregisterObject(QLatin1String( "/KSpeech" ));
     if (ready()) {
         QDBusConnection::sessionBus().registerObject(QLatin1String( "/KSpeech" ), this, QDBusConnection::ExportAdaptors);
     }
 
-    d->trayIcon->slotUpdateTalkersMenu();
+#ifndef JOVIE_HEADLESS
+    if (d->trayIcon)
+        d->trayIcon->slotUpdateTalkersMenu();
+#endif
 }
 
 void Jovie::setCallingAppId(const QString& appId)
@@ -525,6 +724,7 @@ void Jovie::setCallingAppId(const QString& appId)
 
 bool Jovie::initializeConfigData()
 {
+    ConfigData::reload();
     return true;
 }
 
@@ -535,10 +735,13 @@ bool Jovie::ready()
     //    return true;
     //kDebug() << "Jovie::ready: Starting KTTSD service";
 //    if (!initializeSpeechData()) return false;
+    if (!initializeConfigData())
+        return false;
     if (!initializeTalkerMgr())
         return false;
     if (!initializeSpeaker())
         return false;
+    initializeSocketServer();
     announceEvent(QLatin1String( "ready" ), QLatin1String( "kttsdStarted" ));
     emit kttsdStarted();
     return true;
@@ -551,7 +754,7 @@ bool Jovie::initializeSpeechData()
 
 bool Jovie::initializeTalkerMgr()
 {
-    TalkerMgr::Instance()->loadTalkers(KGlobal::config().data());
+    TalkerMgr::Instance()->loadTalkers(ConfigData::current());
     return true;
 }
 
@@ -561,12 +764,37 @@ bool Jovie::initializeSpeaker()
 
     Speaker::Instance()->init();
 
+    // Job signals come from the per-job objects.  Broadcasting them from
+    // /KSpeech as well wakes up every client, so it is opt-in.
+    disconnect(Speaker::Instance(), SIGNAL(jobStateChanged(QString,int,KSpeech::JobState)),
+        this, SLOT(slotJobStateChanged(QString,int,KSpeech::JobState)));
+    if (ConfigData::current()->broadcastJobSignals)
+        connect(Speaker::Instance(), SIGNAL(jobStateChanged(QString,int,KSpeech::JobState)),
+            this, SLOT(slotJobStateChanged(QString,int,KSpeech::JobState)));
+
     // Establish ourself as a System Manager application.
     Speaker::Instance()->getAppData(QLatin1String( "jovie" ))->setIsSystemManager(true);
 
     return true;
 }
 
+bool Jovie::initializeSocketServer()
+{
+    ConfigDataPtr config = ConfigData::current();
+    if (!config->socketEnabled)
+    {
+        delete d->socketServer;
+        d->socketServer = 0;
+        return true;
+    }
+    if (!d->socketServer)
+        d->socketServer = new SocketServer();
+    // Keep serving as long as the configured path has not changed.
+    if (!d->socketServer->path().isEmpty() &&
+        (config->socketPath.isEmpty() || config->socketPath == d->socketServer->path()))
+        return true;
+    return d->socketServer->listen(config->socketPath);
+}
 
 void Jovie::slotJobStateChanged(const QString& appId, int jobNum, KSpeech::JobState state)
 {
@@ -585,6 +813,14 @@ void Jovie::slotFilteringFinished()
     //Speaker::Instance()->doUtterances();
 }
 
+void Jovie::slotCreateTrayIcon()
+{
+#ifndef JOVIE_HEADLESS
+    if (!d->trayIcon)
+        d->trayIcon = new JovieTrayIcon();
+#endif
+}
+
 QString Jovie::callingAppId()
 {
     // TODO: What would be nice is if there were a way to get the
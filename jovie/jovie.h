@@ -32,6 +32,7 @@
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtCore/QByteArray>
+#include <QtDBus/QDBusContext>
 
 #include <kspeech.h>
 
@@ -43,7 +44,7 @@ class TalkerCode;
 *
 * Note: Applications do not use this class directly.
 */
-class Jovie : public QObject
+class Jovie : public QObject, protected QDBusContext
 {
 Q_OBJECT
 public:
@@ -419,6 +420,106 @@ public Q_SLOTS: // METHODS
     */
     QByteArray getJobInfo(int jobNum);
 
+    /**
+    * Starts a job whose plain text is supplied piecewise with @ref appendText.
+    * Speaking starts with the first complete sentence.
+    * @return                   Job Number of the new job.
+    *
+    * The job is given the application's current defaultPriority.
+    */
+    int openStream();
+
+    /**
+    * Adds text to a job started with @ref openStream.  The text is split
+    * into sentences as it arrives, and each sentence is filtered and spoken
+    * as soon as it is complete.
+    * @param jobNum             Job Number returned by openStream.
+    * @param text               More text.  May end in the middle of a sentence.
+    * @return                   False if the stream is not open.
+    */
+    bool appendText(int jobNum, const QString &text);
+
+    /**
+    * Ends a job started with @ref openStream.  Any remaining text is spoken
+    * as the last sentence.
+    * @param jobNum             Job Number returned by openStream.
+    */
+    void closeStream(int jobNum);
+
+    /**
+    * Registers a message text that the application speaks often with
+    * different arguments, such as "New mail from %1: %2".
+    * @param text               The text, with placeholders %1 to %99.
+    * @return                   Template id, or 0 if the text is empty.
+    *
+    * The parts of the text between the placeholders are filtered once and
+    * cached; speaking the template filters only the arguments.
+    */
+    int registerTemplate(const QString &text);
+
+    /**
+    * Speaks a template registered with @ref registerTemplate.
+    * @param templateId         Template id.
+    * @param args               Arguments for the placeholders; %1 is the first.
+    * @param sayOptions         Option flags.  @see SayOptions.
+    * @return                   Job Number of the new job, or 0 if there is no
+    *                           such template.
+    */
+    int sayTemplate(int templateId, const QStringList &args, int sayOptions);
+
+    /**
+    * Forgets a template.  Templates are also forgotten when the application
+    * leaves the bus.
+    * @param templateId         Template id.
+    * @return                   False if there is no such template.
+    */
+    bool removeTemplate(int templateId);
+
+    /**
+    * Runs a text through the configured filters and returns the result,
+    * without speaking it.
+    * @param text               Text to filter.
+    * @param appId              Application id the filters should see, for
+    *                           filters that apply to some applications only.
+    *                           If empty, the caller's.
+    * @param talker             Talker code the filters should see.  If empty,
+    *                           the current talker.
+    * @return                   The filtered text.
+    */
+    QString filterText(const QString &text, const QString &appId, const QString &talker);
+
+    /**
+    * Same as @ref filterText for many texts in one call.  Each text is
+    * filtered on its own.
+    * @return                   The filtered texts, in the same order.
+    */
+    QStringList filterTexts(const QStringList &texts, const QString &appId, const QString &talker);
+
+    /**
+    * Same as @ref filterText for the contents of a file.
+    * @param filename           Name of the file.
+    * @param encoding           Encoding of the file.  If empty, UTF-8 or the
+    *                           locale's encoding.
+    * @return                   The filtered text, or an empty string if the
+    *                           file cannot be read.
+    */
+    QString filterFile(const QString &filename, const QString &encoding, const QString &appId, const QString &talker);
+
+    /**
+    * Exports a job as its own D-Bus object, so that the caller can listen to
+    * the signals of that job only.
+    * @param jobNum             Job Number.  If 0, the last job submitted by
+    *                           the application.
+    * @return                   Object path of the job, /org/kde/KSpeechJob_NN,
+    *                           or an empty string if the job has already ended.
+    *
+    * The object implements org.kde.KSpeechJob and is removed once the job is
+    * finished or deleted.
+    *
+    * @see SpeechJobAdaptor
+    */
+    QString watchJob(int jobNum);
+
     /**
     * Return a sentence of a job.
     * @param jobNum             Job Number.  If 0, the last job submitted by
@@ -580,6 +681,8 @@ private slots:
     void slotJobStateChanged(const QString& appId, int jobNum, KSpeech::JobState state);
     void slotMarker(const QString& appId, int jobNum, KSpeech::MarkerType markerType, const QString& markerData);
     void slotFilteringFinished();
+    void slotTextsFiltered();
+    void slotCreateTrayIcon();
 
 private:
     /**
@@ -587,6 +690,14 @@ private:
     */
     QString callingAppId();
 
+    /**
+    * Has the texts filtered on worker threads.  Called over D-Bus, the reply
+    * is sent by @ref slotTextsFiltered, with only the first text if
+    * @p single is True, and nothing is returned; otherwise waits for them.
+    */
+    QStringList filterInBackground(const QStringList &texts, const QString &appId, const QString &talker,
+        bool single);
+
     /*
     * Checks if KTTSD is ready to speak and at least one talker is configured.
     * If not, user is prompted to display the configuration dialog.
@@ -614,6 +725,11 @@ private:
     */
     bool initializeSpeaker();
 
+    /*
+    * Start, move or stop the local socket endpoint as configured.
+    */
+    bool initializeSocketServer();
+
     /*
     * If a job number is 0, returns the default job number for a command.
     * Returns the job number of the last job queued by the application, or if
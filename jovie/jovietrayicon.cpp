@@ -40,7 +40,6 @@
 #include <kaboutdata.h>
 #include <kaction.h>
 #include <kcmdlineargs.h>
-#include <kconfig.h>
 #include <kdebug.h>
 #include <kicon.h>
 #include <klocale.h>
@@ -54,6 +53,8 @@
 // libkttsd includes.
 #include <talkercode.h>
 
+#include "configdata.h"
+
 /* ------------------  JovieTrayIcon class ----------------------- */
 
 JovieTrayIcon::JovieTrayIcon(QWidget *parent)
@@ -133,11 +134,8 @@ JovieTrayIcon::~JovieTrayIcon()
 void JovieTrayIcon::slotUpdateTalkersMenu(){
     talkersMenu->clear();
     
-    // Object for the KTTSD configuration.
-    KConfig config(QLatin1String( "kttsdrc" ));
-
     // Load existing Talkers into Talker List.
-    TalkerCode::TalkerCodeList list = TalkerCode::loadTalkerCodesFromConfig(&config);
+    TalkerCode::TalkerCodeList list = ConfigData::current()->talkers;
 
     for (int i=0;i<list.size();i++) {
        TalkerCode talkerCode=list.at(i);
@@ -213,9 +211,12 @@ void JovieTrayIcon::resumeSelected()
 
 void JovieTrayIcon::repeatSelected()
 {
-    //int jobNum = m_kspeech->getCurrentJob();
-    //int seq = m_kspeech->moveRelSentence(jobNum, 0);
-    //m_kspeech->moveRelSentence(jobNum, -seq);
+    // Go back to the first sentence of the current text job.
+    int jobNum = Jovie::Instance()->getCurrentJob();
+    if (jobNum == 0)
+        return;
+    int seq = Jovie::Instance()->moveRelSentence(jobNum, 0);
+    Jovie::Instance()->moveRelSentence(jobNum, -seq);
 }
 
 void JovieTrayIcon::configureSelected()
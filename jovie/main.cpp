@@ -24,13 +24,20 @@
  ******************************************************************************/
 
 // KDE Includes.
+#ifdef JOVIE_HEADLESS
+#include <kcomponentdata.h>
+#else
 #include <kuniqueapplication.h>
+#include <kcrash.h>
+#endif
 #include <kaboutdata.h>
 #include <kcmdlineargs.h>
-#include <kcrash.h>
 #include <kdebug.h>
 #include <klocale.h>
 
+#ifdef JOVIE_HEADLESS
+#include <QtCore/QCoreApplication>
+#endif
 #include <QtDBus/QtDBus>
 
 // KTTSD includes.
@@ -52,6 +59,17 @@ int main (int argc, char *argv[]){
     aboutdata.setProgramIconName(QLatin1String( "preferences-desktop-text-to-speech" ));
 
     KCmdLineArgs::init( argc, argv, &aboutdata );
+#ifdef JOVIE_HEADLESS
+    // Accepted for compatibility with the KUniqueApplication build.  The
+    // headless daemon never forks.
+    KCmdLineOptions options;
+    options.add("nofork", ki18n("Do not run in the background."));
+    KCmdLineArgs::addCmdLineOptions(options);
+
+    QCoreApplication app(argc, argv);
+    KComponentData componentData(&aboutdata);
+    // Whether Jovie is already running is known once it claims its name.
+#else
     KUniqueApplication::addCmdLineOptions();
 
     //KUniqueApplication::setOrganizationDomain("kde.org");
@@ -64,25 +82,32 @@ int main (int argc, char *argv[]){
         return (0);
     }
 
-    if (QDBusConnection::sessionBus().interface()->registerService(QLatin1String( "org.kde.KSpeech" ))
-        != QDBusConnectionInterface::ServiceRegistered) {
-        kDebug() << "Could not register on KSpeech";
-    }
-
-    if (QDBusConnection::sessionBus().interface()->registerService(QLatin1String( "org.kde.kttsd" ))
-        != QDBusConnectionInterface::ServiceRegistered) {
-        kDebug() << "Could not register on kttsd";
-    }
-
     KCrash::setFlags(KCrash::AutoRestart);
 
     // This app is started automatically, no need for session management
     app.disableSessionManagement();
+#endif
 
     kDebug() << "main: Creating Jovie Service";
     Jovie* service = Jovie::Instance();
     service->init();
 
+    // Take the service names only once /KSpeech is there, so that the call
+    // that D-Bus activated us finds the object.  Of two instances started
+    // together, only one gets the name; the other leaves.
+    if (QDBusConnection::sessionBus().interface()->registerService(QLatin1String( "org.kde.KSpeech" ),
+            QDBusConnectionInterface::DontQueueService)
+        != QDBusConnectionInterface::ServiceRegistered) {
+        kDebug() << "Jovie is already running";
+        delete service;
+        return (0);
+    }
+
+    if (QDBusConnection::sessionBus().interface()->registerService(QLatin1String( "org.kde.kttsd" ))
+        != QDBusConnectionInterface::ServiceRegistered) {
+        kDebug() << "Could not register on kttsd";
+    }
+
     // kDebug() << "Entering event loop.";
     return app.exec();
     delete service;
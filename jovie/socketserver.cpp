@@ -0,0 +1,455 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Local socket endpoint for submitting speech jobs without D-Bus.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+// SocketServer includes.
+#include "socketserver.h"
+#include "socketserver.moc"
+
+// System includes.
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Qt includes.
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QtEndian>
+
+// KDE includes.
+#include <kdebug.h>
+#include <kstandarddirs.h>
+
+// KTTSD includes.
+#include "speaker.h"
+#include "utf8text.h"
+
+/**
+ * Largest frame accepted on the socket.  Bigger texts go through opSayFd.
+ */
+static const quint32 MaxFrameSize = 1024 * 1024;
+
+/**
+ * Largest text accepted through a file descriptor.
+ */
+static const qint64 MaxFdTextSize = 64 * 1024 * 1024;
+
+/**
+ * Most descriptors taken from one read.
+ */
+static const int MaxFdsPerRead = 8;
+
+/**
+ * Most request bytes buffered for one client: a frame of the largest size
+ * and one read beyond it.  A client sending more is dropped.
+ */
+static const int MaxClientInput = MaxFrameSize + 4 + 16384;
+
+/**
+ * Most descriptors buffered for one client before opSayFd requests use
+ * them.  A client sending more is dropped.
+ */
+static const int MaxClientFds = 16;
+
+/**
+ * Replies buffered for a client that does not read them.  Beyond this its
+ * requests are not read until it catches up.
+ */
+static const int MaxClientOutput = 65536;
+
+/**
+ * One connected client.
+ */
+class SocketClient
+{
+public:
+    SocketClient(int clientFd) :
+        fd(clientFd), readNotifier(0), writeNotifier(0) {}
+
+    int fd;
+    QString appId;
+    QByteArray input;                   /* Bytes of requests not handled yet. */
+    QByteArray output;                  /* Replies not written yet. */
+    QList<int> fds;                     /* Descriptors received, in order. */
+    QSocketNotifier *readNotifier;
+    QSocketNotifier *writeNotifier;
+};
+
+SocketServer::SocketServer(QObject *parent) :
+    QObject(parent),
+    m_fd(-1),
+    m_notifier(0)
+{
+}
+
+SocketServer::~SocketServer()
+{
+    close();
+}
+
+bool SocketServer::listen(const QString &path)
+{
+    close();
+
+    QString socketPath = path;
+    if (socketPath.isEmpty())
+        socketPath = KStandardDirs::locateLocal("socket", QLatin1String( "jovie" ));
+    QByteArray encodedPath = QFile::encodeName(socketPath);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (encodedPath.size() >= int(sizeof(addr.sun_path)))
+    {
+        kDebug() << "SocketServer::listen: socket path too long: " << socketPath;
+        return false;
+    }
+    strcpy(addr.sun_path, encodedPath.constData());
+
+    m_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_fd == -1)
+    {
+        kDebug() << "SocketServer::listen: socket() failed: " << strerror(errno);
+        return false;
+    }
+    fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+
+    // A socket left behind by an earlier run would make bind() fail.
+    ::unlink(encodedPath.constData());
+    mode_t oldMask = ::umask(0077);
+    int result = ::bind(m_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    ::umask(oldMask);
+    if (result == -1 || ::listen(m_fd, SOMAXCONN) == -1)
+    {
+        kDebug() << "SocketServer::listen: cannot listen on " << socketPath << ": " << strerror(errno);
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_path = socketPath;
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, SIGNAL(activated(int)), this, SLOT(slotNewConnection()));
+    kDebug() << "SocketServer::listen: listening on " << m_path;
+    return true;
+}
+
+void SocketServer::close()
+{
+    foreach (SocketClient *client, m_clients)
+        dropClient(client);
+    delete m_notifier;
+    m_notifier = 0;
+    if (m_fd != -1)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        ::unlink(QFile::encodeName(m_path).constData());
+    }
+    m_path.clear();
+}
+
+QString SocketServer::path() const
+{
+    return m_path;
+}
+
+void SocketServer::slotNewConnection()
+{
+    forever
+    {
+        int fd = ::accept(m_fd, 0, 0);
+        if (fd == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        SocketClient *client = new SocketClient(fd);
+#ifdef SO_PEERCRED
+        struct ucred cred;
+        socklen_t credLen = sizeof(cred);
+        if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == 0)
+            client->appId = QString::fromLatin1("unix:%1").arg(cred.pid);
+#endif
+        if (client->appId.isEmpty())
+            client->appId = QString::fromLatin1("unix:fd%1").arg(fd);
+
+        client->readNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(client->readNotifier, SIGNAL(activated(int)), this, SLOT(slotReadyRead(int)));
+        client->writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+        client->writeNotifier->setEnabled(false);
+        connect(client->writeNotifier, SIGNAL(activated(int)), this, SLOT(slotReadyWrite(int)));
+        m_clients.insert(fd, client);
+    }
+}
+
+void SocketServer::slotReadyRead(int fd)
+{
+    SocketClient *client = m_clients.value(fd);
+    if (!client)
+        return;
+
+    char buffer[16384];
+    char control[CMSG_SPACE(MaxFdsPerRead * sizeof(int))];
+    while (client->output.size() < MaxClientOutput)
+    {
+        struct iovec iov;
+        iov.iov_base = buffer;
+        iov.iov_len = sizeof(buffer);
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t count = ::recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (count <= 0)
+        {
+            dropClient(client);
+            return;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+            int fdCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *received = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            for (int ndx = 0; ndx < fdCount; ++ndx)
+                client->fds.append(received[ndx]);
+        }
+        client->input.append(buffer, count);
+        if (client->input.size() > MaxClientInput || client->fds.count() > MaxClientFds)
+        {
+            kDebug() << "SocketServer: " << client->appId << " sent more than it may buffer";
+            dropClient(client);
+            return;
+        }
+
+        // Handle what is complete, so only a partial frame stays buffered.
+        processRequests(client);
+        if (!m_clients.contains(fd))
+            return;
+    }
+    client->readNotifier->setEnabled(client->output.size() < MaxClientOutput);
+}
+
+void SocketServer::slotReadyWrite(int fd)
+{
+    SocketClient *client = m_clients.value(fd);
+    if (client)
+        flush(client);
+}
+
+void SocketServer::processRequests(SocketClient *client)
+{
+    int pos = 0;
+    const int fd = client->fd;
+    while (client->input.size() - pos >= 4)
+    {
+        const uchar *data = reinterpret_cast<const uchar*>(client->input.constData()) + pos;
+        quint32 length = qFromBigEndian<quint32>(data);
+        if (length < 5 || length > MaxFrameSize)
+        {
+            kDebug() << "SocketServer: bad frame length " << length << " from " << client->appId;
+            dropClient(client);
+            return;
+        }
+        if (quint32(client->input.size() - pos - 4) < length)
+            break;
+        quint8 opcode = data[4];
+        quint32 serial = qFromBigEndian<quint32>(data + 5);
+        QByteArray payload = client->input.mid(pos + 9, length - 5);
+        pos += 4 + length;
+        processRequest(client, opcode, serial, payload);
+        // Handling a request may end up dropping the client.
+        if (!m_clients.contains(fd))
+            return;
+    }
+    client->input.remove(0, pos);
+    flush(client);
+}
+
+void SocketServer::processRequest(SocketClient *client, quint8 opcode, quint32 serial, const QByteArray &payload)
+{
+    Speaker *speaker = Speaker::Instance();
+    const uchar *data = reinterpret_cast<const uchar*>(payload.constData());
+    quint8 status = stOk;
+    qint32 value = 0;
+
+    switch (opcode)
+    {
+        case opHello:
+            if (payload.isEmpty())
+                status = stBadRequest;
+            else
+                client->appId = QString::fromUtf8(payload.constData(), payload.size());
+            break;
+        case opSay:
+            if (payload.size() < 4)
+                status = stBadRequest;
+            else
+            {
+                qint32 options = qFromBigEndian<qint32>(data);
+                QString text = QString::fromUtf8(payload.constData() + 4, payload.size() - 4);
+                value = speaker->say(client->appId, text, options);
+                if (!value)
+                    status = stFailed;
+            }
+            break;
+        case opSayFd:
+            if (payload.size() < 4 || client->fds.isEmpty())
+                status = stBadRequest;
+            else
+            {
+                qint32 options = qFromBigEndian<qint32>(data);
+                int textFd = client->fds.takeFirst();
+                value = sayFromFd(client->appId, textFd, options);
+                ::close(textFd);
+                if (!value)
+                    status = stFailed;
+            }
+            break;
+        case opStop:
+            speaker->stop();
+            break;
+        case opCancel:
+            speaker->cancel();
+            break;
+        case opIsSpeaking:
+            value = speaker->isSpeaking() ? 1 : 0;
+            break;
+        case opJobState:
+            if (payload.size() < 4)
+                status = stBadRequest;
+            else
+                value = speaker->jobState(qFromBigEndian<qint32>(data));
+            break;
+        default:
+            status = stUnknownOpcode;
+            break;
+    }
+
+    uchar reply[13];
+    qToBigEndian<quint32>(9, reply);
+    reply[4] = status;
+    qToBigEndian<quint32>(serial, reply + 5);
+    qToBigEndian<qint32>(value, reply + 9);
+    client->output.append(reinterpret_cast<const char*>(reply), sizeof(reply));
+}
+
+int SocketServer::sayFromFd(const QString &appId, int fd, int sayOptions)
+{
+    struct stat st;
+    if (::fstat(fd, &st) == -1 || st.st_size <= 0 || st.st_size > MaxFdTextSize)
+        return 0;
+
+    // Only a memfd sealed against shrinking and writing can be mapped: the
+    // client could otherwise truncate it under the speaker, which then gets
+    // SIGBUS, or change the text while it is filtered.  Anything else is
+    // copied.
+    if (!isSealedFile(fd))
+    {
+        QByteArray text;
+        text.resize(int(st.st_size));
+        qint64 done = 0;
+        while (done < st.st_size)
+        {
+            ssize_t count = ::pread(fd, text.data() + done, st.st_size - done, done);
+            if (count == -1 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                break;
+            done += count;
+        }
+        if (done == 0)
+            return 0;
+        text.truncate(int(done));
+        return Speaker::Instance()->sayUtf8(appId, text, sayOptions);
+    }
+
+    // The mapping outlives the descriptor and goes away with the QFile, once
+    // the speaker is done with the text, which it decodes itself.
+    QSharedPointer<QFile> file(new QFile);
+    if (!file->open(fd, QIODevice::ReadOnly))
+        return 0;
+    uchar *map = file->map(0, st.st_size);
+    file->close();
+    if (!map)
+        return 0;
+    return Speaker::Instance()->sayUtf8(appId,
+        QByteArray::fromRawData(reinterpret_cast<const char*>(map), st.st_size), sayOptions, file);
+}
+
+void SocketServer::flush(SocketClient *client)
+{
+    while (!client->output.isEmpty())
+    {
+        ssize_t count = ::send(client->fd, client->output.constData(), client->output.size(), MSG_NOSIGNAL);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (count <= 0)
+        {
+            dropClient(client);
+            return;
+        }
+        client->output.remove(0, count);
+    }
+    client->writeNotifier->setEnabled(!client->output.isEmpty());
+    // Read requests again once the client caught up with the replies.
+    if (!client->readNotifier->isEnabled() && client->output.size() < MaxClientOutput)
+    {
+        client->readNotifier->setEnabled(true);
+        slotReadyRead(client->fd);
+    }
+}
+
+void SocketServer::dropClient(SocketClient *client)
+{
+    m_clients.remove(client->fd);
+    // We may be inside one of the notifiers' activated() signals.
+    client->readNotifier->setEnabled(false);
+    client->readNotifier->deleteLater();
+    client->writeNotifier->setEnabled(false);
+    client->writeNotifier->deleteLater();
+    foreach (int fd, client->fds)
+        ::close(fd);
+    ::close(client->fd);
+    // Same as an application leaving the bus.
+    Speaker::Instance()->getAppData(client->appId)->setUnregistered(true);
+    delete client;
+}
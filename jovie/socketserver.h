@@ -0,0 +1,142 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Local socket endpoint for submitting speech jobs without D-Bus.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef SOCKETSERVER_H
+#define SOCKETSERVER_H
+
+// Qt includes.
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+class QSocketNotifier;
+class SocketClient;
+
+/**
+ * @class SocketServer
+ *
+ * Serves a Unix domain socket for producers that submit many short jobs and
+ * cannot afford a session bus round trip for each.  Jobs go to the same
+ * Speaker and AppData as D-Bus calls.
+ *
+ * Every frame starts with a 32-bit big-endian length that counts the bytes
+ * after it.  A request is:
+ *
+ *   length, opcode (1 byte), serial (32 bits), payload
+ *
+ * and each request gets exactly one reply, in request order:
+ *
+ *   length (always 9), status (1 byte), serial (32 bits), value (32 bits)
+ *
+ * Clients may send any number of requests before reading the replies, but
+ * while too many replies wait to be read, further requests are not read.
+ * A client is dropped if it sends descriptors faster than its opSayFd
+ * requests use them.  All integers are big-endian; text is UTF-8.
+ *
+ * Requests:
+ * - opHello:      payload is the application id to use for this connection.
+ *                 Without it the connection is "unix:<pid>" of the peer.
+ * - opSay:        payload is the say options (32 bits) followed by the text.
+ *                 value is the job number.
+ * - opSayFd:      payload is the say options.  The text is read from a file
+ *                 descriptor, typically a memfd, sent with SCM_RIGHTS along
+ *                 with the frame.  value is the job number.  A memfd
+ *                 sealed with F_SEAL_SHRINK and F_SEAL_WRITE is mapped,
+ *                 anything else is copied.
+ * - opStop:       @see Speaker::stop.
+ * - opCancel:     @see Speaker::cancel.
+ * - opIsSpeaking: value is 1 if speaking, else 0.
+ * - opJobState:   payload is a job number.  value is its KSpeech::JobState,
+ *                 or -1 if there is no such job.
+ */
+class SocketServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Opcode {
+        opHello = 1,
+        opSay = 2,
+        opSayFd = 3,
+        opStop = 4,
+        opCancel = 5,
+        opIsSpeaking = 6,
+        opJobState = 7
+    };
+
+    enum Status {
+        stOk = 0,
+        stBadRequest = 1,
+        stUnknownOpcode = 2,
+        stFailed = 3
+    };
+
+    /**
+     * Constructor.
+     */
+    explicit SocketServer(QObject *parent = 0);
+
+    /**
+     * Destructor.  Closes all connections and removes the socket.
+     */
+    ~SocketServer();
+
+    /**
+     * Starts listening.
+     * @param path           Socket path.  If empty, "jovie" in the KDE
+     *                       socket directory.
+     * @return               False if the socket could not be set up.
+     */
+    bool listen(const QString &path = QString());
+
+    /**
+     * Stops listening and drops all connections.
+     */
+    void close();
+
+    /**
+     * The path of the socket, or an empty string if not listening.
+     */
+    QString path() const;
+
+private slots:
+    void slotNewConnection();
+    void slotReadyRead(int fd);
+    void slotReadyWrite(int fd);
+
+private:
+    // Handles all complete requests in the client's input buffer.
+    void processRequests(SocketClient *client);
+    // Handles one request and queues its reply.
+    void processRequest(SocketClient *client, quint8 opcode, quint32 serial, const QByteArray &payload);
+    // Speaks the text behind a descriptor sent by a client.  Returns the job
+    // number, or 0.
+    int sayFromFd(const QString &appId, int fd, int sayOptions);
+    // Writes as much of the pending output as the socket takes.
+    void flush(SocketClient *client);
+    // Closes a client connection.
+    void dropClient(SocketClient *client);
+
+    int m_fd;
+    QString m_path;
+    QSocketNotifier *m_notifier;
+    QHash<int, SocketClient*> m_clients;
+};
+
+#endif      // SOCKETSERVER_H
@@ -34,12 +34,18 @@
 // Qt includes.
 #include <QtCore/QFile>
 #include <QtCore/QDir>
-#include <QtGui/QApplication>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QTimer>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QtConcurrentRun>
+#include <QtCore/QtConcurrentMap>
+#include <QtCore/QThreadPool>
 #include <QtDBus/QtDBus>
 #include <QtXml/QDomDocument>
 
 // KDE includes.
-#include <kconfiggroup.h>
 #include <kdebug.h>
 #include <klocale.h>
 #include <kstandarddirs.h>
@@ -50,9 +56,13 @@
 
 // KTTS includes.
 #include "talkercode.h"
+#include "filterregexp.h"
 
 // KTTSD includes.
 //#include "talkermgr.h"
+#include "configdata.h"
+#include "jobtext.h"
+#include "utf8text.h"
 #include "ssmlconvert.h"
 
 
@@ -97,20 +107,311 @@
 */
 
 
+/**
+ * A job accepted while there is no usable connection to speech-dispatcher.
+ * It is held in the spool until the connection comes back.
+ */
+struct SpooledJob
+{
+    int jobNum;                         /* Job number given to the application. */
+    QString appId;                      /* DBUS senderId of the application. */
+    KSpeech::JobPriority priority;      /* Job priority. */
+    int sayOptions;                     /* Option flags.  @see SayOptions. */
+    QByteArray text;                    /* Filtered text, UTF-8 encoded. */
+    TalkerCode talker;                  /* Talker in effect when the job was accepted. */
+};
+
+/**
+ * A job that is spooled, held by speech-dispatcher or waiting its turn in
+ * the text queue.  Jobs are forgotten once they finish or are deleted.
+ *
+ * Plain text jobs of priority jpText are spoken by sentence: Jovie keeps
+ * their filtered text and hands speech-dispatcher one sentence at a time,
+ * so that it can move around in the job without filtering it again.
+ */
+struct LiveJob
+{
+    LiveJob() : priority(KSpeech::jpText), state(KSpeech::jsQueued), job(0),
+        messages(0), streaming(false), bySentence(false), sentenceNum(0),
+        sentenceMsgId(-1), sentenceBegun(false) {}
+    LiveJob(const QString &jobAppId, KSpeech::JobPriority jobPriority, KSpeech::JobState jobState) :
+        appId(jobAppId), priority(jobPriority), state(jobState), job(0),
+        messages(0), streaming(false), bySentence(false), sentenceNum(0),
+        sentenceMsgId(-1), sentenceBegun(false) {}
+    QString appId;                      /* DBUS senderId of the application. */
+    KSpeech::JobPriority priority;      /* Job priority. */
+    KSpeech::JobState state;            /* Current state. */
+    SpeechJob *job;                     /* Object for the job, once somebody asked for it. */
+    int messages;                       /* Messages with speech-dispatcher not ended yet. */
+    bool streaming;                     /* Open stream; more text may follow. */
+    bool bySentence;                    /* Spoken one sentence at a time from text. */
+    JobText text;                       /* Filtered text, if spoken by sentence. */
+    TalkerCode talker;                  /* Talker for the text. */
+    int sentenceNum;                    /* Sentence being spoken or next to speak, from 0. */
+    int sentenceMsgId;                  /* Message id of that sentence, or -1 if not sent. */
+    bool sentenceBegun;                 /* True once speech-dispatcher began speaking it. */
+};
+
+/**
+ * A message text registered once and spoken many times with different
+ * arguments.  The text is split at its placeholders %1 to %99; the static
+ * parts are filtered the first time the template is spoken and kept until
+ * the filters are reloaded.  Only the arguments are filtered on each use.
+ */
+struct MessageTemplate
+{
+    MessageTemplate() : talkerChosen(false) {}
+    QString appId;                      /* DBUS senderId of the application. */
+    QString text;                       /* Text as registered. */
+    QStringList parts;                  /* Static parts, one more than placeholders. */
+    QList<int> placeholders;            /* Argument number of each placeholder, from 1. */
+    QStringList filteredParts;          /* Filtered static parts, empty until first use. */
+    bool talkerChosen;                  /* True if filtering the static parts chose a talker. */
+    TalkerCode talker;                  /* That talker. */
+};
+
+/**
+ * A job accepted while the filters are still loading.  It waits in state
+ * jsFiltering, without holding up the event loop, until the load is done and
+ * Speaker::slotFiltersLoaded() filters and queues it.
+ */
+struct EarlyJob
+{
+    EarlyJob() : jobNum(0), sayOptions(KSpeech::soNone) {}
+    int jobNum;                         /* Job number handed out. */
+    QString appId;                      /* DBUS senderId of the application. */
+    QString text;                       /* Unfiltered text. */
+    int sayOptions;                     /* Say options of the job. */
+};
+
+/**
+ * Longest stretch of streamed text held back while waiting for a sentence
+ * delimiter.  Beyond this the text is spoken as it is.
+ */
+static const int MaxStreamHoldback = 4096;
+
+/**
+ * Plain texts longer than this are filtered by a worker thread, with a
+ * FilterMgr of their own from the pool.  When all filters support streaming
+ * they are filtered in pieces of StreamFilterChunk characters, so speech
+ * starts while the rest is still being filtered.
+ */
+static const int BackgroundFilterThreshold = 65536;
+static const int StreamFilterChunk = 16384;
+
+/**
+ * Texts longer than this are split at sentence boundaries into parts of about
+ * ParallelFilterChunk characters, and filters that support splitting run
+ * over the parts on all cores.
+ */
+static const int ParallelFilterThreshold = 262144;
+static const int ParallelFilterChunk = 32768;
+
+/**
+ * What @ref filterPiece carries from one piece of a text to the next.
+ */
+struct StreamState
+{
+    StreamState(const QString& appId, bool filtering, const QString& sentenceDelimiter, const TalkerCode& talkerCode) :
+        appId(appId),
+        filtering(filtering),
+        sentenceDelimiter(sentenceDelimiter),
+        talkerCode(talkerCode) { }
+    QString appId;
+    bool filtering;
+    QRegExp sentenceDelimiter;
+    TalkerCode talkerCode;
+    // Filtered text that does not end in a sentence delimiter yet.
+    QString pending;
+};
+
+/**
+ * A long text job being filtered by a worker thread with a FilterMgr leased
+ * from the pool.  The text is either a QString or UTF-8, possibly in a
+ * mapped file that is kept until the worker is done.
+ */
+struct BackgroundFilter
+{
+    BackgroundFilter(const StreamState& streamState) : state(streamState) { }
+    StreamState state;
+    QString text;
+    QByteArray utf8;
+    QSharedPointer<QFile> mapping;
+    QAtomicInt cancelled;               /* Set when the job is deleted. */
+    QFuture<void> future;
+};
+
+/**
+ * Runs a range of filters over one part of a split text, with a FilterMgr
+ * leased for just that part.  Used with QtConcurrent::mapped.
+ */
+struct PartFilter
+{
+    typedef QString result_type;
+    PartFilter(FilterMgrPool* pool, int first, int last, const TalkerCode& talkerCode, const QString& appId) :
+        pool(pool), first(first), last(last), talkerCode(talkerCode), appId(appId) { }
+    QString operator()(const QString& part) const
+    {
+        FilterMgrLease filterMgr(pool);
+        // Filters that support splitting do not change the talker.
+        TalkerCode partTalker = talkerCode;
+        return filterMgr->convert(part, first, last, &partTalker, appId);
+    }
+    FilterMgrPool* pool;
+    int first;
+    int last;
+    TalkerCode talkerCode;
+    QString appId;
+};
+
+/**
+ * Splits a text after the first sentence delimiter past every chunk
+ * characters.
+ */
+static QStringList splitAtSentences(const QString& text, const QRegExp& sentenceDelimiter, int chunk)
+{
+    QRegExp delimiter(sentenceDelimiter);
+    QStringList parts;
+    int pos = 0;
+    while (pos < text.length())
+    {
+        int end = text.length();
+        if (pos + chunk < text.length())
+        {
+            const int found = delimiter.indexIn(text, pos + chunk);
+            if (found != -1)
+                end = found + qMax(1, delimiter.matchedLength());
+        }
+        parts.append(text.mid(pos, end - pos));
+        pos = end;
+    }
+    return parts;
+}
+
+/**
+ * Filters one piece of a text and returns the whole sentences it completes.
+ * The rest is kept in @p state for the next piece.  May run in a worker
+ * thread.
+ */
+static QString filterPiece(FilterMgr* filterMgr, const QString& piece, bool last, StreamState& state)
+{
+    if (state.filtering)
+    {
+        state.pending += filterMgr->feed(piece, &state.talkerCode, state.appId);
+        if (last)
+            state.pending += filterMgr->flush(&state.talkerCode, state.appId);
+    }
+    else
+        state.pending += piece;
+
+    int cut = state.pending.length();
+    if (!last)
+    {
+        cut = 0;
+        int found;
+        while ((found = state.sentenceDelimiter.indexIn(state.pending, cut)) != -1)
+        {
+            const int end = found + state.sentenceDelimiter.matchedLength();
+            if (end == cut || end >= state.pending.length())
+                break;
+            cut = end;
+        }
+        if (cut == 0 && state.pending.length() > MaxStreamHoldback)
+            cut = state.pending.length();
+    }
+    const QString ready = state.pending.left(cut);
+    state.pending.remove(0, cut);
+    return ready;
+}
+
+/**
+ * A connection to speech-dispatcher opened off the main thread, along with
+ * the output modules it offers.
+ */
+struct SpeechdConnection
+{
+    SpeechdConnection() : connection(NULL) {}
+    SPDConnection *connection;
+    QStringList outputModules;
+};
+
+/**
+ * Opens and sets up a connection to speech-dispatcher.  Runs in a worker
+ * thread so that neither startup nor a reconnect blocks the event loop.
+ */
+static SpeechdConnection openSpeechdConnection()
+{
+    SpeechdConnection result;
+    SPDConnection *connection = spd_open("jovie", "main", NULL, SPD_MODE_THREADED);
+    if (connection != NULL)
+    {
+        kDebug() << "successfully opened connection to speech dispatcher";
+        connection->callback_begin = connection->callback_end =
+            connection->callback_cancel = connection->callback_pause =
+            connection->callback_resume = Speaker::speechdCallback;
+
+        spd_set_notification_on(connection, SPD_BEGIN);
+        spd_set_notification_on(connection, SPD_END);
+        spd_set_notification_on(connection, SPD_CANCEL);
+        spd_set_notification_on(connection, SPD_PAUSE);
+        spd_set_notification_on(connection, SPD_RESUME);
+        char ** modulenames = spd_list_modules(connection);
+        while (modulenames != NULL && modulenames[0] != NULL)
+        {
+            result.outputModules << QLatin1String( modulenames[0] );
+            modulenames++;
+            kDebug() << "added module " << result.outputModules.last();
+        }
+        result.connection = connection;
+    }
+    return result;
+}
+
+/**
+ * Maximum number of jobs held while speech-dispatcher is unreachable.
+ */
+static const int MaxSpooledJobs = 100;
+
+/**
+ * Reconnect backoff, in milliseconds.  The first retry is quick so that a
+ * restarting speech-dispatcher costs only a short pause.
+ */
+static const int MinReconnectDelay = 250;
+static const int MaxReconnectDelay = 30000;
+
+/**
+ * Delay, in milliseconds, before an interrupted text job is handed back to
+ * speech-dispatcher when the interruption did not come from Jovie.
+ */
+static const int ResumeDelay = 1000;
+
 class SpeakerPrivate
 {
     SpeakerPrivate(Speaker *parent) :
         connection(NULL),
         filterMgr(new FilterMgr()),
-        config(new KConfig(QLatin1String( "kttsdrc" ))),
-        q(parent)
+        q(parent),
+        lastJobNum(0),
+        lastTemplateId(0),
+        reconnectDelay(MinReconnectDelay),
+        filtersLoading(false),
+        filterReloadPending(false)
     {
-        filterMgr->init();
+        reconnectTimer.setSingleShot(true);
+        resumeTimer.setSingleShot(true);
     }
 
     ~SpeakerPrivate()
     {
-        spd_close(connection);
+        foreach (const QSharedPointer<BackgroundFilter>& filter, backgroundFilters)
+        {
+            filter->cancelled = 1;
+            filter->future.waitForFinished();
+        }
+        filterLoad.waitForFinished();
+        connectWatcher.waitForFinished();
+        if (connection)
+            spd_close(connection);
         connection = NULL;
 
         // from speechdata class
@@ -121,88 +422,247 @@ class SpeakerPrivate
         //allJobs.clear();
 
         delete filterMgr;
-        delete config;
 
         foreach (AppData* applicationData, appData)
             delete applicationData;
         appData.clear();
+
+        foreach (const LiveJob &job, liveJobs)
+            delete job.job;
+    }
+
+    /**
+    * Starts loading the filter plugins in a worker thread.
+    * Speaker::slotFiltersLoaded() runs when it is done.
+    */
+    void startFilterLoad()
+    {
+        filtersLoading = true;
+        filterMgr->init();
+        filterLoad = QtConcurrent::run(filterMgr, &FilterMgr::load);
+        filterLoadWatcher.setFuture(filterLoad);
     }
 
     friend class Speaker;
 
 protected:
 
-    bool ConnectToSpeechd()
+    // Start opening a connection in the background.  slotConnectFinished
+    // picks up the result.
+    void startConnect()
     {
-        bool retval = false;
-        connection = spd_open("jovie", "main", NULL, SPD_MODE_THREADED);
-        if (connection != NULL)
-        {
-            kDebug() << "successfully opened connection to speech dispatcher";
-            connection->callback_begin = connection->callback_end =
-                connection->callback_cancel = connection->callback_pause =
-                connection->callback_resume = Speaker::speechdCallback;
+        if (connectWatcher.isRunning())
+            return;
+        connectWatcher.setFuture(QtConcurrent::run(openSpeechdConnection));
+    }
 
-            spd_set_notification_on(connection, SPD_BEGIN);
-            spd_set_notification_on(connection, SPD_END);
-            spd_set_notification_on(connection, SPD_CANCEL);
-            spd_set_notification_on(connection, SPD_PAUSE);
-            spd_set_notification_on(connection, SPD_RESUME);
-            char ** modulenames = spd_list_modules(connection);
-            while (modulenames != NULL && modulenames[0] != NULL)
+    // Drop the connection after a failed call and start the reconnect cycle.
+    // Whatever speech-dispatcher was holding is gone with it.
+    void connectionLost()
+    {
+        kDebug() << "lost connection to speech dispatcher";
+        if (connection)
+            spd_close(connection);
+        connection = NULL;
+        forgetSpeechdJobs();
+        scheduleReconnect();
+    }
+
+    // Mark the jobs handed to speech-dispatcher as deleted.  Jobs spoken by
+    // sentence still have their text and send the sentence again later.
+    void forgetSpeechdJobs()
+    {
+        QList<int> jobNums = jobNumByMsgId.values();
+        jobNumByMsgId.clear();
+        staleMsgIds.clear();
+        foreach (int jobNum, jobNums)
+        {
+            QHash<int, LiveJob>::iterator it = liveJobs.find(jobNum);
+            if (it != liveJobs.end() && it->bySentence)
             {
-                outputModules << QLatin1String( modulenames[0] );
-                modulenames++;
-                kDebug() << "added module " << outputModules.last();
+                it->sentenceMsgId = -1;
+                it->sentenceBegun = false;
             }
+            else
+                setJobState(jobNum, KSpeech::jsDeleted);
+        }
+    }
 
-            readTalkerData();
+    // True if a job more important than text is spooled or being spoken.
+    bool hasInterruptingJobs() const
+    {
+        foreach (const LiveJob &job, liveJobs)
+        {
+            if (job.priority < KSpeech::jpText)
+                return true;
+        }
+        return false;
+    }
 
-            retval = true;
+    // Take back the sentence speech-dispatcher holds for a job.  It is stopped
+    // right away if it is being spoken, otherwise as soon as it begins.
+    void withdrawSentence(LiveJob &job)
+    {
+        if (job.sentenceMsgId == -1)
+            return;
+        jobNumByMsgId.remove(job.sentenceMsgId);
+        staleMsgIds.insert(job.sentenceMsgId);
+        if (job.sentenceBegun && connection)
+            spd_stop(connection);
+        job.sentenceMsgId = -1;
+        job.sentenceBegun = false;
+    }
+
+    // True if the spool holds any part of the job.
+    bool isSpooled(int jobNum) const
+    {
+        foreach (const SpooledJob &job, spool)
+        {
+            if (job.jobNum == jobNum)
+                return true;
         }
-        return retval;
+        return false;
     }
 
-    // try to reconnect to speech-dispatcher, return true on success
-    bool reconnect()
+    // A message of a job was handed to speech-dispatcher.
+    void messageSent(int msgId, int jobNum)
     {
-        spd_close(connection);
-        return ConnectToSpeechd();
+        jobNumByMsgId.insert(msgId, jobNum);
+        QHash<int, LiveJob>::iterator it = liveJobs.find(jobNum);
+        if (it != liveJobs.end())
+            ++it->messages;
     }
 
-    void readTalkerData()
+    // The job is finished once speech-dispatcher is done with all of its
+    // messages and no more can come.
+    void finishIfDone(int jobNum)
     {
-        config->reparseConfiguration();
-        // Iterate through list of the TalkerCode IDs.
-        KConfigGroup ttsconfig(config, "General");
-        QStringList talkerIDsList = ttsconfig.readEntry("TalkerIDs", QStringList());
-        // kDebug() << "TalkerListModel::loadTalkerCodesFromConfig: talkerIDsList = " << talkerIDsList;
-        if (!talkerIDsList.isEmpty())
+        QHash<int, LiveJob>::const_iterator it = liveJobs.constFind(jobNum);
+        if (it != liveJobs.constEnd() && !it->bySentence && it->messages <= 0 &&
+            !it->streaming && !isSpooled(jobNum))
+            setJobState(jobNum, KSpeech::jsFinished);
+    }
+
+    // Record a job state change and tell listeners about it.
+    void setJobState(int jobNum, KSpeech::JobState state)
+    {
+        QHash<int, LiveJob>::iterator it = liveJobs.find(jobNum);
+        if (it == liveJobs.end() || it->state == state)
+            return;
+        QString appId = it->appId;
+        SpeechJob *job = it->job;
+        const bool ended = state == KSpeech::jsFinished || state == KSpeech::jsDeleted;
+        const bool interrupting = it->priority < KSpeech::jpText;
+        if (ended)
         {
-            QStringList::ConstIterator itEnd = talkerIDsList.constEnd();
-            for (QStringList::ConstIterator it = talkerIDsList.constBegin(); it != itEnd; ++it)
+            if (it->bySentence)
             {
-                QString talkerID = *it;
-                kDebug() << "TalkerListWidget::loadTalkerCodes: talkerID = " << talkerID;
-                KConfigGroup talkGroup(config, "Talkers");
-                QString talkerCode = talkGroup.readEntry(talkerID);
-                TalkerCode tc = TalkerCode(talkerCode, true);
-                if (defaultTalker.name().isEmpty())
-                    defaultTalker = tc;
-                kDebug() << "TalkerCodeWidget::loadTalkerCodes: talkerCode = " << talkerCode;
-                //tc.setId(talkerID);
-                // do something with the talker codes read in
+                withdrawSentence(*it);
+                textQueue.removeAll(jobNum);
             }
-            currentTalker = defaultTalker;
+            if (backgroundFilters.contains(jobNum))
+                backgroundFilters.value(jobNum)->cancelled = 1;
+            liveJobs.erase(it);
+        }
+        else
+            it->state = state;
+        // Once the last job that could have interrupted text is done, an
+        // interrupted text job may go on.
+        if (ended && interrupting && !hasInterruptingJobs())
+            resumeTimer.start(0);
+        emit q->jobStateChanged(appId, jobNum, state);
+        if (job)
+        {
+            job->setState(state);
+            if (state == KSpeech::jsFinished || state == KSpeech::jsDeleted)
+                job->deleteLater();
+        }
+    }
 
-            q->setOutputModule(defaultTalker.outputModule());
-            q->setLanguage(defaultTalker.language());
-            q->setVoiceType(defaultTalker.voiceType());
-            q->setVolume(defaultTalker.volume());
-            q->setPitch(defaultTalker.pitch());
-            q->setSpeed(defaultTalker.rate());
-	    q->setPunctuationType(defaultTalker.punctuation());
+    // Arm the reconnect timer with the current backoff delay, doubling it
+    // for the next attempt.
+    void scheduleReconnect()
+    {
+        if (reconnectTimer.isActive() || connectWatcher.isRunning())
+            return;
+        kDebug() << "retrying speech dispatcher connection in " << reconnectDelay << " ms";
+        reconnectTimer.start(reconnectDelay);
+        reconnectDelay = qMin(reconnectDelay * 2, MaxReconnectDelay);
+    }
+
+    // Hand one job to speech-dispatcher.  Returns the message id or -1 on failure.
+    // The text is UTF-8 and NUL terminated; it is used in place.
+    int sayToSpeechd(SPDPriority spdpriority, int sayOptions, const char *text)
+    {
+        int msgId = -1;
+        switch (sayOptions)
+        {
+            case KSpeech::soNone: /**< No options specified.  Autodetected. */
+            case KSpeech::soPlainText: /**< The text contains plain text. */
+            case KSpeech::soHtml: /**< The text contains HTML markup. */
+                msgId = spd_say(connection, spdpriority, text);
+                break;
+            case KSpeech::soSsml: /**< The text contains SSML markup. */
+                spd_set_data_mode(connection, SPD_DATA_SSML);
+                msgId = spd_say(connection, spdpriority, text);
+                spd_set_data_mode(connection, SPD_DATA_TEXT);
+                break;
+            case KSpeech::soChar: /**< The text should be spoken as individual characters. */
+                spd_set_spelling(connection, SPD_SPELL_ON);
+                msgId = spd_say(connection, spdpriority, text);
+                spd_set_spelling(connection, SPD_SPELL_OFF);
+                break;
+            case KSpeech::soKey: /**< The text contains a keyboard symbolic key name. */
+                msgId = spd_key(connection, spdpriority, text);
+                break;
+            case KSpeech::soSoundIcon: /**< The text is the name of a sound icon. */
+                msgId = spd_sound_icon(connection, spdpriority, text);
+                break;
+        }
+        return msgId;
+    }
+
+    // Add a job to the spool.  When the spool is full the oldest job of the
+    // least important priority makes room, unless that job is more important
+    // than the new one, in which case the new job is refused.
+    bool spoolJob(const SpooledJob &job)
+    {
+        if (spool.count() >= MaxSpooledJobs)
+        {
+            int victim = -1;
+            for (int ndx = 0; ndx < spool.count(); ++ndx)
+            {
+                if (victim < 0 || spool[ndx].priority > spool[victim].priority)
+                    victim = ndx;
+            }
+            if (spool[victim].priority < job.priority)
+            {
+                kDebug() << "spool is full, dropping job " << job.jobNum;
+                return false;
+            }
+            kDebug() << "spool is full, dropping job " << spool[victim].jobNum;
+            int victimJobNum = spool.takeAt(victim).jobNum;
+            setJobState(victimJobNum, KSpeech::jsDeleted);
         }
+        spool.append(job);
+        return true;
+    }
+
+    void readTalkerData()
+    {
+        ConfigDataPtr config = ConfigData::current();
+        if (config->talkers.isEmpty())
+            return;
+        defaultTalker = config->defaultTalker;
+        currentTalker = defaultTalker;
+
+        q->setOutputModule(defaultTalker.outputModule());
+        q->setLanguage(defaultTalker.language());
+        q->setVoiceType(defaultTalker.voiceType());
+        q->setVolume(defaultTalker.volume());
+        q->setPitch(defaultTalker.pitch());
+        q->setSpeed(defaultTalker.rate());
+        q->setPunctuationType(defaultTalker.punctuation());
     }
 
     /**
@@ -218,14 +678,19 @@ protected:
     mutable QMap<QString, AppData*> appData;
 
     /**
-    * the filter manager
+    * the filter manager, for texts filtered on the main thread
     */
     FilterMgr * filterMgr;
 
     /**
-    * Object holding all the configuration
+    * Filter managers for long texts filtered in the background.
+    */
+    FilterMgrPool filterPool;
+
+    /**
+    * Text jobs being filtered in the background, by job number.
     */
-    KConfig *config;
+    QHash<int, QSharedPointer<BackgroundFilter> > backgroundFilters;
 
     Speaker *q;
 
@@ -240,165 +705,1040 @@ protected:
     * and to know if we need to change the talker based on a filter's results.
     */
     TalkerCode currentTalker;
+
+    /**
+    * Last job number handed out.  Job numbers are assigned by Jovie so that
+    * jobs accepted while speech-dispatcher is down still get one.
+    */
+    int lastJobNum;
+
+    /**
+    * Jobs waiting for speech-dispatcher to come back, in arrival order.
+    */
+    QList<SpooledJob> spool;
+
+    /**
+    * Spooled and speaking jobs by job number.
+    */
+    QHash<int, LiveJob> liveJobs;
+
+    /**
+    * Job number for each message id speech-dispatcher gave us.
+    */
+    QHash<int, int> jobNumByMsgId;
+
+    /**
+    * Jobs spoken by sentence, in speaking order.  Only the first one has a
+    * sentence with speech-dispatcher.
+    */
+    QList<int> textQueue;
+
+    /**
+    * Sentences that were taken back after they had been handed over.
+    */
+    QSet<int> staleMsgIds;
+
+    /**
+    * Text of open streams that does not make up a whole sentence yet.
+    */
+    QHash<int, QString> streamText;
+
+    /**
+    * Registered message templates by id.
+    */
+    QHash<int, MessageTemplate> templates;
+
+    /**
+    * Last template id handed out.
+    */
+    int lastTemplateId;
+
+    /**
+    * Fires the next reconnect attempt.
+    */
+    QTimer reconnectTimer;
+
+    /**
+    * Hands an interrupted text job back to speech-dispatcher.
+    */
+    QTimer resumeTimer;
+
+    /**
+    * Delay before the next reconnect attempt.  Doubles on each failure.
+    */
+    int reconnectDelay;
+
+    /**
+    * Watches the connection attempt running in the background.
+    */
+    QFutureWatcher<SpeechdConnection> connectWatcher;
+
+    /**
+    * Background load of the filter plugins.
+    */
+    QFuture<void> filterLoad;
+
+    /**
+    * Watches the background load of the filter plugins.
+    */
+    QFutureWatcher<void> filterLoadWatcher;
+
+    /**
+    * True from the start of a filter load until the jobs that waited for it
+    * are queued.
+    */
+    bool filtersLoading;
+
+    /**
+    * Speaker::init() was called during a load; load again once it is done.
+    */
+    bool filterReloadPending;
+
+    /**
+    * Jobs that arrived while the filters were loading, in order.
+    */
+    QList<EarlyJob> earlyJobs;
+
+    /**
+    * Streams closed while the filters were loading.
+    */
+    QList<int> closedStreams;
 };
 
 /* Public Methods ==========================================================*/
 
-Speaker * Speaker::m_instance = NULL;
+Speaker * Speaker::m_instance = NULL;
+
+Speaker * Speaker::Instance()
+{
+    if (m_instance == NULL)
+    {
+        m_instance = new Speaker();
+    }
+    return m_instance;
+}
+
+void Speaker::speechdCallback(size_t msg_id, size_t /*client_id*/, SPDNotificationType type)
+{
+    // Called from the speech-dispatcher thread.
+    QMetaObject::invokeMethod(m_instance, "slotSpeechdEvent", Qt::QueuedConnection,
+        Q_ARG(int, int(msg_id)), Q_ARG(int, int(type)));
+}
+
+Speaker::Speaker() :
+    d(new SpeakerPrivate(this))
+{
+    connect(&d->reconnectTimer, SIGNAL(timeout()), this, SLOT(slotReconnect()));
+    connect(&d->resumeTimer, SIGNAL(timeout()), this, SLOT(slotResumeInterrupted()));
+    connect(&d->connectWatcher, SIGNAL(finished()), this, SLOT(slotConnectFinished()));
+    connect(&d->filterLoadWatcher, SIGNAL(finished()), this, SLOT(slotFiltersLoaded()));
+    // Do not wait for speech-dispatcher here.  Jobs arriving before the
+    // connection is up are spooled.
+    d->startConnect();
+    // kDebug() << "Running: Speaker::Speaker()";
+    // Connect ServiceUnregistered signal from DBUS so we know when apps have exited.
+    connect (QDBusConnection::sessionBus().interface(), SIGNAL(serviceUnregistered(QString)),
+        this, SLOT(slotServiceUnregistered(QString)));
+}
+
+Speaker::~Speaker(){
+    kDebug() << "Running: Speaker::~Speaker()";
+    delete d;
+}
+
+void Speaker::init()
+{
+    // from speechdata
+    kDebug() << "Running: Speaker::init()";
+    // Load the filters in the background.  Jobs that need them before the
+    // load is done wait in jsFiltering; see slotFiltersLoaded().  The
+    // FilterMgr cannot be reconfigured while it loads, so if a load is
+    // running, another one follows it.
+    if (d->filtersLoading)
+        d->filterReloadPending = true;
+    else
+        d->startFilterLoad();
+    d->filterPool.init();
+
+    // The filters may have changed; filter the templates again on next use.
+    QHash<int, MessageTemplate>::iterator it;
+    for (it = d->templates.begin(); it != d->templates.end(); ++it)
+        it->filteredParts.clear();
+
+    // Reread config setting the top voice if there is one.
+    d->readTalkerData();
+}
+
+AppData* Speaker::getAppData(const QString& appId) const
+{
+    if (!d->appData.contains(appId))
+        d->appData.insert(appId, new AppData(appId));
+    return d->appData[appId];
+}
+
+bool Speaker::isSsml(const QString &text)
+{
+    /// This checks to see if the root tag of the text is a <speak> tag.
+    QDomDocument ssml;
+    ssml.setContent(text, false);  // No namespace processing.
+    /// Check to see if this is SSML
+    QDomElement root = ssml.documentElement();
+    return (root.tagName() == QLatin1String( "speak" ));
+}
+
+QStringList Speaker::parseText(const QString &text, const QString &appId /*=NULL*/)
+{
+    // There has to be a better way
+    // kDebug() << "I'm getting: "<< text << " from application " << appId;
+    if (isSsml(text)) {
+        QStringList tempList(text);
+        return tempList;
+    }
+    // The fixed expressions are compiled once.  Speaker only runs in the
+    // main thread, so they are never matched concurrently.
+    static const FilterRegExp whitespace(QLatin1String( "[ \\t\\f]+" ));
+    static const FilterRegExp leadingSpaces(QLatin1String( "\\t +" ));
+    static const FilterRegExp trailingSpaces(QLatin1String( " +\\t" ));
+    static const FilterRegExp blankLines(QLatin1String( "\t\t+" ));
+    // See if app has specified a custom sentence delimiter and use it, otherwise use default.
+    FilterRegExp sentenceDelimiter(getAppData(appId)->sentenceDelimiter());
+    QString temp = text;
+    // Replace spaces, tabs, and formfeeds with a single space.
+    whitespace.replace(temp, QLatin1String( " " ));
+    // Replace sentence delimiters with tab.
+    sentenceDelimiter.replace(temp, QLatin1String( "\\1\t" ));
+    // Replace remaining newlines with spaces.
+    temp.replace(QLatin1Char( '\n' ),QLatin1Char( ' ' ));
+    temp.replace(QLatin1Char( '\r' ),QLatin1Char( ' ' ));
+    // Remove leading spaces.
+    leadingSpaces.replace(temp, QLatin1String( "\t" ));
+    // Remove trailing spaces.
+    trailingSpaces.replace(temp, QLatin1String( "\t" ));
+    // Remove blank lines.
+    blankLines.replace(temp, QLatin1String( "\t" ));
+    // Split into sentences.
+    QStringList tempList = temp.split( QLatin1Char( '\t' ), QString::SkipEmptyParts);
+
+//    for ( QStringList::Iterator it = tempList.begin(); it != tempList.end(); ++it ) {
+//        kDebug() << "'" << *it << "'";
+//    }
+    return tempList;
+}
+
+SPDPriority Speaker::spdPriority(KSpeech::JobPriority priority)
+{
+    SPDPriority spdpriority = SPD_PROGRESS; // default to least priority
+    switch (priority)
+    {
+        case KSpeech::jpScreenReaderOutput: /**< Screen Reader job. SPD_IMPORTANT */
+            spdpriority = SPD_IMPORTANT;
+            break;
+        case KSpeech::jpWarning: /**< Warning job. SPD_NOTIFICATION */
+            spdpriority = SPD_NOTIFICATION;
+            break;
+        case KSpeech::jpMessage: /**< Message job.SPD_MESSAGE */
+            spdpriority = SPD_MESSAGE;
+            break;
+        case KSpeech::jpText: /**< Text job. SPD_TEXT */
+            spdpriority = SPD_TEXT;
+            break;
+        case KSpeech::jpProgress: /**< Progress report. SPD_PROGRESS added KDE 4.4 */
+            spdpriority = SPD_PROGRESS;
+            break;
+        default:
+            break;
+    }
+    return spdpriority;
+}
+
+void Speaker::applyTalker(const TalkerCode &talkerCode)
+{
+    setOutputModule(talkerCode.outputModule());
+    // If there's a voiceName, use it, otherwise just use the language
+    if (!talkerCode.voiceName().isEmpty())
+    {
+        setVoiceName(talkerCode.voiceName());
+    }
+    else
+    {
+        setLanguage(talkerCode.language());
+    }
+    setVoiceType(talkerCode.voiceType());
+    setVolume(talkerCode.volume());
+    setSpeed(talkerCode.rate());
+    setPitch(talkerCode.pitch());
+    setPunctuationType(talkerCode.punctuation());
+}
+
+int Speaker::say(const QString& appId, const QString& text, int sayOptions)
+{
+    if(text.isNull() || text.isEmpty()){
+        kDebug() << "Speaker::say text was empty";
+        return 0;
+    }
+    switch (sayOptions)
+    {
+        case KSpeech::soNone:
+        case KSpeech::soPlainText:
+        case KSpeech::soHtml:
+        case KSpeech::soSsml:
+        case KSpeech::soChar:
+        case KSpeech::soKey:
+        case KSpeech::soSoundIcon:
+            break;
+        default:
+            kDebug() << "Unknown say option "<< sayOptions;
+            return 0;
+    }
+    AppData* appData = getAppData(appId);
+    KSpeech::JobPriority priority = appData->defaultPriority();
+    //kDebug() << "Speaker::say priority = " << priority;
+    //kDebug() << "Running: Speaker::say appId = " << appId << " text = " << text;
+    //QString talker = appData->defaultTalker();
+
+    if (priority == KSpeech::jpText &&
+        (sayOptions == KSpeech::soNone || sayOptions == KSpeech::soPlainText) &&
+        text.length() > BackgroundFilterThreshold)
+    {
+        BackgroundFilter* filter = newBackgroundFilter(appId);
+        filter->text = text;
+        return sayInBackground(filter);
+    }
+    if (d->filtersLoading && appData->filteringOn())
+        return sayWhenFiltersLoaded(appId, text, sayOptions);
+
+    if (priority == KSpeech::jpText &&
+        (sayOptions == KSpeech::soNone || sayOptions == KSpeech::soPlainText))
+    {
+        int jobNum = openTextJob(appId);
+        // Do not keep a copy of long texts around for the debug output.
+        appendJobText(jobNum, prepareText(text, appId), d->currentTalker);
+        closeTextJob(jobNum);
+        return jobNum;
+    }
+
+    kDebug() << "incoming job with text: " << text;
+    return queueJob(appId, sayOptions, prepareText(text, appId));
+}
+
+int Speaker::sayWhenFiltersLoaded(const QString& appId, const QString& text, int sayOptions)
+{
+    AppData* appData = getAppData(appId);
+    KSpeech::JobPriority priority = appData->defaultPriority();
+    EarlyJob earlyJob;
+    earlyJob.appId = appId;
+    earlyJob.text = text;
+    earlyJob.sayOptions = sayOptions;
+    if (priority == KSpeech::jpText &&
+        (sayOptions == KSpeech::soNone || sayOptions == KSpeech::soPlainText))
+    {
+        earlyJob.jobNum = openTextJob(appId);
+        d->setJobState(earlyJob.jobNum, KSpeech::jsFiltering);
+    }
+    else
+    {
+        earlyJob.jobNum = ++d->lastJobNum;
+        d->liveJobs.insert(earlyJob.jobNum, LiveJob(appId, priority, KSpeech::jsFiltering));
+        appData->jobList()->append(earlyJob.jobNum);
+        emit jobStateChanged(appId, earlyJob.jobNum, KSpeech::jsFiltering);
+    }
+    kDebug() << "job " << earlyJob.jobNum << " waits for the filters to load";
+    d->earlyJobs.append(earlyJob);
+    return earlyJob.jobNum;
+}
+
+int Speaker::queueJob(const QString& appId, int sayOptions, const QString& filteredText, int jobNum)
+{
+    AppData* appData = getAppData(appId);
+    KSpeech::JobPriority priority = appData->defaultPriority();
+    if (jobNum == 0 && priority == KSpeech::jpText &&
+        (sayOptions == KSpeech::soNone || sayOptions == KSpeech::soPlainText))
+    {
+        int jobNum = openTextJob(appId);
+        appendJobText(jobNum, filteredText, d->currentTalker);
+        closeTextJob(jobNum);
+        return jobNum;
+    }
+
+    SpooledJob job;
+    job.jobNum = jobNum;
+    job.appId = appId;
+    job.priority = priority;
+    job.sayOptions = sayOptions;
+    job.text = filteredText.toUtf8();
+    job.talker = d->currentTalker;
+
+    if (jobNum != 0)
+    {
+        // The job was handed out while the filters loaded.
+        job.priority = d->liveJobs.value(jobNum).priority;
+        if (!submitJob(job))
+        {
+            d->setJobState(jobNum, KSpeech::jsDeleted);
+            return 0;
+        }
+        d->setJobState(jobNum, KSpeech::jsQueued);
+        return jobNum;
+    }
+
+    job.jobNum = ++d->lastJobNum;
+    d->liveJobs.insert(job.jobNum, LiveJob(appId, priority, KSpeech::jsQueued));
+    if (!submitJob(job))
+    {
+        d->liveJobs.remove(job.jobNum);
+        return 0;
+    }
+    kDebug() << "saying post filtered text: " << filteredText;
+
+    //// Note: Set state last so job is fully populated when jobStateChanged signal is emitted.
+    appData->jobList()->append(job.jobNum);
+    emit jobStateChanged(appId, job.jobNum, KSpeech::jsQueued);
+    return job.jobNum;
+}
+
+int Speaker::registerTemplate(const QString& appId, const QString& text)
+{
+    if (text.isEmpty())
+        return 0;
+    // The same text registered again gets the same id.
+    QHash<int, MessageTemplate>::const_iterator it;
+    for (it = d->templates.constBegin(); it != d->templates.constEnd(); ++it)
+        if (it->appId == appId && it->text == text)
+            return it.key();
+
+    MessageTemplate messageTemplate;
+    messageTemplate.appId = appId;
+    messageTemplate.text = text;
+    int start = 0;
+    int pos = 0;
+    while ((pos = text.indexOf(QLatin1Char('%'), pos)) != -1)
+    {
+        int number = 0;
+        int end = pos + 1;
+        while (end < text.length() && end < pos + 3 && text.at(end).isDigit())
+            number = number * 10 + text.at(end++).digitValue();
+        if (number == 0)
+        {
+            ++pos;
+            continue;
+        }
+        messageTemplate.parts.append(text.mid(start, pos - start));
+        messageTemplate.placeholders.append(number);
+        start = pos = end;
+    }
+    messageTemplate.parts.append(text.mid(start));
+
+    int templateId = ++d->lastTemplateId;
+    d->templates.insert(templateId, messageTemplate);
+    kDebug() << "template " << templateId << " of " << appId << " has "
+             << messageTemplate.placeholders.count() << " placeholders";
+    return templateId;
+}
+
+bool Speaker::removeTemplate(const QString& appId, int templateId)
+{
+    QHash<int, MessageTemplate>::iterator it = d->templates.find(templateId);
+    if (it == d->templates.end() || it->appId != appId)
+        return false;
+    d->templates.erase(it);
+    return true;
+}
+
+int Speaker::sayTemplate(const QString& appId, int templateId, const QStringList& args, int sayOptions)
+{
+    QHash<int, MessageTemplate>::iterator it = d->templates.find(templateId);
+    if (it == d->templates.end() || it->appId != appId)
+    {
+        kDebug() << "Speaker::sayTemplate: no template " << templateId << " for " << appId;
+        return 0;
+    }
+    QString text = it->parts.first();
+    for (int i = 0; i < it->placeholders.count(); ++i)
+        text += args.value(it->placeholders.at(i) - 1) + it->parts.at(i + 1);
+    // Markup cannot be filtered in parts.
+    if (sayOptions != KSpeech::soNone && sayOptions != KSpeech::soPlainText)
+        return say(appId, text, sayOptions);
+    // Nor before the filters are loaded.
+    if (d->filtersLoading && getAppData(appId)->filteringOn())
+        return sayWhenFiltersLoaded(appId, text, sayOptions);
+
+    QString filteredText;
+    TalkerCode talkerCode = d->currentTalker;
+    if (getAppData(appId)->filteringOn())
+    {
+        if (it->filteredParts.isEmpty())
+        {
+            TalkerCode partsTalker = d->currentTalker;
+            foreach (const QString& part, it->parts)
+                it->filteredParts.append(part.isEmpty() ? part : d->filterMgr->convert(part, &partsTalker, appId));
+            it->talkerChosen = partsTalker != d->currentTalker;
+            it->talker = partsTalker;
+        }
+        if (it->talkerChosen)
+            talkerCode = it->talker;
+        filteredText = it->filteredParts.first();
+        for (int i = 0; i < it->placeholders.count(); ++i)
+        {
+            const QString arg = args.value(it->placeholders.at(i) - 1);
+            if (!arg.isEmpty())
+                filteredText += d->filterMgr->convert(arg, &talkerCode, appId);
+            filteredText += it->filteredParts.at(i + 1);
+        }
+    }
+    else
+        filteredText = text;
+
+    if (talkerCode != d->currentTalker)
+        applyTalker(talkerCode);
+    emit newJobFiltered(text, filteredText);
+    return queueJob(appId, sayOptions, filteredText);
+}
+
+int Speaker::openStream(const QString& appId)
+{
+    AppData* appData = getAppData(appId);
+    int jobNum = ++d->lastJobNum;
+    LiveJob liveJob(appId, appData->defaultPriority(), KSpeech::jsQueued);
+    liveJob.streaming = true;
+    liveJob.bySentence = liveJob.priority == KSpeech::jpText;
+    d->liveJobs.insert(jobNum, liveJob);
+    if (liveJob.bySentence)
+        d->textQueue.append(jobNum);
+    d->streamText.insert(jobNum, QString());
+    appData->jobList()->append(jobNum);
+    emit jobStateChanged(appId, jobNum, KSpeech::jsQueued);
+    return jobNum;
+}
+
+bool Speaker::appendText(int jobNum, const QString& text)
+{
+    QHash<int, QString>::iterator it = d->streamText.find(jobNum);
+    if (it == d->streamText.end())
+        return false;
+    if (!d->liveJobs.contains(jobNum))
+    {
+        // Cancelled while open.
+        d->streamText.erase(it);
+        return false;
+    }
+    QString &pending = it.value();
+    pending += text;
+    QString appId = d->liveJobs.value(jobNum).appId;
+    // Hold everything until the filters are loaded; see slotFiltersLoaded().
+    if (d->filtersLoading && getAppData(appId)->filteringOn())
+        return true;
+
+    // Hand over each sentence as soon as something follows its delimiter.
+    // A delimiter at the very end may still turn out to be something else,
+    // such as the dot in "3.14", once more text arrives.
+    QRegExp sentenceDelimiter(getAppData(appId)->sentenceDelimiter());
+    int start = 0;
+    int pos;
+    while ((pos = sentenceDelimiter.indexIn(pending, start)) != -1)
+    {
+        int end = pos + sentenceDelimiter.matchedLength();
+        if (end >= pending.length() || end == start)
+            break;
+        if (!speakStreamText(jobNum, pending.mid(start, end - start)))
+            return false;
+        start = end;
+    }
+    pending.remove(0, start);
+
+    if (pending.length() > MaxStreamHoldback)
+    {
+        QString text = pending;
+        pending.clear();
+        return speakStreamText(jobNum, text);
+    }
+    return true;
+}
+
+void Speaker::closeStream(int jobNum)
+{
+    if (!d->streamText.contains(jobNum))
+        return;
+    QHash<int, LiveJob>::iterator it = d->liveJobs.find(jobNum);
+    if (it != d->liveJobs.end() && d->filtersLoading && getAppData(it->appId)->filteringOn())
+    {
+        // Closed once the held text is spoken; see slotFiltersLoaded().
+        if (!d->closedStreams.contains(jobNum))
+            d->closedStreams.append(jobNum);
+        return;
+    }
+    QString pending = d->streamText.take(jobNum);
+    if (it == d->liveJobs.end())
+        return;
+    it->streaming = false;
+    if (!pending.trimmed().isEmpty())
+        speakStreamText(jobNum, pending);
+    it = d->liveJobs.find(jobNum);
+    if (it != d->liveJobs.end())
+        it->text.squeeze();
+    d->finishIfDone(jobNum);
+    speakNextSentence();
+}
+
+int Speaker::sayUtf8(const QString& appId, const QByteArray& text, int sayOptions,
+                     const QSharedPointer<QFile>& mapping)
+{
+    AppData* appData = getAppData(appId);
+    if (text.size() > BackgroundFilterThreshold &&
+        appData->defaultPriority() == KSpeech::jpText &&
+        (sayOptions == KSpeech::soNone || sayOptions == KSpeech::soPlainText))
+    {
+        // Decoded piece by piece by the worker; the whole text never exists
+        // as a QString.
+        BackgroundFilter* filter = newBackgroundFilter(appId);
+        if (mapping)
+        {
+            filter->utf8 = text;
+            filter->mapping = mapping;
+        }
+        else
+            filter->utf8 = QByteArray(text.constData(), text.size());
+        return sayInBackground(filter);
+    }
+    return say(appId, QString::fromUtf8(text.constData(), text.size()), sayOptions);
+}
+
+int Speaker::openTextJob(const QString& appId)
+{
+    AppData* appData = getAppData(appId);
+    int jobNum = ++d->lastJobNum;
+    LiveJob liveJob(appId, appData->defaultPriority(), KSpeech::jsQueued);
+    liveJob.bySentence = true;
+    liveJob.streaming = true;
+    d->liveJobs.insert(jobNum, liveJob);
+    d->textQueue.append(jobNum);
+    appData->jobList()->append(jobNum);
+    emit jobStateChanged(appId, jobNum, KSpeech::jsQueued);
+    return jobNum;
+}
+
+void Speaker::closeTextJob(int jobNum)
+{
+    QHash<int, LiveJob>::iterator it = d->liveJobs.find(jobNum);
+    if (it != d->liveJobs.end())
+    {
+        it->streaming = false;
+        it->text.squeeze();
+        kDebug() << "text job " << jobNum << " has " << it->text.sentenceCount()
+                 << " sentences, " << it->text.size() << " bytes";
+    }
+    speakNextSentence();
+}
+
+BackgroundFilter* Speaker::newBackgroundFilter(const QString& appId)
+{
+    AppData* appData = getAppData(appId);
+    return new BackgroundFilter(StreamState(appId, appData->filteringOn(),
+        appData->sentenceDelimiter(), d->currentTalker));
+}
+
+int Speaker::sayInBackground(BackgroundFilter* filter)
+{
+    QSharedPointer<BackgroundFilter> shared(filter);
+    int jobNum = openTextJob(filter->state.appId);
+    kDebug() << "filtering job " << jobNum << " in the background";
+    d->setJobState(jobNum, KSpeech::jsFiltering);
+    d->backgroundFilters.insert(jobNum, shared);
+    filter->future = QtConcurrent::run(this, &Speaker::filterInBackground, jobNum, shared);
+    return jobNum;
+}
+
+void Speaker::filterInBackground(int jobNum, QSharedPointer<BackgroundFilter> filter)
+{
+    StreamState& state = filter->state;
+    const int length = filter->utf8.isNull() ? filter->text.length() : filter->utf8.size();
+    if (state.filtering && length > ParallelFilterThreshold && d->filterPool.size() > 1)
+    {
+        filterInParallel(jobNum, filter);
+        return;
+    }
+
+    QScopedPointer<FilterMgrLease> lease;
+    if (state.filtering)
+        lease.reset(new FilterMgrLease(&d->filterPool));
+    FilterMgr* filterMgr = lease ? lease->get() : 0;
+
+    if (filterMgr && !filterMgr->supportsStreaming())
+    {
+        // Some filter needs the whole text at once.
+        QString text = filter->utf8.isNull() ? filter->text :
+            QString::fromUtf8(filter->utf8.constData(), filter->utf8.size());
+        filter->text.clear();
+        filter->utf8.clear();
+        filter->mapping.clear();
+        const QString filtered = filterMgr->convert(text, &state.talkerCode, state.appId);
+        QMetaObject::invokeMethod(this, "slotBackgroundFiltered", Qt::QueuedConnection,
+            Q_ARG(int, jobNum), Q_ARG(QString, filtered),
+            Q_ARG(QString, state.talkerCode.getTalkerCode()), Q_ARG(bool, true));
+        return;
+    }
+
+    const bool utf8 = !filter->utf8.isNull();
+    const char* data = filter->utf8.constData();
+    const qint64 size = utf8 ? filter->utf8.size() : filter->text.length();
+    qint64 pos = 0;
+    // Skip a byte order mark.
+    if (utf8 && filter->utf8.startsWith("\xef\xbb\xbf"))
+        pos = 3;
+    bool last = pos >= size;
+    while (!last && !filter->cancelled)
+    {
+        QString piece;
+        if (utf8)
+        {
+            const int length = utf8PieceLength(data + pos, size - pos, StreamFilterChunk);
+            piece = QString::fromUtf8(data + pos, length);
+            pos += length;
+        }
+        else
+        {
+            int length = StreamFilterChunk;
+            // Do not split a surrogate pair.
+            if (pos + length < size && filter->text.at(pos + length - 1).isHighSurrogate())
+                ++length;
+            piece = filter->text.mid(pos, length);
+            pos += length;
+        }
+        last = pos >= size;
+        const QString ready = filterPiece(filterMgr, piece, last, state);
+        if (!ready.isEmpty() || last)
+            QMetaObject::invokeMethod(this, "slotBackgroundFiltered", Qt::QueuedConnection,
+                Q_ARG(int, jobNum), Q_ARG(QString, ready),
+                Q_ARG(QString, state.talkerCode.getTalkerCode()), Q_ARG(bool, last));
+    }
+    if (!last)
+    {
+        // Deleted; reset the filters for the next lease.
+        if (filterMgr)
+            filterMgr->flush(&state.talkerCode, state.appId);
+        QMetaObject::invokeMethod(this, "slotBackgroundFiltered", Qt::QueuedConnection,
+            Q_ARG(int, jobNum), Q_ARG(QString, QString()), Q_ARG(QString, QString()), Q_ARG(bool, true));
+    }
+    filter->text.clear();
+    filter->utf8.clear();
+    filter->mapping.clear();
+}
+
+void Speaker::filterInParallel(int jobNum, QSharedPointer<BackgroundFilter> filter)
+{
+    const QString text = convertInParallel(filter.data(), jobNum);
+    QMetaObject::invokeMethod(this, "slotBackgroundFiltered", Qt::QueuedConnection,
+        Q_ARG(int, jobNum), Q_ARG(QString, filter->cancelled ? QString() : text),
+        Q_ARG(QString, filter->state.talkerCode.getTalkerCode()), Q_ARG(bool, true));
+}
 
-Speaker * Speaker::Instance()
+QString Speaker::convertInParallel(BackgroundFilter* filter, int jobNum)
 {
-    if (m_instance == NULL)
+    StreamState& state = filter->state;
+    QString text = filter->utf8.isNull() ? filter->text :
+        QString::fromUtf8(filter->utf8.constData(), filter->utf8.size());
+    filter->text.clear();
+    filter->utf8.clear();
+    filter->mapping.clear();
+
+    QList<bool> splitting;
     {
-        m_instance = new Speaker();
+        FilterMgrLease filterMgr(&d->filterPool);
+        filterMgr->chooseTalker(text, &state.talkerCode, state.appId);
+        for (int i = 0; i < filterMgr->filterCount(); ++i)
+            splitting.append(filterMgr->filterSupportsSplitting(i));
     }
-    return m_instance;
+
+    int first = 0;
+    while (first < splitting.count() && !filter->cancelled)
+    {
+        // Take all following filters of the same kind together.
+        int last = first + 1;
+        while (last < splitting.count() && splitting.at(last) == splitting.at(first))
+            ++last;
+        if (!splitting.at(first))
+        {
+            FilterMgrLease filterMgr(&d->filterPool);
+            text = filterMgr->convert(text, first, last, &state.talkerCode, state.appId);
+            first = last;
+            continue;
+        }
+
+        const QStringList parts = splitAtSentences(text, state.sentenceDelimiter, ParallelFilterChunk);
+        text.clear();
+        kDebug() << "filtering job " << jobNum << " in " << parts.count() << " parts, filters "
+                 << first << " to " << last - 1;
+        QFuture<QString> future = QtConcurrent::mapped(parts,
+            PartFilter(&d->filterPool, first, last, state.talkerCode, state.appId));
+        // Let the pool start another thread while this one waits.
+        QThreadPool::globalInstance()->releaseThread();
+        const bool final = last == splitting.count();
+        for (int i = 0; i < parts.count(); ++i)
+        {
+            if (filter->cancelled)
+            {
+                future.cancel();
+                break;
+            }
+            // The parts end at sentence boundaries, so once all filters ran
+            // they can be spoken as they come in.
+            if (final && jobNum)
+                QMetaObject::invokeMethod(this, "slotBackgroundFiltered", Qt::QueuedConnection,
+                    Q_ARG(int, jobNum), Q_ARG(QString, future.resultAt(i)),
+                    Q_ARG(QString, state.talkerCode.getTalkerCode()), Q_ARG(bool, false));
+            else
+                text += future.resultAt(i);
+        }
+        future.waitForFinished();
+        QThreadPool::globalInstance()->reserveThread();
+        first = last;
+    }
+    return text;
 }
 
-void Speaker::speechdCallback(size_t msg_id, size_t /*client_id*/, SPDNotificationType type)
+void Speaker::slotBackgroundFiltered(int jobNum, const QString& text, const QString& talkerCode, bool last)
 {
-    kDebug() << "speechdCallback called with messageid: " << msg_id << " and type: " << type;
-    //KSpeech::JobState state(KSpeech::jsQueued);
-    //switch (type) {
-    //    case SPD_EVENT_BEGIN:
-    //        state = KSpeech::jsSpeaking;
-    //        break;
-    //    case SPD_EVENT_END:
-    //        state = KSpeech::jsFinished;
-    //        break;
-    //    case SPD_EVENT_INDEX_MARK:
-    //        break;
-    //    case SPD_EVENT_CANCEL:
-    //        state = KSpeech::jsDeleted;
-    //        break;
-    //    case SPD_EVENT_PAUSE:
-    //        state = KSpeech::jsPaused;
-    //        break;
-    //    case SPD_EVENT_RESUME:
-    //        state = KSpeech::jsSpeaking;
-    //        break;
-    //}
+    if (last)
+        d->backgroundFilters.remove(jobNum);
+    if (!d->liveJobs.contains(jobNum))
+        return;
+    if (!text.isEmpty())
+        appendJobText(jobNum, text, TalkerCode(talkerCode));
+    if (last)
+    {
+        if (d->liveJobs.value(jobNum).state == KSpeech::jsFiltering)
+            d->setJobState(jobNum, KSpeech::jsQueued);
+        closeTextJob(jobNum);
+    }
+    else
+        // Start speaking while the rest is filtered.
+        speakNextSentence();
 }
 
-Speaker::Speaker() :
-    d(new SpeakerPrivate(this))
+void Speaker::slotFiltersLoaded()
 {
-    if (!d->ConnectToSpeechd())
+    if (d->filterReloadPending)
     {
-        kDebug() << "connection: " << d->connection;
-        kError() << "could not get a connection to speech-dispatcher"<< endl;
+        // The configuration changed during the load.
+        d->filterReloadPending = false;
+        d->startFilterLoad();
+        return;
+    }
+    d->filtersLoading = false;
+    if (d->earlyJobs.isEmpty() && d->streamText.isEmpty())
+        return;
+    kDebug() << "filters loaded; " << d->earlyJobs.count() << " jobs were waiting for them";
+
+    const QList<EarlyJob> earlyJobs = d->earlyJobs;
+    d->earlyJobs.clear();
+    foreach (const EarlyJob& earlyJob, earlyJobs)
+    {
+        // Skip jobs cancelled while they waited.
+        if (!d->liveJobs.contains(earlyJob.jobNum))
+            continue;
+        const bool bySentence = d->liveJobs.value(earlyJob.jobNum).bySentence;
+        const QString filteredText = prepareText(earlyJob.text, earlyJob.appId);
+        if (bySentence)
+        {
+            appendJobText(earlyJob.jobNum, filteredText, d->currentTalker);
+            d->setJobState(earlyJob.jobNum, KSpeech::jsQueued);
+            closeTextJob(earlyJob.jobNum);
+        }
+        else
+            queueJob(earlyJob.appId, earlyJob.sayOptions, filteredText, earlyJob.jobNum);
     }
-    // kDebug() << "Running: Speaker::Speaker()";
-    // Connect ServiceUnregistered signal from DBUS so we know when apps have exited.
-    connect (QDBusConnection::sessionBus().interface(), SIGNAL(serviceUnregistered(QString)),
-        this, SLOT(slotServiceUnregistered(QString)));
-}
 
-Speaker::~Speaker(){
-    kDebug() << "Running: Speaker::~Speaker()";
-    delete d;
+    // Speak what open streams held meanwhile, and close those that were.
+    foreach (int jobNum, d->streamText.keys())
+        appendText(jobNum, QString());
+    const QList<int> closedStreams = d->closedStreams;
+    d->closedStreams.clear();
+    foreach (int jobNum, closedStreams)
+        closeStream(jobNum);
 }
 
-void Speaker::init()
+bool Speaker::speakStreamText(int jobNum, const QString& text)
 {
-    // from speechdata
-    // Create an initial FilterMgr for the pool to save time later.
-    kDebug() << "Running: Speaker::init()";
-    delete d->filterMgr;
-    d->filterMgr = new FilterMgr();
-    d->filterMgr->init();
+    QString sentence = text.simplified();
+    if (sentence.isEmpty())
+        return true;
+    const LiveJob liveJob = d->liveJobs.value(jobNum);
 
-    // Reread config setting the top voice if there is one.
-    d->readTalkerData();
+    if (liveJob.bySentence)
+    {
+        QString filteredText = prepareText(sentence, liveJob.appId);
+        appendJobText(jobNum, filteredText, d->currentTalker);
+        speakNextSentence();
+        return true;
+    }
+
+    SpooledJob job;
+    job.jobNum = jobNum;
+    job.appId = liveJob.appId;
+    job.priority = liveJob.priority;
+    job.sayOptions = KSpeech::soPlainText;
+    job.text = prepareText(sentence, liveJob.appId).toUtf8();
+    job.talker = d->currentTalker;
+    if (!submitJob(job))
+    {
+        d->streamText.remove(jobNum);
+        d->setJobState(jobNum, KSpeech::jsDeleted);
+        return false;
+    }
+    return true;
 }
 
-AppData* Speaker::getAppData(const QString& appId) const
+void Speaker::appendJobText(int jobNum, const QString& filteredText, const TalkerCode& talker)
 {
-    if (!d->appData.contains(appId))
-        d->appData.insert(appId, new AppData(appId));
-    return d->appData[appId];
+    QHash<int, LiveJob>::iterator it = d->liveJobs.find(jobNum);
+    if (it == d->liveJobs.end())
+        return;
+    it->text.appendText(filteredText, QRegExp(getAppData(it->appId)->sentenceDelimiter()));
+    it->talker = talker;
+    if (it->job)
+        it->job->setSentenceCount(it->text.sentenceCount());
 }
 
-bool Speaker::isSsml(const QString &text)
+void Speaker::speakNextSentence()
 {
-    /// This checks to see if the root tag of the text is a <speak> tag.
-    QDomDocument ssml;
-    ssml.setContent(text, false);  // No namespace processing.
-    /// Check to see if this is SSML
-    QDomElement root = ssml.documentElement();
-    return (root.tagName() == QLatin1String( "speak" ));
+    while (!d->textQueue.isEmpty())
+    {
+        const int jobNum = d->textQueue.first();
+        QHash<int, LiveJob>::iterator it = d->liveJobs.find(jobNum);
+        if (it == d->liveJobs.end())
+        {
+            d->textQueue.removeFirst();
+            continue;
+        }
+        if (it->sentenceMsgId != -1 || it->state == KSpeech::jsInterrupted)
+            return;
+        if (it->sentenceNum >= it->text.sentenceCount())
+        {
+            // Wait for more text, or move on to the next job.
+            if (it->streaming)
+                return;
+            d->setJobState(jobNum, KSpeech::jsFinished);
+            continue;
+        }
+        if (d->connection == NULL)
+        {
+            d->scheduleReconnect();
+            return;
+        }
+        if (it->talker != d->currentTalker)
+            applyTalker(it->talker);
+        int msgId = d->sayToSpeechd(spdPriority(it->priority), KSpeech::soPlainText,
+            it->text.sentenceData(it->sentenceNum));
+        if (msgId == -1)
+        {
+            // The sentence goes again after the reconnect.
+            d->connectionLost();
+            return;
+        }
+        it->sentenceMsgId = msgId;
+        it->sentenceBegun = false;
+        d->jobNumByMsgId.insert(msgId, jobNum);
+        if (it->job)
+            it->job->setSentenceNum(it->sentenceNum + 1);
+        return;
+    }
 }
 
-QStringList Speaker::parseText(const QString &text, const QString &appId /*=NULL*/)
+int Speaker::sentenceCount(int jobNum) const
 {
-    // There has to be a better way
-    // kDebug() << "I'm getting: "<< text << " from application " << appId;
-    if (isSsml(text)) {
-        QStringList tempList(text);
-        return tempList;
-    }
-    // See if app has specified a custom sentence delimiter and use it, otherwise use default.
-    QRegExp sentenceDelimiter(getAppData(appId)->sentenceDelimiter());
-    QString temp = text;
-    // Replace spaces, tabs, and formfeeds with a single space.
-    temp.replace(QRegExp(QLatin1String( "[ \\t\\f]+") ), QLatin1String( " " ));
-    // Replace sentence delimiters with tab.
-    temp.replace(sentenceDelimiter, QLatin1String( "\\1\t" ));
-    // Replace remaining newlines with spaces.
-    temp.replace(QLatin1Char( '\n' ),QLatin1Char( ' ' ));
-    temp.replace(QLatin1Char( '\r' ),QLatin1Char( ' ' ));
-    // Remove leading spaces.
-    temp.replace(QRegExp(QLatin1String( "\\t +" )), QLatin1String( "\t" ));
-    // Remove trailing spaces.
-    temp.replace(QRegExp(QLatin1String( " +\\t" )), QLatin1String( "\t" ));
-    // Remove blank lines.
-    temp.replace(QRegExp(QLatin1String( "\t\t+" )),QLatin1String( "\t" ));
-    // Split into sentences.
-    QStringList tempList = temp.split( QLatin1Char( '\t' ), QString::SkipEmptyParts);
+    QHash<int, LiveJob>::const_iterator it = d->liveJobs.constFind(jobNum);
+    if (it == d->liveJobs.constEnd() || !it->bySentence)
+        return 0;
+    return it->text.sentenceCount();
+}
 
-//    for ( QStringList::Iterator it = tempList.begin(); it != tempList.end(); ++it ) {
-//        kDebug() << "'" << *it << "'";
-//    }
-    return tempList;
+QString Speaker::jobSentence(int jobNum, int sentenceNum) const
+{
+    QHash<int, LiveJob>::const_iterator it = d->liveJobs.constFind(jobNum);
+    if (it == d->liveJobs.constEnd() || !it->bySentence)
+        return QString();
+    return QString::fromUtf8(it->text.sentence(sentenceNum - 1));
 }
 
-int Speaker::say(const QString& appId, const QString& text, int sayOptions)
+int Speaker::currentTextJob() const
 {
-    if(text.isNull() || text.isEmpty()){
-        kDebug() << "Speaker::say text was empty";
+    return d->textQueue.isEmpty() ? 0 : d->textQueue.first();
+}
+
+int Speaker::moveRelSentence(int jobNum, int n)
+{
+    QHash<int, LiveJob>::iterator it = d->liveJobs.find(jobNum);
+    if (it == d->liveJobs.end() || !it->bySentence)
         return 0;
+    const int count = it->text.sentenceCount();
+    if (count == 0)
+        return 0;
+    const int current = qMin(it->sentenceNum, count - 1);
+    if (n == 0)
+        return current + 1;
+
+    // The index has every sentence at hand, so just start over from there.
+    const int target = qBound(0, current + n, count - 1);
+    d->withdrawSentence(*it);
+    it->sentenceNum = target;
+    if (it->job)
+        it->job->setSentenceNum(target + 1);
+    speakNextSentence();
+    return target + 1;
+}
+
+void Speaker::moveJobLater(int jobNum)
+{
+    const int index = d->textQueue.indexOf(jobNum);
+    if (index < 0 || index + 1 >= d->textQueue.count())
+        return;
+    d->textQueue.swap(index, index + 1);
+    if (index == 0)
+    {
+        // It continues with the same sentence when its turn comes again.
+        QHash<int, LiveJob>::iterator it = d->liveJobs.find(jobNum);
+        if (it != d->liveJobs.end())
+            d->withdrawSentence(*it);
+        d->setJobState(jobNum, KSpeech::jsQueued);
+        speakNextSentence();
     }
-    QString filteredText = text;
-    int jobNum = -1;
+}
 
-    AppData* appData = getAppData(appId);
-    KSpeech::JobPriority priority = appData->defaultPriority();
-    TalkerCode talkerCode = d->currentTalker;
-    //kDebug() << "Speaker::say priority = " << priority;
-    //kDebug() << "Running: Speaker::say appId = " << appId << " text = " << text;
-    //QString talker = appData->defaultTalker();
+QFuture<QStringList> Speaker::filterTexts(const QStringList& texts, const QString& appId, const QString& talker)
+{
+    const TalkerCode talkerCode = talker.isEmpty() ? d->currentTalker : TalkerCode(talker, true);
+    const StreamState state(appId, true, getAppData(appId)->sentenceDelimiter(), talkerCode);
+    return QtConcurrent::run(this, &Speaker::filterTextsInBackground, texts, state);
+}
 
-    SPDPriority spdpriority = SPD_PROGRESS; // default to least priority
-    switch (priority)
+QStringList Speaker::filterTextsInBackground(const QStringList& texts, const StreamState& state)
+{
+    QStringList filteredTexts;
+    foreach (const QString& text, texts)
     {
-        case KSpeech::jpScreenReaderOutput: /**< Screen Reader job. SPD_IMPORTANT */
-            spdpriority = SPD_IMPORTANT;
-            break;
-        case KSpeech::jpWarning: /**< Warning job. SPD_NOTIFICATION */
-            spdpriority = SPD_NOTIFICATION;
-            break;
-        case KSpeech::jpMessage: /**< Message job.SPD_MESSAGE */
-            spdpriority = SPD_MESSAGE;
-            break;
-        case KSpeech::jpText: /**< Text job. SPD_TEXT */
-            spdpriority = SPD_TEXT;
-            break;
-        case KSpeech::jpProgress: /**< Progress report. SPD_PROGRESS added KDE 4.4 */
-            spdpriority = SPD_PROGRESS;
-            break;
+        // Each text starts from the given talker; a talker chosen by the
+        // filters is not applied, since nothing is spoken.
+        BackgroundFilter filter(state);
+        if (text.isEmpty())
+            filteredTexts.append(text);
+        else if (text.length() > ParallelFilterThreshold && d->filterPool.size() > 1)
+        {
+            filter.text = text;
+            filteredTexts.append(convertInParallel(&filter, 0));
+        }
+        else
+        {
+            FilterMgrLease filterMgr(&d->filterPool);
+            filteredTexts.append(filterMgr->convert(text, &filter.state.talkerCode, state.appId));
+        }
     }
+    return filteredTexts;
+}
 
-    if (appData->filteringOn()) {
+QString Speaker::prepareText(const QString& text, const QString& appId)
+{
+    QString filteredText = text;
+    TalkerCode talkerCode = d->currentTalker;
+    if (getAppData(appId)->filteringOn()) {
         filteredText = d->filterMgr->convert(text, &talkerCode, appId);
     }
 
@@ -407,80 +1747,32 @@ int Speaker::say(const QString& appId, const QString& text, int sayOptions)
     {
         kDebug() << "Changing language from " << d->currentTalker.getTranslatedDescription() <<
                  " to " << talkerCode.getTranslatedDescription();
-        setOutputModule(talkerCode.outputModule());
-        // If there's a voiceName, use it, otherwise just use the language
-        if (!talkerCode.voiceName().isEmpty())
-        {
-            setVoiceName(talkerCode.voiceName());
-        }
-        else
-        {
-            setLanguage(talkerCode.language());
-        }
-        setVoiceType(talkerCode.voiceType());
-        setVolume(talkerCode.volume());
-        setSpeed(talkerCode.rate());
-        setPitch(talkerCode.pitch());
-        setPunctuationType(talkerCode.punctuation());
+        applyTalker(talkerCode);
     }
     emit newJobFiltered(text, filteredText);
+    return filteredText;
+}
 
-    while (jobNum == -1 && d->connection != NULL)
-    {
-        switch (sayOptions)
-        {
-            case KSpeech::soNone: /**< No options specified.  Autodetected. */
-                jobNum = spd_say(d->connection, spdpriority, filteredText.toUtf8().data());
-                break;
-            case KSpeech::soPlainText: /**< The text contains plain text. */
-                jobNum = spd_say(d->connection, spdpriority, filteredText.toUtf8().data());
-                break;
-            case KSpeech::soHtml: /**< The text contains HTML markup. */
-                jobNum = spd_say(d->connection, spdpriority, filteredText.toUtf8().data());
-                break;
-            case KSpeech::soSsml: /**< The text contains SSML markup. */
-                spd_set_data_mode(d->connection, SPD_DATA_SSML);
-                jobNum = spd_say(d->connection, spdpriority, filteredText.toUtf8().data());
-                spd_set_data_mode(d->connection, SPD_DATA_TEXT);
-                break;
-            case KSpeech::soChar: /**< The text should be spoken as individual characters. */
-                spd_set_spelling(d->connection, SPD_SPELL_ON);
-                jobNum = spd_say(d->connection, spdpriority, filteredText.toUtf8().data());
-                spd_set_spelling(d->connection, SPD_SPELL_OFF);
-                break;
-            case KSpeech::soKey: /**< The text contains a keyboard symbolic key name. */
-                jobNum = spd_key(d->connection, spdpriority, filteredText.toUtf8().data());
-                break;
-            case KSpeech::soSoundIcon: /**< The text is the name of a sound icon. */
-                jobNum = spd_sound_icon(d->connection, spdpriority, filteredText.toUtf8().data());
-                break;
-        default:{
-                kDebug() << "Unknown say option "<< sayOptions;
-                goto exit_loop;
-            }
-        }
-        if (jobNum == -1 && d->connection != NULL)
-        {
-            // job failure
-            // try to reconnect once
-            kDebug() << "trying to reconnect to speech dispatcher";
-            if (!d->reconnect())
-            {
-                // replace this with an error stored in kttsd in a log? to be viewed on hover over kttsmgr?
-                kDebug() << "could not connect to speech dispatcher";
-            }
-        }
-    }
-    exit_loop: ;//the only way we can exit from a switch inside a loop
-    if (jobNum != -1)
+bool Speaker::submitJob(const SpooledJob& job)
+{
+    // While speech-dispatcher is unreachable, or if it goes away under us,
+    // hold the job until the reconnect cycle brings it back.
+    int msgId = -1;
+    if (d->connection != NULL)
+        msgId = d->sayToSpeechd(spdPriority(job.priority), job.sayOptions, job.text.constData());
+    if (msgId == -1)
     {
-        kDebug() << "incoming job with text: " << text;
-        kDebug() << "saying post filtered text: " << filteredText;
+        if (d->connection != NULL)
+            d->connectionLost();
+        else
+            d->scheduleReconnect();
+        if (!d->spoolJob(job))
+            return false;
+        kDebug() << "spooled job " << job.jobNum << " until speech dispatcher is back";
+        return true;
     }
-
-    //// Note: Set state last so job is fully populated when jobStateChanged signal is emitted.
-    appData->jobList()->append(jobNum);
-    return jobNum;
+    d->messageSent(msgId, job.jobNum);
+    return true;
 }
 
 int Speaker::findJobNumByAppId(const QString& appId) const
@@ -499,7 +1791,42 @@ void Speaker::requestExit()
 
 bool Speaker::isSpeaking()
 {
-    return true; // TODO: ask speech-dispatcher somehow?
+    foreach (const LiveJob &job, d->liveJobs)
+    {
+        if (job.state == KSpeech::jsSpeaking)
+            return true;
+    }
+    return false;
+}
+
+SpeechJob* Speaker::jobObject(int jobNum)
+{
+    QHash<int, LiveJob>::iterator it = d->liveJobs.find(jobNum);
+    if (it == d->liveJobs.end())
+        return 0;
+    if (!it->job)
+    {
+        it->job = new SpeechJob(it->priority);
+        it->job->setJobNum(jobNum);
+        it->job->setAppId(it->appId);
+        it->job->setState(it->state);
+        if (it->bySentence)
+        {
+            it->job->setSentenceCount(it->text.sentenceCount());
+            it->job->setSentenceNum(it->sentenceNum + 1);
+        }
+    }
+    return it->job;
+}
+
+int Speaker::jobState(int jobNum) const
+{
+    QHash<int, LiveJob>::const_iterator it = d->liveJobs.constFind(jobNum);
+    if (it != d->liveJobs.constEnd())
+        return it->state;
+    if (jobNum > 0 && jobNum <= d->lastJobNum)
+        return KSpeech::jsFinished;
+    return -1;
 }
 
 void Speaker::setTalker(int jobNum, const QString &talker)
@@ -557,10 +1884,9 @@ QStringList Speaker::getPossibleTalkers()
 
 void Speaker::setSpeed(int speed)
 {
-    if (d->connection) {
+    if (d->connection)
         spd_set_voice_rate(d->connection, speed);
-        d->currentTalker.setRate(speed);
-    }
+    d->currentTalker.setRate(speed);
 }
 
 int Speaker::speed()
@@ -570,10 +1896,9 @@ int Speaker::speed()
 
 void Speaker::setPitch(int pitch)
 {
-    if (d->connection) {
+    if (d->connection)
         spd_set_voice_pitch(d->connection, pitch);
-        d->currentTalker.setPitch(pitch);
-    }
+    d->currentTalker.setPitch(pitch);
 }
 
 int Speaker::pitch()
@@ -583,10 +1908,9 @@ int Speaker::pitch()
 
 void Speaker::setVolume(int volume)
 {
-    if (d->connection) {
+    if (d->connection)
         spd_set_volume(d->connection, volume);
-        d->currentTalker.setVolume(volume);
-    }
+    d->currentTalker.setVolume(volume);
 }
 
 int Speaker::volume()
@@ -598,9 +1922,9 @@ void Speaker::setOutputModule(const QString & module)
 {
     if (d->connection) {
         int result = spd_set_output_module(d->connection, module.toUtf8().data());
-        d->currentTalker.setOutputModule(module);
         // discard result for now, TODO: add error reporting
     }
+    d->currentTalker.setOutputModule(module);
 }
 
 QString Speaker::outputModule()
@@ -612,8 +1936,8 @@ void Speaker::setVoiceName(const QString & voiceName)
 {
     if (d->connection) {
         int result = spd_set_synthesis_voice(d->connection, voiceName.toUtf8().data());
-        d->currentTalker.setVoiceName(voiceName);
     }
+    d->currentTalker.setVoiceName(voiceName);
 }
 
 QString Speaker::voiceName()
@@ -623,13 +1947,91 @@ QString Speaker::voiceName()
 
 bool Speaker::reconnect()
 {
-    return d->reconnect();
+    if (d->connectWatcher.isRunning())
+        return false;
+    d->reconnectTimer.stop();
+    if (d->connection)
+        spd_close(d->connection);
+    d->connection = NULL;
+    d->forgetSpeechdJobs();
+    d->reconnectDelay = MinReconnectDelay;
+    d->startConnect();
+    return true;
+}
+
+void Speaker::slotReconnect()
+{
+    kDebug() << "trying to reconnect to speech dispatcher";
+    d->startConnect();
+}
+
+void Speaker::slotConnectFinished()
+{
+    SpeechdConnection result = d->connectWatcher.result();
+    if (result.connection == NULL)
+    {
+        // replace this with an error stored in kttsd in a log? to be viewed on hover over kttsmgr?
+        kError() << "could not get a connection to speech-dispatcher" << endl;
+        d->scheduleReconnect();
+        return;
+    }
+    d->connection = result.connection;
+    d->outputModules = result.outputModules;
+    d->reconnectDelay = MinReconnectDelay;
+    // speech-dispatcher does not know our settings on a new connection.
+    applyTalker(d->currentTalker);
+    flushSpool();
+    speakNextSentence();
+}
+
+void Speaker::flushSpool()
+{
+    if (d->spool.isEmpty())
+        return;
+    kDebug() << "flushing " << d->spool.count() << " spooled jobs";
+
+    // Most important jobs first, arrival order within a priority.
+    QList<SpooledJob> pending;
+    for (int priority = KSpeech::jpScreenReaderOutput; priority <= KSpeech::jpProgress; ++priority)
+    {
+        foreach (const SpooledJob &job, d->spool)
+        {
+            if (job.priority == priority)
+                pending.append(job);
+        }
+    }
+    d->spool.clear();
+
+    TalkerCode talker = d->currentTalker;
+    while (!pending.isEmpty())
+    {
+        SpooledJob job = pending.first();
+        if (job.talker != d->currentTalker)
+            applyTalker(job.talker);
+        int msgId = -1;
+        if (d->connection != NULL)
+            msgId = d->sayToSpeechd(spdPriority(job.priority), job.sayOptions, job.text.constData());
+        if (msgId == -1)
+        {
+            // Lost it again; keep the rest for the next attempt.
+            d->spool = pending;
+            if (d->connection != NULL)
+                d->connectionLost();
+            return;
+        }
+        d->messageSent(msgId, job.jobNum);
+        pending.removeFirst();
+    }
+    if (talker != d->currentTalker)
+        applyTalker(talker);
 }
 
 void Speaker::setPunctuationType(int punctuation)
 {
-    if(d->connection && punctuation >= SPD_PUNCT_ALL && punctuation <= SPD_PUNCT_SOME){
-        int result = spd_set_punctuation(d->connection, SPDPunctuation(punctuation));
+    if(punctuation >= SPD_PUNCT_ALL && punctuation <= SPD_PUNCT_SOME){
+        if (d->connection)
+            spd_set_punctuation(d->connection, SPDPunctuation(punctuation));
+        d->currentTalker.setPunctuation(punctuation);
     }
 }
 
@@ -638,9 +2040,9 @@ void Speaker::setLanguage(const QString & language)
 {
     if (d->connection) {
         int result = spd_set_language(d->connection, language.toUtf8().data());
-        d->currentTalker.setLanguage(language);
         // discard result for now, TODO: add error reporting
     }
+    d->currentTalker.setLanguage(language);
 }
 
 QString Speaker::language()
@@ -652,10 +2054,9 @@ void Speaker::setVoiceType(int voiceType)
 {
     if (d->connection) {
         int result = spd_set_voice_type(d->connection, SPDVoiceType(voiceType));
-        d->currentTalker.setVoiceType(voiceType);
         // discard result for now, TODO: add error reporting
-
     }
+    d->currentTalker.setVoiceType(voiceType);
 }
 
 
@@ -666,6 +2067,15 @@ int Speaker::voiceType()
 
 void Speaker::stop()
 {
+    // A text job being spoken goes away with its sentence.  Any other cancel
+    // of a sentence means a more important message interrupted it.
+    QHash<int, LiveJob>::iterator it = d->liveJobs.find(currentTextJob());
+    if (it != d->liveJobs.end() && it->sentenceBegun)
+    {
+        d->setJobState(currentTextJob(), KSpeech::jsDeleted);
+        speakNextSentence();
+        return;
+    }
     if (d->connection)
         spd_stop(d->connection);
     else
@@ -674,6 +2084,13 @@ void Speaker::stop()
 
 void Speaker::cancel()
 {
+    QList<SpooledJob> spool = d->spool;
+    d->spool.clear();
+    foreach (const SpooledJob &job, spool)
+        d->setJobState(job.jobNum, KSpeech::jsDeleted);
+    QList<int> textQueue = d->textQueue;
+    foreach (int jobNum, textQueue)
+        d->setJobState(jobNum, KSpeech::jsDeleted);
     if (d->connection)
         spd_cancel(d->connection);
     else
@@ -701,8 +2118,102 @@ bool Speaker::isApplicationPaused(const QString& appId)
     return getAppData(appId)->isApplicationPaused();
 }
 
+void Speaker::slotSpeechdEvent(int msgId, int type)
+{
+    if (d->staleMsgIds.contains(msgId))
+    {
+        // A sentence that was taken back must not be heard.
+        if (type == SPD_EVENT_BEGIN || type == SPD_EVENT_RESUME)
+        {
+            if (d->connection)
+                spd_stop(d->connection);
+        }
+        else if (type == SPD_EVENT_END || type == SPD_EVENT_CANCEL)
+            d->staleMsgIds.remove(msgId);
+        return;
+    }
+    QHash<int, int>::iterator it = d->jobNumByMsgId.find(msgId);
+    if (it == d->jobNumByMsgId.end())
+        return;
+    int jobNum = it.value();
+    QHash<int, LiveJob>::iterator job = d->liveJobs.find(jobNum);
+    const bool bySentence = job != d->liveJobs.end() && job->bySentence;
+    switch (type)
+    {
+        case SPD_EVENT_BEGIN:
+            if (bySentence)
+            {
+                job->sentenceBegun = true;
+                if (job->job)
+                    job->job->emitMarker(KSpeech::mtSentenceBegin, QString::number(job->sentenceNum + 1));
+            }
+            d->setJobState(jobNum, KSpeech::jsSpeaking);
+            break;
+        case SPD_EVENT_RESUME:
+            d->setJobState(jobNum, KSpeech::jsSpeaking);
+            break;
+        case SPD_EVENT_PAUSE:
+            d->setJobState(jobNum, KSpeech::jsPaused);
+            break;
+        case SPD_EVENT_END:
+            d->jobNumByMsgId.erase(it);
+            if (bySentence)
+            {
+                if (job->job)
+                    job->job->emitMarker(KSpeech::mtSentenceEnd, QString::number(job->sentenceNum + 1));
+                job->sentenceMsgId = -1;
+                job->sentenceBegun = false;
+                ++job->sentenceNum;
+                speakNextSentence();
+                break;
+            }
+            if (job != d->liveJobs.end())
+                --job->messages;
+            d->finishIfDone(jobNum);
+            break;
+        case SPD_EVENT_CANCEL:
+            d->jobNumByMsgId.erase(it);
+            if (bySentence)
+            {
+                // speech-dispatcher drops text when something more important
+                // comes along.  Keep the place and go on from the same
+                // sentence once the interruption is over.
+                job->sentenceMsgId = -1;
+                job->sentenceBegun = false;
+                d->setJobState(jobNum, KSpeech::jsInterrupted);
+                kDebug() << "job " << jobNum << " interrupted at sentence " << job->sentenceNum + 1;
+                if (!d->hasInterruptingJobs())
+                    d->resumeTimer.start(ResumeDelay);
+                break;
+            }
+            d->setJobState(jobNum, KSpeech::jsDeleted);
+            break;
+        default:
+            break;
+    }
+}
+
+void Speaker::slotResumeInterrupted()
+{
+    const int jobNum = currentTextJob();
+    if (jobNum == 0 || jobState(jobNum) != KSpeech::jsInterrupted)
+        return;
+    kDebug() << "resuming interrupted job " << jobNum;
+    d->setJobState(jobNum, KSpeech::jsSpeakable);
+    speakNextSentence();
+}
+
 void Speaker::slotServiceUnregistered(const QString& serviceName)
 {
     if (d->appData.contains(serviceName))
         d->appData[serviceName]->setUnregistered(true);
+    // Template ids of the application mean nothing any more.
+    QHash<int, MessageTemplate>::iterator it = d->templates.begin();
+    while (it != d->templates.end())
+    {
+        if (it->appId == serviceName)
+            it = d->templates.erase(it);
+        else
+            ++it;
+    }
 }
@@ -32,6 +32,8 @@
 #include <QtCore/QObject>
 #include <QtCore/QList>
 #include <QtCore/QEvent>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QFuture>
 
 #include <kspeech.h>
 
@@ -47,17 +49,11 @@
 #include "appdata.h"
 #include "speechjob.h"
 
-/**
- * Struct used to keep a pool of FilterMgr objects.
- */
-//struct PooledFilterMgr {
-//    FilterMgr* filterMgr;       /* The FilterMgr object. */
-//    bool busy;                  /* True if the FilterMgr is busy. */
-//    SpeechJob* job;             /* The job the FilterMgr is filtering. */
-//    TalkerCode* talkerCode;     /* TalkerCode object passed to FilterMgr. */
-//};
-
+class QFile;
 class SpeakerPrivate;
+struct SpooledJob;
+struct BackgroundFilter;
+struct StreamState;
 
 /**
  * @class Speaker
@@ -84,7 +80,8 @@ public:
     ~Speaker();
 
     /**
-    * (re)initializes the filtermgr
+    * (re)initializes the filtermgr.  The filter plugins are loaded in the
+    * background.
     */
     void init();
 
@@ -100,6 +97,24 @@ public:
     */
     bool isSpeaking();
 
+    /**
+    * Get the state of a job.
+    * @param jobNum         Job number of the job.
+    * @return               A KSpeech::JobState.  Jobs that are no longer
+    *                       queued or speaking report jsFinished.  -1 if no
+    *                       such job was ever given out.
+    */
+    int jobState(int jobNum) const;
+
+    /**
+    * Get the object for a job that is still queued or speaking, creating it
+    * on first use.  The object follows the job's state and is deleted
+    * (deleteLater) once the job is finished or deleted.
+    * @param jobNum         Job number of the job.
+    * @return               The job object, or 0 if the job has ended.
+    */
+    SpeechJob* jobObject(int jobNum);
+
     /**
     * Get application data.
     * If this is a new application, a new AppData object is created and initialized
@@ -126,6 +141,144 @@ public:
     */
     int say(const QString& appId, const QString& text, int sayOptions);
 
+    /**
+    * Same as @ref say for UTF-8 text, typically a mapped file.
+    * @param appId          The DBUS senderId of the application.
+    * @param text           The text to be spoken, in UTF-8.
+    * @param sayOptions     Option flags.  @see SayOptions.
+    * @param mapping        File whose mapped memory holds @p text.  It is
+    *                       kept until the text has been filtered, so the
+    *                       file must be sealed against shrinking; see
+    *                       isSealedFile().  If null,
+    *                       the text is copied if it is needed after the call.
+    *
+    * Long plain texts are decoded, filtered and split into sentences a piece
+    * at a time by a worker thread, so no decoded copy of the whole text is
+    * made.
+    */
+    int sayUtf8(const QString& appId, const QByteArray& text, int sayOptions,
+                const QSharedPointer<QFile>& mapping = QSharedPointer<QFile>());
+
+    /**
+    * Registers a message text that the application speaks often with
+    * different arguments.
+    * @param appId          The DBUS senderId of the application.
+    * @param text           The text, with placeholders %1 to %99 as in
+    *                       QString::arg.
+    * @return               Template id, or 0 if the text is empty.  The
+    *                       same text registered again gets the same id.
+    *
+    * The parts of the text between placeholders are filtered once, the first
+    * time the template is spoken, and only the arguments are filtered after
+    * that.  Each part is filtered on its own, so filter rules should not
+    * need to see across a placeholder.
+    */
+    int registerTemplate(const QString& appId, const QString& text);
+
+    /**
+    * Forgets a template.
+    * @return               False if the application has no such template.
+    */
+    bool removeTemplate(const QString& appId, int templateId);
+
+    /**
+    * Speaks a template with its placeholders replaced by arguments, like
+    * @ref say.
+    * @param appId          The DBUS senderId of the application.
+    * @param templateId     Id returned by @ref registerTemplate.
+    * @param args           Arguments; %1 is the first.  Missing arguments
+    *                       are left empty.
+    * @param sayOptions     Option flags.  Templates with markup are filtered
+    *                       as a whole each time.
+    * @return               Job number, or 0 if there is no such template.
+    */
+    int sayTemplate(const QString& appId, int templateId, const QStringList& args, int sayOptions);
+
+    /**
+    * Runs texts through the filters without speaking them.
+    * @param texts          Texts to filter, each on its own.
+    * @param appId          Application id the filters should see.
+    * @param talker         Talker code the filters should see.  If empty,
+    *                       the current talker.
+    * @return               The filtered texts, in the same order, once
+    *                       worker threads have run them through the filter
+    *                       pool.
+    *
+    * The filters are applied whether or not the application has filtering
+    * turned on.
+    */
+    QFuture<QStringList> filterTexts(const QStringList& texts, const QString& appId, const QString& talker);
+
+    /**
+    * Start a job whose plain text arrives in pieces.
+    * @param appId          The DBUS senderId of the application.
+    * @return               Job number.
+    *
+    * The job is given the applications current defaultPriority.  Text added
+    * with @ref appendText is split into sentences as it arrives; each sentence
+    * is filtered and spoken as soon as it is complete.
+    */
+    int openStream(const QString& appId);
+
+    /**
+    * Add text to an open stream.
+    * @param jobNum         Job number returned by @ref openStream.
+    * @param text           More text.  May end in the middle of a sentence.
+    * @return               False if there is no such open stream, or it was
+    *                       cancelled.
+    */
+    bool appendText(int jobNum, const QString& text);
+
+    /**
+    * Close a stream.  Text after the last sentence delimiter is spoken as the
+    * final sentence, and the job finishes once everything has been spoken.
+    * @param jobNum         Job number returned by @ref openStream.
+    */
+    void closeStream(int jobNum);
+
+    /**
+    * Number of sentences in a text job.  Plain text jobs of priority jpText
+    * are spoken sentence by sentence from an index over their filtered text.
+    * @param jobNum         Job number of the job.
+    * @return               Number of sentences, or 0 if the job is not a
+    *                       text job or has ended.
+    */
+    int sentenceCount(int jobNum) const;
+
+    /**
+    * Get a sentence of a text job.
+    * @param jobNum         Job number of the job.
+    * @param sentenceNum    Sentence number.  The first sentence is 1.
+    * @return               The filtered sentence, or an empty string.
+    */
+    QString jobSentence(int jobNum, int sentenceNum) const;
+
+    /**
+    * Job number of the text job being spoken, or next to be spoken.
+    * @return               Job number, or 0 if there are no text jobs.
+    */
+    int currentTextJob() const;
+
+    /**
+    * Advance or rewind a text job.  Speech continues from the start of the
+    * sentence moved to, without filtering the job again.
+    * @param jobNum         Job number of the job.
+    * @param n              Number of sentences to move forward (positive) or
+    *                       back (negative).  0 does not move.
+    * @return               Number of the sentence moved to, or the current
+    *                       sentence if n is 0.  The first sentence is 1.
+    *                       0 if the job is not a text job.
+    */
+    int moveRelSentence(int jobNum, int n);
+
+    /**
+    * Move a text job after the next text job.  If it was being spoken, the
+    * next job starts, and the moved job later continues from the sentence
+    * it was on.
+    * @param jobNum         Job number of the job.
+    */
+    void moveJobLater(int jobNum);
+
     /**
     * Change the talker for a job.
     * @param jobNum         Job number of the job.
@@ -209,6 +362,11 @@ public:
     QString language();
     int voiceType();
     QString voiceName();
+
+    /**
+    * Drops the connection to speech-dispatcher and opens a new one in the
+    * background.  Returns false if a connection attempt is already running.
+    */
     bool reconnect();
 signals:
     /**
@@ -219,15 +377,171 @@ signals:
      */
     void newJobFiltered(const QString &prefilterText, const QString &postfilterText);
 
+    /**
+     * This signal is emitted each time the state of a job changes.
+     * @param appId             The DBUS senderId of the application that submitted the job.
+     * @param jobNum            Job Number.
+     * @param state             Job state.
+     */
+    void jobStateChanged(const QString &appId, int jobNum, KSpeech::JobState state);
+
 private slots:
     void slotServiceUnregistered(const QString& serviceName);
 
+    /**
+    * Adds text filtered by a worker thread to its job.  The last call for a
+    * job, with @p last set, also marks the job complete.
+    */
+    void slotBackgroundFiltered(int jobNum, const QString& text, const QString& talkerCode, bool last);
+
+    /**
+    * Attempts to reconnect to speech-dispatcher.  On failure the next attempt is
+    * scheduled with a longer delay; on success the talker settings are re-applied
+    * and spooled jobs are handed over.
+    */
+    void slotReconnect();
+
+    /**
+    * Takes over the connection opened in the background, or schedules another
+    * attempt if it failed.
+    */
+    void slotConnectFinished();
+
+    /**
+    * Handles a notification from speech-dispatcher, delivered to the main
+    * thread by speechdCallback.
+    */
+    void slotSpeechdEvent(int msgId, int type);
+
+    /**
+    * Continues an interrupted text job from the sentence it was on.  The
+    * text was filtered before, so this costs one message.
+    */
+    void slotResumeInterrupted();
+
+    /**
+    * Filters and queues the jobs that arrived while the filters were
+    * loading, or starts another load if the configuration changed meanwhile.
+    */
+    void slotFiltersLoaded();
+
 private:
     /**
     * Constructor.
     */
     Speaker();
 
+    /**
+    * Maps a KSpeech job priority to the speech-dispatcher message priority.
+    */
+    static SPDPriority spdPriority(KSpeech::JobPriority priority);
+
+    /**
+    * Sends all the settings of a talker to speech-dispatcher.
+    */
+    void applyTalker(const TalkerCode &talkerCode);
+
+    /**
+    * Hands spooled jobs to speech-dispatcher, most important first.
+    */
+    void flushSpool();
+
+    /**
+    * Hands a job, or a part of one, to speech-dispatcher, or spools it while
+    * there is no connection.  Returns false if the spool refused it.
+    */
+    bool submitJob(const SpooledJob& job);
+
+    /**
+    * Runs text through the filters, if the application wants that, and
+    * switches to the talker they chose.
+    */
+    QString prepareText(const QString& text, const QString& appId);
+
+    /**
+    * Queues filtered text as a new job of the application, spoken by
+    * sentence or handed to speech-dispatcher as one message depending on
+    * its priority.  Returns the job number, or 0.
+    * @param jobNum         Number of a job handed out by
+    *                       @ref sayWhenFiltersLoaded, or 0 for a new job.
+    */
+    int queueJob(const QString& appId, int sayOptions, const QString& filteredText, int jobNum = 0);
+
+    /**
+    * Hands out a job for a text that arrived before the filters were loaded.
+    * It waits in jsFiltering until @ref slotFiltersLoaded queues it, so the
+    * event loop does not wait for the load.  Returns the job number.
+    */
+    int sayWhenFiltersLoaded(const QString& appId, const QString& text, int sayOptions);
+
+    /**
+    * Creates an empty text job of the application, queued for sentence by
+    * sentence speech, and returns its number.  Text is added with
+    * @ref appendJobText until @ref closeTextJob.
+    */
+    int openTextJob(const QString& appId);
+
+    /**
+    * Marks a text job opened with @ref openTextJob as complete and starts
+    * speaking it if it is first in line.
+    */
+    void closeTextJob(int jobNum);
+
+    /**
+    * Sets up a background filter for a long plain text of the application.
+    */
+    BackgroundFilter* newBackgroundFilter(const QString& appId);
+
+    /**
+    * Queues a text job and has a worker thread filter its text, which
+    * @ref slotBackgroundFiltered adds to the job sentence by sentence.
+    * Takes over @p filter.  Returns the job number.
+    */
+    int sayInBackground(BackgroundFilter* filter);
+
+    /**
+    * Runs in a worker thread.  Leases a FilterMgr from the pool and filters
+    * the text of a job, in pieces if all filters support streaming.
+    */
+    void filterInBackground(int jobNum, QSharedPointer<BackgroundFilter> filter);
+
+    /**
+    * Runs in a worker thread.  Filters a very long text with the filters
+    * that support splitting running over parts of it on all cores, and the
+    * others over the whole text.
+    */
+    void filterInParallel(int jobNum, QSharedPointer<BackgroundFilter> filter);
+
+    /**
+    * Runs in a worker thread.  Filters the text of @p filter as
+    * @ref filterInParallel does and returns it.  If @p jobNum is not 0, the
+    * parts that all filters ran over go to that job as they are done and
+    * only the rest is returned.
+    */
+    QString convertInParallel(BackgroundFilter* filter, int jobNum);
+
+    /**
+    * Runs in a worker thread for @ref filterTexts.  Long texts are filtered
+    * in parallel.
+    */
+    QStringList filterTextsInBackground(const QStringList& texts, const StreamState& state);
+
+    /**
+    * Adds filtered text to a text job and indexes its sentences.
+    */
+    void appendJobText(int jobNum, const QString& filteredText, const TalkerCode& talker);
+
+    /**
+    * Hands the next sentence of the first text job to speech-dispatcher,
+    * unless one is there already.  Finishes jobs that have run out of text.
+    */
+    void speakNextSentence();
+
+    /**
+    * Filters and speaks one sentence of an open stream.
+    */
+    bool speakStreamText(int jobNum, const QString& text);
+
     /**
     * Determines whether the given text is SSML markup.
     */
@@ -243,6 +557,7 @@ private:
     QStringList parseText(const QString &text, const QString &appId);
 
 private:
+    friend class SpeakerPrivate;
     SpeakerPrivate* const d;
     static Speaker * m_instance;
 };
@@ -0,0 +1,148 @@
+/*************************************************** vim:set ts=4 sw=4 sts=4:
+  This class contains a single speech job.
+  -------------------
+  Copyright:
+  (C) 2006 by Gary Cramblitt <garycramblitt@comcast.net>
+  -------------------
+  Original author: Gary Cramblitt <garycramblitt@comcast.net>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+// SpeechJob includes.
+#include "speechjob.h"
+#include "speechjob.moc"
+
+// Qt includes.
+#include <QtCore/QDataStream>
+
+// KDE includes.
+#include <klocale.h>
+
+/* -------------------------------------------------------------------------- */
+
+class SpeechJobPrivate
+{
+public:
+    SpeechJobPrivate(KSpeech::JobPriority priority) :
+        jobNum(0),
+        jobPriority(priority),
+        state(KSpeech::jsQueued),
+        sentenceCount(0),
+        sentenceNum(0),
+        seq(0),
+        refCount(0) {}
+
+    friend class SpeechJob;
+
+protected:
+    int jobNum;
+    QString appId;
+    KSpeech::JobPriority jobPriority;
+    QString talker;
+    KSpeech::JobState state;
+    QStringList sentences;
+    int sentenceCount;
+    int sentenceNum;
+    int seq;
+    int refCount;
+};
+
+/* -------------------------------------------------------------------------- */
+
+SpeechJob::SpeechJob(KSpeech::JobPriority priority) :
+    QObject(0),
+    d(new SpeechJobPrivate(priority))
+{
+}
+
+SpeechJob::~SpeechJob()
+{
+    delete d;
+}
+
+int SpeechJob::jobNum() const { return d->jobNum; }
+void SpeechJob::setJobNum(int jobNum) { d->jobNum = jobNum; }
+QString SpeechJob::appId() const { return d->appId; }
+void SpeechJob::setAppId(const QString &appId) { d->appId = appId; }
+KSpeech::JobPriority SpeechJob::jobPriority() const { return d->jobPriority; }
+void SpeechJob::setJobPriority(KSpeech::JobPriority jobPriority) { d->jobPriority = jobPriority; }
+QString SpeechJob::talker() const { return d->talker; }
+void SpeechJob::setTalker(const QString &talker) { d->talker = talker; }
+KSpeech::JobState SpeechJob::state() const { return d->state; }
+QStringList SpeechJob::sentences() const { return d->sentences; }
+void SpeechJob::setSentences(const QStringList &sentences)
+{
+    d->sentences = sentences;
+    d->sentenceCount = sentences.count();
+}
+int SpeechJob::sentenceCount() const { return d->sentenceCount; }
+void SpeechJob::setSentenceCount(int sentenceCount) { d->sentenceCount = sentenceCount; }
+int SpeechJob::sentenceNum() const { return d->sentenceNum; }
+void SpeechJob::setSentenceNum(int sentenceNum) { d->sentenceNum = sentenceNum; }
+int SpeechJob::seq() const { return d->seq; }
+void SpeechJob::setSeq(int seq) { d->seq = seq; }
+int SpeechJob::refCount() const { return d->refCount; }
+void SpeechJob::incRefCount() { ++d->refCount; }
+void SpeechJob::decRefCount() { --d->refCount; }
+
+void SpeechJob::setState(KSpeech::JobState state)
+{
+    if (d->state == state)
+        return;
+    d->state = state;
+    emit jobStateChanged(d->appId, d->jobNum, state);
+}
+
+void SpeechJob::emitMarker(KSpeech::MarkerType markerType, const QString& markerData)
+{
+    emit marker(d->appId, d->jobNum, markerType, markerData);
+}
+
+QString SpeechJob::getNextSentence()
+{
+    if (d->sentenceNum >= d->sentences.count())
+        return QString();
+    return d->sentences[d->sentenceNum++];
+}
+
+QByteArray SpeechJob::serialize() const
+{
+    QByteArray temp;
+    QDataStream stream(&temp, QIODevice::WriteOnly);
+    stream << (qint32)d->jobPriority;
+    stream << (qint32)d->state;
+    stream << d->appId;
+    stream << d->talker;
+    stream << (qint32)d->sentenceNum;
+    stream << (qint32)sentenceCount();
+    return temp;
+}
+
+/*static*/ QString SpeechJob::jobStateToStr(KSpeech::JobState state)
+{
+    switch (state)
+    {
+        case KSpeech::jsQueued:      return i18n("Queued");
+        case KSpeech::jsFiltering:   return i18n("Filtering");
+        case KSpeech::jsSpeakable:   return i18n("Waiting");
+        case KSpeech::jsSpeaking:    return i18n("Speaking");
+        case KSpeech::jsPaused:      return i18n("Paused");
+        case KSpeech::jsInterrupted: return i18n("Interrupted");
+        case KSpeech::jsFinished:    return i18n("Finished");
+        case KSpeech::jsDeleted:     return i18n("Deleted");
+    }
+    return QString();
+}
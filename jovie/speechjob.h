@@ -25,8 +25,10 @@
 #define SPEECHJOB_H
 
 // Qt includes.
+#include <QtCore/QObject>
 #include <QtCore/QList>
 #include <QtCore/QByteArray>
+#include <QtCore/QStringList>
 
 // KDE includes.
 #include <kspeech.h>
@@ -76,8 +78,10 @@ public:
     /** List of sentences in the job. */
     QStringList sentences() const;
     void setSentences(const QStringList &sentences);
-    /** Count of sentences in the job. */
+    /** Count of sentences in the job.  Set along with the sentences, or on
+        its own when the sentences are kept elsewhere. */
     int sentenceCount() const;
+    void setSentenceCount(int sentenceCount);
     /** Current sentence begin spoken.
         The first sentence is at 1, so if 0, not speaking. */
     int sentenceNum() const;
@@ -141,6 +145,13 @@ public:
     
 Q_SIGNALS:
     void jobStateChanged(const QString& appId, int jobNum, KSpeech::JobState state);
+    void marker(const QString& appId, int jobNum, KSpeech::MarkerType markerType, const QString& markerData);
+
+public:
+    /**
+     * Emits a marker for this job.
+     */
+    void emitMarker(KSpeech::MarkerType markerType, const QString& markerData);
     
 private:
     SpeechJobPrivate* d;
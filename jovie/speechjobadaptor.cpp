@@ -0,0 +1,56 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  D-Bus adaptor exporting a SpeechJob as org.kde.KSpeechJob.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#include "speechjobadaptor.h"
+#include "speechjobadaptor.moc"
+
+#include "speechjob.h"
+
+SpeechJobAdaptor::SpeechJobAdaptor(SpeechJob *job) :
+    QDBusAbstractAdaptor(job),
+    m_job(job)
+{
+    connect(job, SIGNAL(jobStateChanged(QString,int,KSpeech::JobState)),
+        this, SLOT(slotJobStateChanged(QString,int,KSpeech::JobState)));
+    connect(job, SIGNAL(marker(QString,int,KSpeech::MarkerType,QString)),
+        this, SLOT(slotMarker(QString,int,KSpeech::MarkerType,QString)));
+}
+
+/*static*/ QString SpeechJobAdaptor::path(int jobNum)
+{
+    return QString::fromLatin1("/org/kde/KSpeechJob_%1").arg(jobNum);
+}
+
+int SpeechJobAdaptor::jobNum() const { return m_job->jobNum(); }
+QString SpeechJobAdaptor::appId() const { return m_job->appId(); }
+int SpeechJobAdaptor::jobPriority() const { return m_job->jobPriority(); }
+int SpeechJobAdaptor::state() const { return m_job->state(); }
+int SpeechJobAdaptor::sentenceNum() const { return m_job->sentenceNum(); }
+int SpeechJobAdaptor::sentenceCount() const { return m_job->sentenceCount(); }
+
+void SpeechJobAdaptor::slotJobStateChanged(const QString &/*appId*/, int /*jobNum*/, KSpeech::JobState state)
+{
+    emit stateChanged(state);
+}
+
+void SpeechJobAdaptor::slotMarker(const QString &/*appId*/, int /*jobNum*/, KSpeech::MarkerType markerType,
+    const QString &markerData)
+{
+    emit marker(markerType, markerData);
+}
@@ -0,0 +1,92 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  D-Bus adaptor exporting a SpeechJob as org.kde.KSpeechJob.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef SPEECHJOBADAPTOR_H
+#define SPEECHJOBADAPTOR_H
+
+// Qt includes.
+#include <QtDBus/QDBusAbstractAdaptor>
+
+// KDE includes.
+#include <kspeech.h>
+
+class SpeechJob;
+
+/**
+ * @class SpeechJobAdaptor
+ *
+ * Exports one job at /org/kde/KSpeechJob_NN.  Applications that only care
+ * about their own jobs listen here instead of to the broadcast signals on
+ * /KSpeech:
+ *
+ * @verbatim
+     QDBusConnection::sessionBus().connect("org.kde.KSpeech", "/org/kde/KSpeechJob_12",
+         "org.kde.KSpeechJob", "stateChanged", this, SLOT(slotStateChanged(int)));
+   @endverbatim
+ *
+ * The object goes away once the job is finished or deleted, right after the
+ * last stateChanged signal.
+ */
+class SpeechJobAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.KSpeechJob")
+
+    Q_PROPERTY(int jobNum READ jobNum)
+    Q_PROPERTY(QString appId READ appId)
+    Q_PROPERTY(int jobPriority READ jobPriority)
+    Q_PROPERTY(int state READ state)
+    Q_PROPERTY(int sentenceNum READ sentenceNum)
+    Q_PROPERTY(int sentenceCount READ sentenceCount)
+
+public:
+    explicit SpeechJobAdaptor(SpeechJob *job);
+
+    /**
+     * The object path a job is exported at.
+     */
+    static QString path(int jobNum);
+
+    int jobNum() const;
+    QString appId() const;
+    int jobPriority() const;
+    int state() const;
+    int sentenceNum() const;
+    int sentenceCount() const;
+
+Q_SIGNALS:
+    /**
+     * The job changed state.  @see KSpeech::JobState.
+     */
+    void stateChanged(int state);
+
+    /**
+     * The job reached a marker.  @see KSpeech::MarkerType.
+     */
+    void marker(int markerType, const QString &markerData);
+
+private Q_SLOTS:
+    void slotJobStateChanged(const QString &appId, int jobNum, KSpeech::JobState state);
+    void slotMarker(const QString &appId, int jobNum, KSpeech::MarkerType markerType, const QString &markerData);
+
+private:
+    SpeechJob *m_job;
+};
+
+#endif      // SPEECHJOBADAPTOR_H
@@ -0,0 +1,179 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Chooses a talker for a text by all TalkerChooser rules at once.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#include "talkerclassifier.h"
+
+// Qt includes.
+#include <QtCore/QRegExp>
+
+// KDE includes.
+#include <kdebug.h>
+
+void TalkerClassifier::clear()
+{
+    m_rules.clear();
+    m_matchers.clear();
+}
+
+void TalkerClassifier::addRule(const QString& pattern, const QStringList& appIds, const TalkerCode& talkerCode)
+{
+    Rule rule;
+    rule.pattern = pattern;
+    rule.appIds = appIds;
+    rule.talkerCode = talkerCode;
+    if (!pattern.isEmpty())
+        rule.regExp = FilterRegExp(pattern);
+    // Back references would point at the wrong groups in the alternation.
+    rule.separate = pattern.contains(QRegExp(QLatin1String("\\\\[1-9]")));
+    if (!pattern.isEmpty() && !rule.regExp.isValid())
+        kDebug() << "TalkerClassifier::addRule: invalid regular expression " << pattern;
+    else if (!pattern.isEmpty() && rule.regExp.hazard() != FilterRegExp::NoHazard)
+        kWarning() << "TalkerClassifier::addRule: " << pattern
+            << (rule.regExp.isUsable() ? ": " : ": not used: ") << rule.regExp.warning();
+    m_rules.append(rule);
+    m_matchers.clear();
+}
+
+bool TalkerClassifier::isEmpty() const
+{
+    return m_rules.isEmpty();
+}
+
+bool TalkerClassifier::applies(const Rule& rule, const QString& appId) const
+{
+    if (rule.appIds.isEmpty())
+        return true;
+    foreach (const QString& id, rule.appIds)
+    {
+        if (appId.contains(id))
+            return true;
+    }
+    return false;
+}
+
+TalkerClassifier::Matcher& TalkerClassifier::matcher(const QString& appId)
+{
+    // Applications the same rules apply to share a matcher, so there are
+    // no more matchers than combinations of application ids in the rules,
+    // however many applications come and go.
+    QByteArray key(m_rules.count(), '0');
+    for (int i = 0; i < m_rules.count(); ++i)
+    {
+        if (!applies(m_rules.at(i), appId))
+            continue;
+        key[i] = '1';
+        if (m_rules.at(i).pattern.isEmpty())
+        {
+            key.truncate(i + 1);
+            break;
+        }
+    }
+    QHash<QByteArray, Matcher>::iterator it = m_matchers.find(key);
+    if (it != m_matchers.end())
+        return *it;
+
+    Matcher matcher;
+    QStringList alternatives;
+    int group = 1;
+    for (int i = 0; i < key.size(); ++i)
+    {
+        const Rule& rule = m_rules.at(i);
+        if (key.at(i) != '1')
+            continue;
+        if (rule.pattern.isEmpty())
+        {
+            // Rules after this one can never win.
+            matcher.always = i;
+            break;
+        }
+        if (!rule.regExp.isUsable())
+            continue;
+        if (rule.separate)
+        {
+            matcher.separate.append(i);
+            continue;
+        }
+        alternatives.append(QLatin1Char('(') + rule.pattern + QLatin1Char(')'));
+        matcher.rules.append(i);
+        matcher.groups.append(group);
+        group += 1 + rule.regExp.captureCount();
+    }
+    if (!alternatives.isEmpty())
+        matcher.alternation = FilterRegExp(alternatives.join(QLatin1String("|")));
+    return *m_matchers.insert(key, matcher);
+}
+
+bool TalkerClassifier::classify(const QString& text, const QString& appId, TalkerCode* talkerCode)
+{
+    if (m_rules.isEmpty())
+        return false;
+    Matcher& m = matcher(appId);
+    int best = m.always == -1 ? m_rules.count() : m.always;
+
+    if (!m.rules.isEmpty() && m.rules.first() < best)
+    {
+        int pos = 0;
+        int found;
+        while (pos <= text.length() && (found = m.alternation.indexIn(text, pos)) != -1)
+        {
+            // Which alternative matched here, and does an earlier rule match
+            // at the same place?
+            for (int k = 0; k < m.rules.count() && m.rules.at(k) < best; ++k)
+            {
+                if (m.alternation.pos(m.groups.at(k)) == found ||
+                    m_rules[m.rules.at(k)].regExp.matchesAt(text, found))
+                {
+                    best = m.rules.at(k);
+                    break;
+                }
+            }
+            if (best == m.rules.first())
+                break;
+            pos = found + 1;
+        }
+        if (m.alternation.limitReached())
+        {
+            // Only the rule that takes too long should be lost, so try the
+            // rules one by one.
+            kWarning() << "TalkerClassifier::classify: gave up on the rules together for " << appId;
+            for (int k = 0; k < m.rules.count() && m.rules.at(k) < best; ++k)
+            {
+                if (m_rules[m.rules.at(k)].regExp.indexIn(text) != -1)
+                {
+                    best = m.rules.at(k);
+                    break;
+                }
+                if (m_rules[m.rules.at(k)].regExp.limitReached())
+                    kWarning() << "TalkerClassifier::classify: gave up on " << m_rules[m.rules.at(k)].pattern;
+            }
+        }
+    }
+    foreach (int rule, m.separate)
+    {
+        if (rule >= best)
+            break;
+        if (m_rules[rule].regExp.indexIn(text) != -1)
+            best = rule;
+    }
+
+    if (best == m_rules.count())
+        return false;
+    *talkerCode = m_rules.at(best).talkerCode;
+    return true;
+}
@@ -0,0 +1,105 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Chooses a talker for a text by all TalkerChooser rules at once.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef TALKERCLASSIFIER_H
+#define TALKERCLASSIFIER_H
+
+// Qt includes.
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+
+// KTTS includes.
+#include "filterregexp.h"
+#include "talkercode.h"
+
+/**
+ * @class TalkerClassifier
+ *
+ * Holds the rules of all configured talker choosers and evaluates them
+ * together.  A rule applies to an application if its id contains one of the
+ * rule's application ids, or if the rule has none.  It matches a text if its
+ * regular expression occurs in it, or if it has no regular expression.
+ *
+ * The first rule, in configuration order, that applies and matches chooses
+ * the talker.  The rules that apply to an application are compiled into one
+ * alternation, so the text is scanned once rather than once per rule.
+ * Where the alternation reports a match, the rules before it are checked
+ * at that position only.  Rules whose expression is not usable, see
+ * FilterRegExp::isUsable(), are left out.
+ */
+class TalkerClassifier
+{
+    public:
+        /**
+         * Removes all rules.
+         */
+        void clear();
+
+        /**
+         * Adds a rule after the ones added so far.
+         * @param pattern           Regular expression.  If empty, any text matches.
+         * @param appIds            Application ids.  If empty, any application.
+         * @param talkerCode        Talker chosen by the rule.
+         */
+        void addRule(const QString& pattern, const QStringList& appIds, const TalkerCode& talkerCode);
+
+        /**
+         * Returns True if there are no rules.
+         */
+        bool isEmpty() const;
+
+        /**
+         * Chooses a talker for a text.
+         * @return                  True if a rule matched.  @p talkerCode is
+         *                          only changed then.
+         */
+        bool classify(const QString& text, const QString& appId, TalkerCode* talkerCode);
+
+    private:
+        struct Rule
+        {
+            QString pattern;
+            QStringList appIds;
+            TalkerCode talkerCode;
+            FilterRegExp regExp;
+            bool separate;              /* Has back references; not in the alternation. */
+        };
+
+        // The rules that apply to one application, compiled.
+        struct Matcher
+        {
+            Matcher() : always(-1) { }
+            FilterRegExp alternation;
+            QList<int> rules;           /* Rule of each alternative. */
+            QList<int> groups;          /* Capture group of each alternative. */
+            QList<int> separate;        /* Rules matched on their own. */
+            int always;                 /* First rule without a pattern, or -1. */
+        };
+
+        bool applies(const Rule& rule, const QString& appId) const;
+        Matcher& matcher(const QString& appId);
+
+        QList<Rule> m_rules;
+        // Matchers by the rules that apply, one '1' or '0' per rule.
+        QHash<QByteArray, Matcher> m_matchers;
+};
+
+#endif      // TALKERCLASSIFIER_H
@@ -35,6 +35,7 @@
 
 // KTTS includes.
 #include "talkercode.h"
+#include "configdata.h"
 
 /**
  * @class TalkerMgr
@@ -66,10 +67,10 @@ public:
     QStringList getTalkers();
 
     /**
-     * load the talkers from the given config object
-     * @param c              KConfig object to read configured talkers from
+     * load the talkers from the given configuration snapshot
+     * @param config         ConfigData to take the configured talkers from
      */
-    void loadTalkers(KConfig* c);
+    void loadTalkers(const ConfigDataPtr& config);
 
     /**
      * Given a talker code, returns the parsed TalkerCode of the closest matching Talker.
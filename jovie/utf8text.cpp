@@ -0,0 +1,121 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Fast UTF-8 validation for text read straight from mapped files.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#include "utf8text.h"
+
+// System includes.
+#include <fcntl.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Returns the first byte at or after p that is not ASCII, or end.
+static inline const uchar* skipAscii(const uchar *p, const uchar *end)
+{
+#if defined(__SSE2__)
+    while (end - p >= 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const int mask = _mm_movemask_epi8(chunk);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#else
+    while (end - p >= int(sizeof(quint64)))
+    {
+        quint64 word;
+        memcpy(&word, p, sizeof(word));
+        if (word & Q_UINT64_C(0x8080808080808080))
+            break;
+        p += sizeof(word);
+    }
+#endif
+    while (p < end && *p < 0x80)
+        ++p;
+    return p;
+}
+
+bool isValidUtf8(const char *data, qint64 size)
+{
+    const uchar *p = reinterpret_cast<const uchar*>(data);
+    const uchar *end = p + size;
+    while ((p = skipAscii(p, end)) < end)
+    {
+        const uchar c = *p;
+        int length;
+        uint code;
+        uint minimum;
+        if ((c & 0xe0) == 0xc0)
+        {
+            length = 2;
+            code = c & 0x1f;
+            minimum = 0x80;
+        }
+        else if ((c & 0xf0) == 0xe0)
+        {
+            length = 3;
+            code = c & 0x0f;
+            minimum = 0x800;
+        }
+        else if ((c & 0xf8) == 0xf0)
+        {
+            length = 4;
+            code = c & 0x07;
+            minimum = 0x10000;
+        }
+        else
+            return false;
+        if (end - p < length)
+            return false;
+        for (int i = 1; i < length; ++i)
+        {
+            if ((p[i] & 0xc0) != 0x80)
+                return false;
+            code = (code << 6) | (p[i] & 0x3f);
+        }
+        if (code < minimum || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff))
+            return false;
+        p += length;
+    }
+    return true;
+}
+
+int utf8PieceLength(const char *data, qint64 size, int max)
+{
+    if (size <= max)
+        return int(size);
+    // Back off to the start of the sequence that straddles the limit.
+    int length = max;
+    while (length > 0 && (uchar(data[length]) & 0xc0) == 0x80)
+        --length;
+    return length > 0 ? length : max;
+}
+
+bool isSealedFile(int fd)
+{
+#ifdef F_GET_SEALS
+    const int seals = fcntl(fd, F_GET_SEALS);
+    return seals != -1 && (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)) == (F_SEAL_SHRINK | F_SEAL_WRITE);
+#else
+    Q_UNUSED(fd);
+    return false;
+#endif
+}
@@ -0,0 +1,49 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Fast UTF-8 validation for text read straight from mapped files.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef UTF8TEXT_H
+#define UTF8TEXT_H
+
+// Qt includes.
+#include <QtCore/QtGlobal>
+
+/**
+ * Returns true if @p data is well-formed UTF-8: no stray or missing
+ * continuation bytes, no overlong forms, no surrogates and nothing above
+ * U+10FFFF.  Runs of ASCII are skipped 16 bytes at a time where SSE2 is
+ * available, and a machine word at a time elsewhere.
+ */
+bool isValidUtf8(const char *data, qint64 size);
+
+/**
+ * Returns the length of the longest prefix of @p data, at most @p max bytes,
+ * that does not end inside a UTF-8 sequence.  Used to decode mapped text in
+ * pieces.
+ */
+int utf8PieceLength(const char *data, qint64 size, int max);
+
+/**
+ * Returns true if the file behind @p fd is sealed against shrinking and
+ * writing, as a memfd can be.  Only such a file may stay mapped while a
+ * worker thread decodes it: a mapped file that shrinks gives SIGBUS, and
+ * ordinary files can always shrink.
+ */
+bool isSealedFile(int fd);
+
+#endif      // UTF8TEXT_H
@@ -115,6 +115,16 @@ bool KttsFilterProc::init(KConfig * /*config*/, const QString & /*configGroup*/)
  */
 /*virtual*/ void KttsFilterProc::waitForFinished() { }
 
+/**
+ * Waits at most msecs milliseconds for a previous call to asyncConvert to finish.
+ * The default cannot give up early; it waits as long as waitForFinished does.
+ */
+/*virtual*/ bool KttsFilterProc::waitForFinished(int /*msecs*/)
+{
+    waitForFinished();
+    return true;
+}
+
 /**
  * Returns the state of the Filter.
  */
@@ -150,4 +160,66 @@ bool KttsFilterProc::init(KConfig * /*config*/, const QString & /*configGroup*/)
  */
 /*virtual*/ void KttsFilterProc::setSbRegExp(const QString& /*re*/) { }
 
+/**
+ * Returns True if the plugin can convert a text in pieces,
+ * i.e., supports the @ref feed and @ref flush methods.
+ * @return                  True if this plugin supports streaming.
+ */
+/*virtual*/ bool KttsFilterProc::supportsStreaming() { return false; }
+
+/**
+ * Returns the number of trailing characters of its input the filter may have
+ * to hold back before it can convert the text in front of them.
+ */
+/*virtual*/ int KttsFilterProc::holdback() { return 0; }
+
+/**
+ * Returns True if the filter is keeping text or state from earlier pieces
+ * of the current stream.
+ */
+/*virtual*/ bool KttsFilterProc::isHolding() { return false; }
+
+/**
+ * Returns True if a text may be split at sentence boundaries and the parts
+ * converted independently.
+ * @return                  True if this plugin supports splitting.
+ */
+/*virtual*/ bool KttsFilterProc::supportsSplitting() { return false; }
+
+/**
+ * Returns True if all the filter does is choose a talker by a simple rule,
+ * and describes the rule.
+ */
+/*virtual*/ bool KttsFilterProc::talkerRule(QString* /*pattern*/, QStringList* /*appIds*/,
+    TalkerCode* /*talkerCode*/) { return false; }
+
+/**
+ * Returns True if the filter can only change a text that contains at least
+ * one of some characters, and gives those characters.
+ */
+/*virtual*/ bool KttsFilterProc::firstChars(QString* /*chars*/) { return false; }
+
+/**
+ * Convert the next piece of a stream.
+ * @param chunk             Next piece of input text.
+ * @param talkerCode        TalkerCode structure for the talker that KTTSD intends to
+ *                          use for synthing the text.
+ * @param appId             The DBUS appId of the application that queued the text.
+ * @return                  Converted text that will not change any more.
+ */
+/*virtual*/ QString KttsFilterProc::feed(const QString& chunk, TalkerCode* talkerCode,
+    const QString& appId)
+{
+    return convert(chunk, talkerCode, appId);
+}
+
+/**
+ * Ends a stream.
+ * @return                  Converted text the filter was holding back.
+ */
+/*virtual*/ QString KttsFilterProc::flush(TalkerCode* /*talkerCode*/, const QString& /*appId*/)
+{
+    return QString();
+}
+
 #include "filterproc.moc"
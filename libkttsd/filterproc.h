@@ -28,6 +28,7 @@
 // Qt includes.
 #include <QtCore/QObject>
 #include <QtCore/QVariantList>
+#include <QtCore/QStringList>
 
 // KDE includes.
 #include <kdemacros.h>
@@ -95,6 +96,11 @@ public:
      *                          how to filter the text.  For example, languageCode.
      * @param appId             The DCOP appId of the application that queued the text.
      *                          Also useful for hints about how to do the filtering.
+     *
+     * A filter that leaves the text as it is must return @p inputText itself,
+     * not a modified copy, and return False from @ref wasModified until the
+     * next call.  Most filters do nothing to most texts; this way they do not
+     * cost a copy of the text either.
      */
     virtual QString convert(const QString& inputText, TalkerCode* talkerCode, const QString& appId);
 
@@ -119,6 +125,19 @@ public:
      */
     virtual void waitForFinished();
 
+    /**
+     * Waits at most @p msecs milliseconds for a previous call to asyncConvert
+     * to finish.
+     * @return                  True if filtering finished, False if it is still
+     *                          going on.  The caller may then give up on it with
+     *                          @ref stopFiltering.
+     *
+     * The default waits as long as @ref waitForFinished does.  Plugins that run
+     * external programs should implement it, so that one slow conversion does
+     * not hold up speech.
+     */
+    virtual bool waitForFinished(int msecs);
+
     /**
      * Returns the state of the Filter.
      */
@@ -143,6 +162,9 @@ public:
     /**
      * Did this filter do anything?  If the filter returns the input as output
      * unmolested, it should return False when this method is called.
+     *
+     * Refers to the last call to @ref convert.  The default returns True, since
+     * it cannot tell.
      */
     virtual bool wasModified();
 
@@ -154,6 +176,92 @@ public:
      */
     virtual void setSbRegExp(const QString& re);
 
+    /**
+     * Returns True if the plugin can convert a text in pieces,
+     * i.e., supports the @ref feed and @ref flush methods.
+     * @return                  True if this plugin supports streaming.
+     *
+     * A streaming filter converts as much of each piece as it safely can and
+     * keeps the rest until more text arrives or @ref flush is called.  It never
+     * keeps much more than @ref holdback characters, so a text of any length can
+     * be filtered in constant memory.  A filter handles one stream at a time.
+     */
+    virtual bool supportsStreaming();
+
+    /**
+     * Returns the number of trailing characters of its input the filter may have
+     * to hold back before it can convert the text in front of them.  Typically
+     * this is the length of the longest match the filter looks for.
+     */
+    virtual int holdback();
+
+    /**
+     * Returns True if the filter is keeping text or state from earlier pieces
+     * of the current stream, so the next piece must be fed to it even if it
+     * could not change that piece on its own.  The default returns False.
+     */
+    virtual bool isHolding();
+
+    /**
+     * Returns True if a text may be split at sentence boundaries and the parts
+     * converted independently, possibly in parallel by separate instances of
+     * the filter, with the same result as converting the whole text.
+     * @return                  True if this plugin supports splitting.
+     *
+     * Such a filter never looks beyond a sentence and never changes the talker.
+     * Filters that must see the whole document, such as XSLT transforms, keep
+     * the default of False and are always given the whole text.
+     */
+    virtual bool supportsSplitting();
+
+    /**
+     * Returns True if all the filter does is choose a talker by a simple rule,
+     * and describes the rule.
+     * @param pattern           Regular expression that must occur in the text.
+     *                          If empty, any text matches.
+     * @param appIds            The application's id must contain one of these.
+     *                          If empty, any application matches.
+     * @param talkerCode        Talker chosen when the rule matches.
+     *
+     * Instead of running such filters one by one, the filter manager evaluates
+     * their rules together, in one pass over the text and before all other
+     * filters, so that those see the final talker.
+     */
+    virtual bool talkerRule(QString* pattern, QStringList* appIds, TalkerCode* talkerCode);
+
+    /**
+     * Returns True if the filter can only change a text that contains at
+     * least one of some characters, and gives those characters.
+     * @param chars             Receives the characters.
+     *
+     * The filter manager looks for them before calling the filter, and passes
+     * a text without any of them on as it is.  The characters must be known
+     * after @ref init.  The default returns False: any text may change.
+     */
+    virtual bool firstChars(QString* chars);
+
+    /**
+     * Convert the next piece of a stream.
+     * @param chunk             Next piece of input text.
+     * @param talkerCode        TalkerCode structure for the talker that KTTSD intends to
+     *                          use for synthing the text.
+     * @param appId             The DBUS appId of the application that queued the text.
+     * @return                  Converted text that will not change any more.  May be
+     *                          empty if the filter holds back all of it.
+     *
+     * The results of all feed calls and the final @ref flush, concatenated, are the
+     * output @ref convert would give for the whole text as long as no match is
+     * longer than @ref holdback.  The default implementation converts each piece
+     * on its own.
+     */
+    virtual QString feed(const QString& chunk, TalkerCode* talkerCode, const QString& appId);
+
+    /**
+     * Ends a stream.
+     * @return                  Converted text the filter was holding back.
+     */
+    virtual QString flush(TalkerCode* talkerCode, const QString& appId);
+
 signals:
     /**
      * Emitted when asynchronous filtering has completed.
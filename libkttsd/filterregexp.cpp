@@ -0,0 +1,1051 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Regular expressions for filter rules, compiled once with PCRE2.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+// FilterRegExp includes.
+#include "filterregexp.h"
+
+// Qt includes.
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QPair>
+#include <QtCore/QRegExp>
+#include <QtCore/QSharedData>
+
+// KDE includes.
+#include <kdebug.h>
+#include <kglobal.h>
+#include <klocale.h>
+
+#include <config-jovie.h>
+
+#ifdef PCRE2_FOUND
+#define PCRE2_CODE_UNIT_WIDTH 16
+#include <pcre2.h>
+// Before PCRE2 10.34 every text would have to be checked for valid UTF-16
+// before each match; QRegExp is faster than that.
+#ifdef PCRE2_MATCH_INVALID_UTF
+#define USE_PCRE2
+#endif
+#endif
+
+static int hexDigit(QChar c)
+{
+    const ushort u = c.unicode();
+    if (u >= '0' && u <= '9') return u - '0';
+    if (u >= 'a' && u <= 'f') return u - 'a' + 10;
+    if (u >= 'A' && u <= 'F') return u - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Rewrites the escapes that QRegExp reads differently from PCRE2.  QRegExp
+ * takes up to four hex digits after \x and up to three octal digits after
+ * \0; PCRE2 would take two of either.  \v is a vertical tab to QRegExp and
+ * any vertical space to PCRE2.
+ */
+static QString toPcre2Pattern(const QString& pattern)
+{
+    QString result;
+    result.reserve(pattern.length() + 8);
+    const int length = pattern.length();
+    int i = 0;
+    while (i < length)
+    {
+        const QChar c = pattern.at(i);
+        if (c != QLatin1Char('\\') || i + 1 == length)
+        {
+            result += c;
+            ++i;
+            continue;
+        }
+        const QChar next = pattern.at(i + 1);
+        if (next == QLatin1Char('v'))
+        {
+            result += QLatin1String("\\x{b}");
+            i += 2;
+            continue;
+        }
+        int base = 0;
+        int maxDigits = 0;
+        if (next == QLatin1Char('x'))
+        {
+            base = 16;
+            maxDigits = 4;
+        }
+        else if (next == QLatin1Char('0'))
+        {
+            base = 8;
+            maxDigits = 3;
+        }
+        int end = i + 2;
+        uint value = 0;
+        while (base && end < length && end < i + 2 + maxDigits)
+        {
+            const int digit = hexDigit(pattern.at(end));
+            if (digit < 0 || digit >= base)
+                break;
+            value = value * base + digit;
+            ++end;
+        }
+        if (base == 0 || (base == 16 && end == i + 2))
+        {
+            // Any other escape means the same to both.
+            result += c;
+            result += next;
+            i += 2;
+            continue;
+        }
+        result += QLatin1String("\\x{") + QString::number(value, 16) + QLatin1Char('}');
+        i = end;
+    }
+    return result;
+}
+
+// What findHazard() knows about the first character an alternative can match.
+enum {
+    AnyFirst = -1,              /* A class, or an optional atom. */
+    NoFirst = -2                /* The alternative is empty. */
+};
+
+// A group findHazard() is in.
+struct HazardGroup
+{
+    HazardGroup() : unbounded(false), alternation(false), atStart(true) { }
+    bool unbounded;             /* Something inside repeats without bound. */
+    bool alternation;
+    bool atStart;               /* No atom in the current alternative yet. */
+    QList<int> firsts;          /* First character of each alternative. */
+};
+
+static bool overlap(const QList<int>& firsts)
+{
+    int alternatives = 0;
+    bool any = false;
+    for (int i = 0; i < firsts.count(); ++i)
+    {
+        if (firsts.at(i) == NoFirst)
+            continue;
+        ++alternatives;
+        if (firsts.at(i) == AnyFirst)
+            any = true;
+        else if (firsts.indexOf(firsts.at(i)) != i)
+            return true;
+    }
+    return any && alternatives > 1;
+}
+
+/**
+ * Looks for repeated groups that let a backtracking matcher try exponentially
+ * many ways to split a text: groups that repeat without bound and contain a
+ * repetition without bound themselves, as in (a+)+ or (\w+\s?)*, and groups
+ * that repeat without bound and have alternatives that can begin with the
+ * same character, as in (a|ab)*.  The test is conservative: classes count as
+ * matching anything.
+ */
+static FilterRegExp::Hazard findHazard(const QString& pattern)
+{
+    QList<HazardGroup> groups;
+    groups.append(HazardGroup());
+    const int length = pattern.length();
+    int i = 0;
+    while (i < length)
+    {
+        const QChar c = pattern.at(i);
+        int first = AnyFirst;
+        bool closed = false;
+        HazardGroup group;
+        if (c == QLatin1Char('\\'))
+        {
+            if (i + 1 == length)
+                break;
+            const QChar next = pattern.at(i + 1);
+            i += 2;
+            if (next == QLatin1Char('b') || next == QLatin1Char('B'))
+                continue;
+            if (!next.isLetterOrNumber())
+                first = next.toCaseFolded().unicode();
+            else
+            {
+                // Classes, back references and numeric escapes.
+                while (next == QLatin1Char('x') && i < length && hexDigit(pattern.at(i)) >= 0)
+                    ++i;
+            }
+        }
+        else if (c == QLatin1Char('['))
+        {
+            int end = i + 1;
+            if (end < length && pattern.at(end) == QLatin1Char('^'))
+                ++end;
+            if (end < length && pattern.at(end) == QLatin1Char(']'))
+                ++end;
+            while (end < length && pattern.at(end) != QLatin1Char(']'))
+                end += pattern.at(end) == QLatin1Char('\\') ? 2 : 1;
+            i = end + 1;
+        }
+        else if (c == QLatin1Char('('))
+        {
+            const QString kind = pattern.mid(i, 3);
+            const bool special = kind == QLatin1String("(?:") || kind == QLatin1String("(?=") ||
+                kind == QLatin1String("(?!");
+            // Other (? groups, such as (?i), (?<=...) or (?R), are not
+            // QRegExp syntax and cannot be analysed here.  Assume the worst.
+            if (!special && i + 1 < length && pattern.at(i + 1) == QLatin1Char('?'))
+                return FilterRegExp::NestedRepetition;
+            groups.append(HazardGroup());
+            i += special ? 3 : 1;
+            continue;
+        }
+        else if (c == QLatin1Char(')'))
+        {
+            ++i;
+            if (groups.count() == 1)
+                continue;
+            group = groups.takeLast();
+            if (group.atStart)
+                group.firsts.append(NoFirst);
+            closed = true;
+            first = group.firsts.count() == 1 ? group.firsts.first() : AnyFirst;
+        }
+        else if (c == QLatin1Char('|'))
+        {
+            HazardGroup& top = groups.last();
+            if (top.atStart)
+                top.firsts.append(NoFirst);
+            top.alternation = true;
+            top.atStart = true;
+            ++i;
+            continue;
+        }
+        else if (c == QLatin1Char('^') || c == QLatin1Char('$') || c == QLatin1Char('*') ||
+            c == QLatin1Char('+') || c == QLatin1Char('?'))
+        {
+            ++i;
+            continue;
+        }
+        else
+        {
+            if (c != QLatin1Char('.'))
+                first = c.toCaseFolded().unicode();
+            ++i;
+        }
+
+        // The quantifiers of the atom, if any.  A quantifier after another,
+        // as in x*? or x{2}+, is not QRegExp syntax; take the atom to repeat
+        // as much as either allows.
+        bool unbounded = false;
+        bool optional = false;
+        while (i < length)
+        {
+            const QChar q = pattern.at(i);
+            if (q == QLatin1Char('*') || q == QLatin1Char('+'))
+            {
+                unbounded = true;
+                optional = optional || q == QLatin1Char('*');
+                ++i;
+            }
+            else if (q == QLatin1Char('?'))
+            {
+                optional = true;
+                ++i;
+            }
+            else if (q == QLatin1Char('{'))
+            {
+                const int end = pattern.indexOf(QLatin1Char('}'), i);
+                if (end == -1)
+                    break;
+                const QString bounds = pattern.mid(i + 1, end - i - 1);
+                unbounded = unbounded || bounds.endsWith(QLatin1Char(','));
+                optional = optional || bounds.startsWith(QLatin1Char('0')) || bounds.startsWith(QLatin1Char(','));
+                i = end + 1;
+            }
+            else
+                break;
+        }
+
+        HazardGroup& top = groups.last();
+        if (closed && unbounded)
+        {
+            if (group.unbounded)
+                return FilterRegExp::NestedRepetition;
+            if (group.alternation && overlap(group.firsts))
+                return FilterRegExp::OverlappingAlternatives;
+        }
+        top.unbounded = top.unbounded || unbounded || (closed && group.unbounded);
+        if (top.atStart)
+        {
+            top.firsts.append(optional ? AnyFirst : first);
+            top.atStart = false;
+        }
+    }
+    return FilterRegExp::NoHazard;
+}
+
+// What findFirstChars() knows about the start of a part of a pattern.
+struct FirstChars
+{
+    FirstChars() : any(false), empty(true), unknown(false) { }
+    bool any;                   /* Can begin with a character not in chars. */
+    bool empty;                 /* Can match the empty string. */
+    bool unknown;               /* Has syntax that is not QRegExp's. */
+    QString chars;
+};
+
+// Reads the escape at pattern[i], just after a backslash, that stands for
+// one character.  Returns the character, or -1 for classes such as \w,
+// back references and other escapes that do not.
+static int escapedChar(const QString& pattern, int* i)
+{
+    const int length = pattern.length();
+    const QChar next = pattern.at(*i);
+    ++*i;
+    if (!next.isLetterOrNumber())
+        return next.unicode();
+    int base = 0;
+    int maxDigits = 0;
+    switch (next.unicode())
+    {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case 'a': return '\a';
+        case 'x': base = 16; maxDigits = 4; break;
+        case '0': base = 8; maxDigits = 3; break;
+        default: return -1;
+    }
+    const int start = *i;
+    int value = 0;
+    while (*i < length && *i < start + maxDigits)
+    {
+        const int digit = hexDigit(pattern.at(*i));
+        if (digit < 0 || digit >= base)
+            break;
+        value = value * base + digit;
+        ++*i;
+    }
+    if (base == 16 && *i == start)
+        return -1;
+    return value;
+}
+
+// Reads the class at pattern[i], just after the [.
+static FirstChars firstOfClass(const QString& pattern, int* i)
+{
+    FirstChars result;
+    result.empty = false;
+    const int length = pattern.length();
+    if (*i < length && pattern.at(*i) == QLatin1Char('^'))
+    {
+        result.any = true;
+        ++*i;
+    }
+    bool first = true;
+    while (*i < length && (first || pattern.at(*i) != QLatin1Char(']')))
+    {
+        first = false;
+        int from = pattern.at(*i).unicode();
+        ++*i;
+        if (from == '\\' && *i < length)
+            from = escapedChar(pattern, i);
+        int to = from;
+        if (*i + 1 < length && pattern.at(*i) == QLatin1Char('-') && pattern.at(*i + 1) != QLatin1Char(']'))
+        {
+            ++*i;
+            to = pattern.at(*i).unicode();
+            ++*i;
+            if (to == '\\' && *i < length)
+                to = escapedChar(pattern, i);
+        }
+        // Classes such as \w, surrogates and long ranges are not listed.
+        if (from < 0 || to < from || to - from > 256 || (from <= 0xdfff && to >= 0xd800))
+        {
+            result.any = true;
+            continue;
+        }
+        for (int c = from; c <= to; ++c)
+            result.chars += QChar(c);
+    }
+    ++*i;
+    return result;
+}
+
+static void firstOfAlternatives(const QString& pattern, int* i, FirstChars* result);
+
+// Reads the atom at pattern[i].
+static FirstChars firstOfAtom(const QString& pattern, int* i)
+{
+    FirstChars result;
+    const int length = pattern.length();
+    const QChar c = pattern.at(*i);
+    ++*i;
+    if (c == QLatin1Char('\\'))
+    {
+        if (*i == length)
+        {
+            result.any = true;
+            return result;
+        }
+        const QChar next = pattern.at(*i);
+        if (next == QLatin1Char('b') || next == QLatin1Char('B'))
+        {
+            ++*i;
+            return result;
+        }
+        const int code = escapedChar(pattern, i);
+        // A back reference may be empty, and it begins with anything.
+        result.any = code < 0;
+        result.empty = code < 0 && next.isDigit();
+        if (code >= 0)
+            result.chars += QChar(code);
+    }
+    else if (c == QLatin1Char('['))
+        result = firstOfClass(pattern, i);
+    else if (c == QLatin1Char('('))
+    {
+        const QString kind = pattern.mid(*i - 1, 3);
+        const bool lookahead = kind == QLatin1String("(?=") || kind == QLatin1String("(?!");
+        if (lookahead || kind == QLatin1String("(?:"))
+            *i += 2;
+        else if (*i < length && pattern.at(*i) == QLatin1Char('?'))
+        {
+            // (?i), (?<=...) and the like are PCRE2's, not QRegExp's.
+            result.unknown = true;
+            return result;
+        }
+        firstOfAlternatives(pattern, i, &result);
+        if (*i < length)
+            ++*i;
+        // A lookahead matches no characters itself.
+        if (lookahead)
+        {
+            const bool unknown = result.unknown;
+            result = FirstChars();
+            result.unknown = unknown;
+        }
+    }
+    else if (c == QLatin1Char('*') || c == QLatin1Char('+') || c == QLatin1Char('?'))
+    {
+        // A quantifier without an atom.
+        result.unknown = true;
+        return result;
+    }
+    else if (c == QLatin1Char('^') || c == QLatin1Char('$'))
+        return result;
+    else if (c == QLatin1Char('.'))
+    {
+        result.any = true;
+        result.empty = false;
+    }
+    else
+    {
+        result.empty = false;
+        result.chars += c;
+        // A character outside the Basic Multilingual Plane is one atom.
+        if (c.isHighSurrogate() && *i < length && pattern.at(*i).isLowSurrogate())
+            ++*i;
+    }
+    return result;
+}
+
+// Reads alternatives up to the ) that closes them or the end of the pattern.
+static void firstOfAlternatives(const QString& pattern, int* i, FirstChars* result)
+{
+    const int length = pattern.length();
+    result->empty = false;
+    bool empty = true;
+    while (*i < length && pattern.at(*i) != QLatin1Char(')'))
+    {
+        if (pattern.at(*i) == QLatin1Char('|'))
+        {
+            result->empty = result->empty || empty;
+            empty = true;
+            ++*i;
+            continue;
+        }
+        const FirstChars atom = firstOfAtom(pattern, i);
+        if (atom.unknown)
+        {
+            result->unknown = true;
+            return;
+        }
+        bool optional = false;
+        if (*i < length)
+        {
+            const QChar q = pattern.at(*i);
+            bool quantified = true;
+            if (q == QLatin1Char('*') || q == QLatin1Char('?'))
+            {
+                optional = true;
+                ++*i;
+            }
+            else if (q == QLatin1Char('+'))
+                ++*i;
+            else if (q == QLatin1Char('{') && pattern.indexOf(QLatin1Char('}'), *i) != -1)
+            {
+                const int end = pattern.indexOf(QLatin1Char('}'), *i);
+                optional = pattern.at(*i + 1) == QLatin1Char('0') || pattern.at(*i + 1) == QLatin1Char(',');
+                *i = end + 1;
+            }
+            else
+                quantified = false;
+            // A quantifier after another, as in x*?, is not QRegExp syntax.
+            if (quantified && *i < length &&
+                QString::fromLatin1("*+?{").contains(pattern.at(*i)))
+            {
+                result->unknown = true;
+                return;
+            }
+        }
+        // Only atoms that all the atoms before them may leave out can begin
+        // the match.
+        if (empty)
+        {
+            result->chars += atom.chars;
+            result->any = result->any || atom.any;
+            empty = atom.empty || optional;
+        }
+    }
+    result->empty = result->empty || empty;
+}
+
+// The characters whose case a match may ignore, keyed by the lower case
+// folded character.
+class CaseVariants
+{
+public:
+    CaseVariants()
+    {
+        for (uint u = 0; u < 0x10000; ++u)
+        {
+            if (u >= 0xd800 && u <= 0xdfff)
+                continue;
+            const QChar c(u);
+            const ushort k = key(c);
+            if (k != u)
+                m_variants[k] += c;
+        }
+    }
+
+    static ushort key(QChar c) { return c.toLower().toCaseFolded().unicode(); }
+
+    QString variants(QChar c) const
+    {
+        const ushort k = key(c);
+        return QString(c) + QChar(k) + m_variants.value(k);
+    }
+
+private:
+    QHash<ushort, QString> m_variants;
+};
+
+K_GLOBAL_STATIC(CaseVariants, s_caseVariants)
+
+/**
+ * Lists the characters a match of a pattern can begin with.  Returns False
+ * if it can begin with any character, as with \w, . or a negated class, or
+ * if it can be empty, as with x* or ^.
+ */
+static bool findFirstChars(const QString& pattern, Qt::CaseSensitivity cs, QString* chars)
+{
+    FirstChars result;
+    int i = 0;
+    firstOfAlternatives(pattern, &i, &result);
+    if (result.unknown || result.any || result.empty || i < pattern.length())
+        return false;
+    if (cs == Qt::CaseInsensitive)
+    {
+        const QString exact = result.chars;
+        foreach (const QChar& c, exact)
+            result.chars += s_caseVariants->variants(c);
+    }
+    // Each character once, in order.
+    QString unique;
+    foreach (const QChar& c, result.chars)
+    {
+        if (!unique.contains(c))
+            unique += c;
+    }
+    *chars = unique;
+    return true;
+}
+
+/**
+ * A compiled pattern, shared by copies of a FilterRegExp.
+ */
+class FilterRegExpCode : public QSharedData
+{
+public:
+    FilterRegExpCode();
+    FilterRegExpCode(const QString& pattern, Qt::CaseSensitivity cs);
+    ~FilterRegExpCode();
+
+    QString pattern;
+    Qt::CaseSensitivity cs;
+    bool valid;
+    bool jit;
+    int captureCount;
+    FilterRegExp::Hazard hazard;
+    bool firstKnown;
+    QString firstChars;         /* Characters a match can begin with, if known. */
+#ifdef USE_PCRE2
+    pcre2_code* code;           /* Null if QRegExp matches the pattern. */
+#endif
+};
+
+// The empty pattern is left to QRegExp, so that default constructed
+// expressions cost no compiling.
+FilterRegExpCode::FilterRegExpCode() :
+    cs(Qt::CaseSensitive),
+    valid(true),
+    jit(false),
+    captureCount(0),
+    hazard(FilterRegExp::NoHazard),
+    firstKnown(false)
+#ifdef USE_PCRE2
+    , code(0)
+#endif
+{
+}
+
+FilterRegExpCode::FilterRegExpCode(const QString& pattern, Qt::CaseSensitivity cs) :
+    pattern(pattern),
+    cs(cs),
+    valid(false),
+    jit(false),
+    captureCount(0),
+    hazard(findHazard(pattern)),
+    firstKnown(findFirstChars(pattern, cs, &firstChars))
+{
+    // Patterns are written for QRegExp.  PCRE2 compiles some that QRegExp
+    // rejects, such as (?i) or lookbehinds, and would give them a meaning
+    // of its own.
+    QRegExp rx(pattern, cs);
+    if (!rx.isValid())
+    {
+        firstKnown = false;
+        return;
+    }
+#ifdef USE_PCRE2
+    // DOTALL and DOLLAR_ENDONLY give . and $ their QRegExp meaning.  UCP
+    // makes \w, \d, \s and \b follow Unicode properties, as QChar does.
+    uint32_t options = PCRE2_UTF | PCRE2_UCP | PCRE2_MATCH_INVALID_UTF |
+        PCRE2_DOTALL | PCRE2_DOLLAR_ENDONLY;
+    if (cs == Qt::CaseInsensitive)
+        options |= PCRE2_CASELESS;
+    const QString translated = toPcre2Pattern(pattern);
+    int errorCode;
+    PCRE2_SIZE errorOffset;
+    code = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(translated.constData()), translated.length(),
+        options, &errorCode, &errorOffset, NULL);
+    if (code)
+    {
+        uint32_t count = 0;
+        pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &count);
+        captureCount = count;
+        jit = pcre2_jit_compile(code, PCRE2_JIT_COMPLETE) == 0;
+        valid = true;
+        return;
+    }
+    PCRE2_UCHAR message[256];
+    pcre2_get_error_message(errorCode, message, sizeof(message) / sizeof(PCRE2_UCHAR));
+    kDebug() << "FilterRegExp: PCRE2 rejects " << pattern << " at " << int(errorOffset) << ": "
+        << QString::fromUtf16(message) << ", matching it with QRegExp";
+#endif
+    valid = true;
+    captureCount = rx.captureCount();
+}
+
+FilterRegExpCode::~FilterRegExpCode()
+{
+#ifdef USE_PCRE2
+    if (code)
+        pcre2_code_free(code);
+#endif
+}
+
+/**
+ * Compiled patterns by pattern and case sensitivity.  Each FilterMgr of the
+ * pool loads filters of its own, and the same word list is compiled, and
+ * JIT compiled, only once for all of them.  Compiled code is only read when
+ * matching, so threads can share it.
+ */
+class CodeCache
+{
+public:
+    CodeCache() : purgeAt(MinPurge) {}
+    QExplicitlySharedDataPointer<FilterRegExpCode> code(const QString& pattern, Qt::CaseSensitivity cs);
+
+private:
+    enum { MinPurge = 256 };
+    typedef QPair<QString, int> Key;
+    QMutex mutex;
+    QHash<Key, QExplicitlySharedDataPointer<FilterRegExpCode> > codes;
+    int purgeAt;                /* Size at which unused codes are dropped. */
+};
+
+K_GLOBAL_STATIC(CodeCache, s_codeCache)
+
+QExplicitlySharedDataPointer<FilterRegExpCode> CodeCache::code(const QString& pattern, Qt::CaseSensitivity cs)
+{
+    const Key key(pattern, int(cs));
+    {
+        QMutexLocker locker(&mutex);
+        QHash<Key, QExplicitlySharedDataPointer<FilterRegExpCode> >::const_iterator it = codes.constFind(key);
+        if (it != codes.constEnd())
+            return *it;
+    }
+    // Compile without holding up the other threads.
+    QExplicitlySharedDataPointer<FilterRegExpCode> compiled(new FilterRegExpCode(pattern, cs));
+    QMutexLocker locker(&mutex);
+    QHash<Key, QExplicitlySharedDataPointer<FilterRegExpCode> >::iterator it = codes.find(key);
+    if (it != codes.end())
+        return *it;
+    if (codes.count() >= purgeAt)
+    {
+        // Drop the codes of filters that were unloaded.  Only the cache can
+        // hand out another reference to a code nothing else holds.
+        it = codes.begin();
+        while (it != codes.end())
+        {
+            if (int((*it)->ref) == 1)
+                it = codes.erase(it);
+            else
+                ++it;
+        }
+        purgeAt = qMax(int(MinPurge), 2 * codes.count());
+    }
+    codes.insert(key, compiled);
+    return compiled;
+}
+
+class FilterRegExp::Private
+{
+public:
+    Private() :
+#ifdef USE_PCRE2
+        matchData(0),
+        matchContext(0),
+#endif
+        matchLimit(DefaultMatchLimit),
+        matched(false),
+        limitReached(false)
+    {
+    }
+
+    ~Private()
+    {
+#ifdef USE_PCRE2
+        if (matchData)
+            pcre2_match_data_free(matchData);
+        if (matchContext)
+            pcre2_match_context_free(matchContext);
+#endif
+    }
+
+    void attach(FilterRegExpCode* compiled);
+    int match(const QString& str, int offset, bool anchored);
+    // Length of group nth of the last match, or -1.
+    int length(int nth) const;
+
+    QExplicitlySharedDataPointer<FilterRegExpCode> code;
+#ifdef USE_PCRE2
+    pcre2_match_data* matchData;
+    pcre2_match_context* matchContext;
+#endif
+    QRegExp regExp;             /* Used if there is no compiled code. */
+    int matchLimit;
+    bool matched;
+    bool limitReached;
+};
+
+void FilterRegExp::Private::attach(FilterRegExpCode* compiled)
+{
+    code = compiled;
+    matched = false;
+#ifdef USE_PCRE2
+    if (matchData)
+        pcre2_match_data_free(matchData);
+    matchData = 0;
+    if (code->code)
+    {
+        matchData = pcre2_match_data_create_from_pattern(code->code, NULL);
+        if (!matchContext)
+            matchContext = pcre2_match_context_create(NULL);
+        pcre2_set_match_limit(matchContext, matchLimit);
+        regExp = QRegExp();
+        return;
+    }
+#endif
+    regExp = QRegExp(code->pattern, code->cs);
+}
+
+int FilterRegExp::Private::match(const QString& str, int offset, bool anchored)
+{
+    limitReached = false;
+    if (offset < 0)
+        offset += str.length();
+    if (offset < 0 || offset > str.length())
+    {
+        matched = false;
+        return -1;
+    }
+#ifdef USE_PCRE2
+    if (code->code)
+    {
+        const PCRE2_SPTR subject = reinterpret_cast<PCRE2_SPTR>(str.constData());
+        uint32_t options = anchored ? PCRE2_ANCHORED : 0;
+        int rc = pcre2_match(code->code, subject, str.length(), offset, options, matchData, matchContext);
+        if (rc == PCRE2_ERROR_JIT_STACKLIMIT)
+        {
+            // The interpreter keeps its backtracking state on the heap.
+            rc = pcre2_match(code->code, subject, str.length(), offset, options | PCRE2_NO_JIT,
+                matchData, matchContext);
+        }
+        matched = rc > 0;
+        limitReached = rc == PCRE2_ERROR_MATCHLIMIT || rc == PCRE2_ERROR_DEPTHLIMIT ||
+            rc == PCRE2_ERROR_HEAPLIMIT;
+        if (rc < 0 && rc != PCRE2_ERROR_NOMATCH && !limitReached)
+            kDebug() << "FilterRegExp::match: error " << rc << " matching " << code->pattern;
+        return matched ? int(pcre2_get_ovector_pointer(matchData)[0]) : -1;
+    }
+#endif
+    int found = regExp.indexIn(str, offset);
+    // The leftmost match starts at the offset if any match does.
+    if (anchored && found != offset)
+        found = -1;
+    matched = found != -1;
+    return found;
+}
+
+int FilterRegExp::Private::length(int nth) const
+{
+    if (!matched || nth < 0 || nth > code->captureCount)
+        return -1;
+#ifdef USE_PCRE2
+    if (code->code)
+    {
+        const PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(matchData);
+        return ovector[2 * nth] == PCRE2_UNSET ? -1 : int(ovector[2 * nth + 1] - ovector[2 * nth]);
+    }
+#endif
+    return nth == 0 ? regExp.matchedLength() : regExp.cap(nth).length();
+}
+
+FilterRegExp::FilterRegExp() :
+    d(new Private)
+{
+    d->attach(new FilterRegExpCode);
+}
+
+FilterRegExp::FilterRegExp(const QString& pattern, Qt::CaseSensitivity cs) :
+    d(new Private)
+{
+    if (s_codeCache.isDestroyed())
+        d->attach(new FilterRegExpCode(pattern, cs));
+    else
+        d->attach(s_codeCache->code(pattern, cs).data());
+}
+
+FilterRegExp::FilterRegExp(const FilterRegExp& other) :
+    d(new Private)
+{
+    d->matchLimit = other.d->matchLimit;
+    d->attach(other.d->code.data());
+}
+
+FilterRegExp::~FilterRegExp()
+{
+    delete d;
+}
+
+FilterRegExp& FilterRegExp::operator=(const FilterRegExp& other)
+{
+    if (this != &other)
+    {
+        d->matchLimit = other.d->matchLimit;
+        d->attach(other.d->code.data());
+    }
+    return *this;
+}
+
+bool FilterRegExp::isValid() const { return d->code->valid; }
+
+QString FilterRegExp::pattern() const { return d->code->pattern; }
+
+Qt::CaseSensitivity FilterRegExp::caseSensitivity() const { return d->code->cs; }
+
+int FilterRegExp::captureCount() const { return d->code->captureCount; }
+
+bool FilterRegExp::isJitCompiled() const { return d->code->jit; }
+
+FilterRegExp::Hazard FilterRegExp::hazard() const { return d->code->hazard; }
+
+bool FilterRegExp::firstChars(QString* chars) const
+{
+    if (!d->code->valid || !d->code->firstKnown)
+        return false;
+    *chars = d->code->firstChars;
+    return true;
+}
+
+bool FilterRegExp::hasMatchLimit() const
+{
+#ifdef USE_PCRE2
+    return d->code->code != 0;
+#else
+    return false;
+#endif
+}
+
+bool FilterRegExp::isUsable() const
+{
+    return isValid() && (hazard() == NoHazard || hasMatchLimit());
+}
+
+QString FilterRegExp::warning() const
+{
+    if (!isValid())
+        return i18n("This is not a valid regular expression.");
+    QString construct;
+    switch (hazard())
+    {
+        case NoHazard:
+            return QString();
+        case NestedRepetition:
+            construct = i18n("A repeated group contains another repetition, so matching can take very long.");
+            break;
+        case OverlappingAlternatives:
+            construct = i18n("A repeated group has alternatives that can begin alike, so matching can take very long.");
+            break;
+    }
+    if (hasMatchLimit())
+        return construct + QLatin1Char(' ') + i18n("Jovie gives up on it for texts where it takes too long.");
+    return construct + QLatin1Char(' ') + i18n("Jovie cannot limit how long it takes and will not use it.");
+}
+
+void FilterRegExp::setMatchLimit(int steps)
+{
+    d->matchLimit = steps;
+#ifdef USE_PCRE2
+    if (d->matchContext)
+        pcre2_set_match_limit(d->matchContext, steps);
+#endif
+}
+
+int FilterRegExp::matchLimit() const { return d->matchLimit; }
+
+bool FilterRegExp::limitReached() const { return d->limitReached; }
+
+int FilterRegExp::indexIn(const QString& str, int offset) const
+{
+    return d->match(str, offset, false);
+}
+
+bool FilterRegExp::matchesAt(const QString& str, int offset) const
+{
+    return d->match(str, offset, true) == offset;
+}
+
+int FilterRegExp::matchedLength() const
+{
+    return d->length(0);
+}
+
+int FilterRegExp::pos(int nth) const
+{
+    if (!d->matched || nth < 0 || nth > d->code->captureCount)
+        return -1;
+#ifdef USE_PCRE2
+    if (d->code->code)
+    {
+        const PCRE2_SIZE start = pcre2_get_ovector_pointer(d->matchData)[2 * nth];
+        return start == PCRE2_UNSET ? -1 : int(start);
+    }
+#endif
+    return d->regExp.pos(nth);
+}
+
+int FilterRegExp::replace(QString& str, const QString& after) const
+{
+    const int captures = d->code->captureCount;
+    QString result;
+    int count = 0;
+    int copied = 0;
+    int offset = 0;
+    while (offset <= str.length())
+    {
+        const int found = d->match(str, offset, false);
+        if (d->limitReached)
+            return 0;
+        if (found == -1)
+            break;
+        const int length = matchedLength();
+        if (count == 0)
+            result.reserve(str.length() + after.length());
+        result += str.midRef(copied, found - copied);
+
+        // Substitute the captured groups for \1 to \99.
+        const int afterLength = after.length();
+        for (int i = 0; i < afterLength; ++i)
+        {
+            const QChar c = after.at(i);
+            int group = -1;
+            if (c == QLatin1Char('\\') && i + 1 < afterLength && captures > 0)
+            {
+                group = after.at(i + 1).digitValue();
+                if (group > 0 && group <= captures)
+                {
+                    ++i;
+                    if (i + 1 < afterLength)
+                    {
+                        const int second = after.at(i + 1).digitValue();
+                        if (second != -1 && group * 10 + second <= captures)
+                        {
+                            group = group * 10 + second;
+                            ++i;
+                        }
+                    }
+                }
+                else
+                    group = -1;
+            }
+            if (group == -1)
+            {
+                result += c;
+                continue;
+            }
+            const int start = pos(group);
+            if (start != -1)
+                result += str.midRef(start, d->length(group));
+        }
+
+        ++count;
+        copied = found + length;
+        // After an empty match, look again one character on.
+        offset = copied + (length == 0 ? 1 : 0);
+    }
+    if (count == 0)
+        return 0;
+    result += str.midRef(copied);
+    str = result;
+    return count;
+}
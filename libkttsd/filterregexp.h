@@ -0,0 +1,206 @@
+/***************************************************** vim:set ts=4 sw=4 sts=4:
+  Regular expressions for filter rules, compiled once with PCRE2.
+  -------------------
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ******************************************************************************/
+
+#ifndef FILTERREGEXP_H
+#define FILTERREGEXP_H
+
+// Qt includes.
+#include <QtCore/QString>
+
+// KDE includes.
+#include <kdemacros.h>
+
+/**
+ * @class FilterRegExp
+ *
+ * A regular expression in QRegExp's RegExp syntax, as filter rules and
+ * sentence delimiters are written.  If Jovie is built with PCRE2, the
+ * pattern is compiled once, to machine code where PCRE2's JIT supports the
+ * processor, rather than interpreted by QRegExp on every match.  Otherwise,
+ * and for patterns PCRE2 rejects, QRegExp does the matching.
+ *
+ * Matches have QRegExp's meaning:
+ * - . matches any character, including a newline.  ^ matches at the start
+ *   of the text only, $ at its end only.
+ * - \\w, \\d, \\s and \\b go by Unicode character properties, so a Word
+ *   rule "\\bword\\b" finds whole words in any script.
+ * - \\xhhhh takes up to four hex digits, \\0ooo up to three octal digits.
+ *   \\v is a vertical tab.
+ * - A pattern QRegExp rejects is not valid, even if PCRE2 would compile it.
+ *
+ * Users type patterns into the filter configuration, and a pattern such as
+ * "(a+)+" can take exponential time to fail on a long text.  hazard() tells
+ * such patterns from others when they are compiled, and each match gives up
+ * after matchLimit() backtracking steps.  Patterns matched by QRegExp cannot
+ * be limited, so filters do not use those with a hazard; see isUsable().
+ *
+ * Copies, and expressions constructed from the same pattern, share the
+ * compiled pattern, even across threads.  Like QRegExp, each object
+ * remembers its last match, so one object must not be used by two threads
+ * at once.
+ */
+class KDE_EXPORT FilterRegExp
+{
+public:
+    /**
+     * Constructs that can make a backtracking match take exponential time.
+     */
+    enum Hazard {
+        NoHazard = 0,
+        NestedRepetition = 1,           /* A repeated group repeats inside, as in (a+)+ */
+        OverlappingAlternatives = 2     /* A repeated group has alternatives that begin alike, as in (a|ab)* */
+    };
+
+    enum {
+        DefaultMatchLimit = 1000000     /* Backtracking steps a match may take, a few milliseconds. */
+    };
+
+    /**
+     * Constructs an empty expression, which matches everywhere.
+     */
+    FilterRegExp();
+
+    /**
+     * Compiles a pattern.
+     * @param pattern        Regular expression in QRegExp's RegExp syntax.
+     * @param cs             Whether letter case must match.
+     */
+    explicit FilterRegExp(const QString& pattern, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    FilterRegExp(const FilterRegExp& other);
+    ~FilterRegExp();
+    FilterRegExp& operator=(const FilterRegExp& other);
+
+    /**
+     * Returns True if the pattern compiled.
+     */
+    bool isValid() const;
+
+    /**
+     * Returns the pattern as given.
+     */
+    QString pattern() const;
+
+    /**
+     * Returns the case sensitivity given.
+     */
+    Qt::CaseSensitivity caseSensitivity() const;
+
+    /**
+     * Returns the number of capturing groups in the pattern.
+     */
+    int captureCount() const;
+
+    /**
+     * Returns True if the pattern is matched by machine code, False if it is
+     * interpreted.
+     */
+    bool isJitCompiled() const;
+
+    /**
+     * Returns the construct found in the pattern that can take exponential
+     * time, if any.
+     */
+    Hazard hazard() const;
+
+    /**
+     * Gives the characters every match begins with one of, in either case if
+     * letter case does not matter.  A text without any of them has no match.
+     * @param chars          Receives the characters.
+     * @return               False if they are not known: the pattern is not
+     *                       valid, a match can be empty, or can begin with
+     *                       characters too many to list, as with \\w or .
+     */
+    bool firstChars(QString* chars) const;
+
+    /**
+     * Returns True if matches give up after matchLimit() steps, False if
+     * QRegExp matches the pattern without a limit.
+     */
+    bool hasMatchLimit() const;
+
+    /**
+     * Returns True if filters should use the expression: it is valid, and
+     * if it has a hazard, its matches are limited.
+     */
+    bool isUsable() const;
+
+    /**
+     * Returns a translated explanation of why the expression is not usable,
+     * or of its hazard, for configuration dialogs.  Empty if there is none.
+     */
+    QString warning() const;
+
+    /**
+     * Sets how many backtracking steps a match may take before it gives up.
+     * The default is DefaultMatchLimit.
+     */
+    void setMatchLimit(int steps);
+
+    /**
+     * Returns how many backtracking steps a match may take.
+     */
+    int matchLimit() const;
+
+    /**
+     * Returns True if the last indexIn(), matchesAt() or replace() gave up
+     * because it reached the match limit.  It then found no match, and
+     * replace() left the text as it was.
+     */
+    bool limitReached() const;
+
+    /**
+     * Finds the first match at or after an offset.
+     * @param str            Text to search.
+     * @param offset         Where to start.  If negative, counted from the end.
+     * @return               Position of the match, or -1.
+     */
+    int indexIn(const QString& str, int offset = 0) const;
+
+    /**
+     * Returns True if a match starts exactly at @p offset.  Unlike
+     * indexIn(), no other position is tried.
+     */
+    bool matchesAt(const QString& str, int offset) const;
+
+    /**
+     * Returns the length of the last match, or -1 if there was none.
+     */
+    int matchedLength() const;
+
+    /**
+     * Returns the position of capturing group @p nth in the last match, or -1
+     * if it did not take part.  Group 0 is the whole match.
+     */
+    int pos(int nth = 0) const;
+
+    /**
+     * Replaces every match in a text as QString::replace(const QRegExp&, ...)
+     * does: \\1 to \\99 in @p after stand for the captured groups.  @p str is
+     * not touched, and not copied, if nothing matches.
+     * @return               The number of matches replaced.
+     */
+    int replace(QString& str, const QString& after) const;
+
+private:
+    class Private;
+    Private* d;
+};
+
+#endif      // FILTERREGEXP_H